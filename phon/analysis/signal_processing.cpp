@@ -202,7 +202,7 @@ static std::vector<size_t> sort_indices(const std::vector<T> &v) {
 // This function is a C++ translation of the function _lpc() in librosa (in audio.py).
 // Copyright (C) librosa development team
 // License: ISC License
-static std::vector<double> lpc_burg(const Array<double> &x, int order)
+static void lpc_burg(const double *x, intptr_t n, int order, LpcWorkspace &ws, const LpcCallback *callback = nullptr)
 {
     // This implementation follows the description of Burg's algorithm given in
     // section III of Marple's paper referenced in the following paper:
@@ -216,22 +216,28 @@ static std::vector<double> lpc_burg(const Array<double> &x, int order)
     // we may use all the coefficients from the previous order while we compute
     // those for the new one. These two arrays hold ar_coeffs for order M and
     // order M-1.  (Corresponding to a_{M,k} and a_{M-1,k} in eqn 5)
-	std::vector<double> ar_coeffs(order + 1, 0.0);
+	auto &ar_coeffs = ws.coeffs;
+	auto &ar_coeffs_prev = ws.previous;
+	ar_coeffs.assign(order + 1, 0.0);
     ar_coeffs[0] = 1.0;
-    std::vector<double> ar_coeffs_prev(order + 1, 0.0);
+	ar_coeffs_prev.assign(order + 1, 0.0);
     ar_coeffs_prev[0] = 1.0;
 
     // These two arrays hold the forward and backward prediction error. They
     // correspond to f_{M-1,k} and b_{M-1,k} in eqns 10, 11, 13 and 14 of
     // Marple. First they are used to compute the reflection coefficient at
     // order M from M-1 then are re-used as f_{M,k} and b_{M,k} for each
-    // iteration of the below loop
-    std::vector<double> fwd_pred_error(x.begin()+1, x.end());
-    std::vector<double> bwd_pred_error(x.begin(), x.end()-1);
+    // iteration of the below loop. Instead of erasing the first forward error and the last backward error at the end of
+    // each iteration, we move the start of the forward errors and shrink the length of both arrays.
+	ws.forward.assign(x + 1, x + n);
+	ws.backward.assign(x, x + n - 1);
+	auto fwd_pred_error = ws.forward.data();
+	auto bwd_pred_error = ws.backward.data();
+	auto len = n - 1;
 
     // DEN_{M} from eqn 16 of Marple.
-    auto den = std::inner_product(fwd_pred_error.begin(), fwd_pred_error.end(), fwd_pred_error.begin(), 0.0) +
-    		std::inner_product(bwd_pred_error.begin(), bwd_pred_error.end(), bwd_pred_error.begin(), 0.0);
+    auto den = std::inner_product(fwd_pred_error, fwd_pred_error + len, fwd_pred_error, 0.0) +
+    		std::inner_product(bwd_pred_error, bwd_pred_error + len, bwd_pred_error, 0.0);
 
     for (int i = 0; i < order; i++)
 	{
@@ -243,13 +249,19 @@ static std::vector<double> lpc_burg(const Array<double> &x, int order)
 			for (size_t k = 0; k < ar_coeffs.size(); k++) {
 				ar_coeffs[k] = 0;
 			}
-			return ar_coeffs;
+			// Higher orders can't be estimated either.
+			for (int m = i + 1; callback && m <= order; m++)
+			{
+				ws.truncated.assign(m + 1, 0.0);
+				(*callback)(m, ws.truncated);
+			}
+			return;
 		}
 
 		// Eqn 15 of Marple, with fwd_pred_error and bwd_pred_error
 		// corresponding to f_{M-1,k+1} and b{M-1,k} and the result as a_{M,M}
 		// reflect_coeff = dtype(-2) * np.dot(bwd_pred_error, fwd_pred_error) / dtype(den)
-		auto reflect_coeff = -2 * std::inner_product(bwd_pred_error.begin(), bwd_pred_error.end(), fwd_pred_error.begin(), 0.0) / den;
+		auto reflect_coeff = -2 * std::inner_product(bwd_pred_error, bwd_pred_error + len, fwd_pred_error, 0.0) / den;
 
 		// Now we use the reflection coefficient and the AR coefficients from
 		// the last model order to compute all of the AR coefficients for the
@@ -265,16 +277,20 @@ static std::vector<double> lpc_burg(const Array<double> &x, int order)
 		for (int j = 1; j < i + 2; j++) {
 			ar_coeffs[j] = ar_coeffs_prev[j] + reflect_coeff * ar_coeffs_prev[i - j + 1];
 		}
+		if (callback)
+		{
+			ws.truncated.assign(ar_coeffs.begin(), ar_coeffs.begin() + i + 2);
+			(*callback)(i + 1, ws.truncated);
+		}
 
 		// Update the forward and backward prediction errors corresponding to
 		// eqns 13 and 14.  We start with f_{M-1,k+1} and b_{M-1,k} and use them
 		// to compute f_{M,k} and b_{M,k}
-		auto fwd_pred_error_tmp = fwd_pred_error;
-		for (size_t k = 0; k < fwd_pred_error.size(); k++) {
-			fwd_pred_error[k] = fwd_pred_error[k] + reflect_coeff * bwd_pred_error[k];
-		}
-		for (size_t k = 0; k < bwd_pred_error.size(); k++) {
-			bwd_pred_error[k] = bwd_pred_error[k] + reflect_coeff * fwd_pred_error_tmp[k];
+		for (intptr_t k = 0; k < len; k++)
+		{
+			auto f = fwd_pred_error[k];
+			fwd_pred_error[k] = f + reflect_coeff * bwd_pred_error[k];
+			bwd_pred_error[k] = bwd_pred_error[k] + reflect_coeff * f;
 		}
 
 		// SNIP - we are now done with order M and advance. M-1 <- M
@@ -289,7 +305,7 @@ static std::vector<double> lpc_burg(const Array<double> &x, int order)
 		//
 
 		auto q = 1.0 - reflect_coeff * reflect_coeff;
-		den = q * den - bwd_pred_error.back() * bwd_pred_error.back() - fwd_pred_error.front() * fwd_pred_error.front();
+		den = q * den - bwd_pred_error[len-1] * bwd_pred_error[len-1] - fwd_pred_error[0] * fwd_pred_error[0];
 
 		// Shift up forward error.
 		//
@@ -298,16 +314,28 @@ static std::vector<double> lpc_burg(const Array<double> &x, int order)
 		//
 		// N.B. We do this after computing the denominator using eqn 17 but
 		// before using it in the numerator in eqn 15.
-		fwd_pred_error.erase(fwd_pred_error.begin());
-		bwd_pred_error.pop_back();
+		fwd_pred_error++;
+		len--;
 	}
-
-    return ar_coeffs;
 }
 
 std::vector<double> get_lpc_coefficients(const Array<double> &x, int order)
 {
-	return lpc_burg(x, order);
+	LpcWorkspace ws;
+	lpc_burg(x.data(), x.size(), order, ws);
+
+	return std::move(ws.coeffs);
+}
+
+const std::vector<double> &get_lpc_coefficients(const double *frame, intptr_t size, int order, LpcWorkspace &ws)
+{
+	lpc_burg(frame, size, order, ws);
+	return ws.coeffs;
+}
+
+void get_lpc_coefficients(const double *frame, intptr_t size, int max_order, LpcWorkspace &ws, const LpcCallback &callback)
+{
+	lpc_burg(frame, size, max_order, ws, &callback);
 }
 
 // Formant estimation partly based on
@@ -355,6 +383,45 @@ bool get_formants(const std::vector<double> &lpc_coeffs, double Fs, std::vector<
 	return true;
 }
 
+bool estimate_formants(const double *frame, intptr_t size, double Fs, int lpc_order, int nformant, LpcWorkspace &ws,
+                       double *freqs, double *bandwidths)
+{
+	auto &coeffs = get_lpc_coefficients(frame, size, lpc_order, ws);
+	return estimate_formants(coeffs, Fs, nformant, ws, freqs, bandwidths);
+}
+
+bool estimate_formants(const std::vector<double> &lpc_coeffs, double Fs, int nformant, LpcWorkspace &ws, double *freqs,
+                       double *bandwidths)
+{
+	ws.freqs.clear();
+	ws.bandwidths.clear();
+	bool ok = get_formants(lpc_coeffs, Fs, ws.freqs, ws.bandwidths);
+	int count = 0;
+
+	if (ok)
+	{
+		const double lowest_freq = 50.0;
+		const double highest_freq = Fs / 2 - lowest_freq;
+
+		for (size_t k = 0; k < ws.freqs.size() && count < nformant; k++)
+		{
+			auto freq = ws.freqs[k];
+			if (freq > lowest_freq && freq < highest_freq)
+			{
+				freqs[count] = freq;
+				bandwidths[count++] = ws.bandwidths[k];
+			}
+		}
+	}
+	for (int k = count; k < nformant; k++)
+	{
+		freqs[k] = std::nan("");
+		bandwidths[k] = std::nan("");
+	}
+
+	return ok;
+}
+
 // Adapted from Praat's pre-emphasis routine in Sound_to_Formant.cpp
 // Copyright (C) 1992-2008,2010-2012,2014-2020 Paul Boersma
 // License: GPL 2 or later
@@ -382,7 +449,11 @@ Array<std::complex<double>> specgram(const Array<double> &data, int nfft, intptr
 	Array<std::complex<double>> result(nrow, ncol, {0.0, 0.0});
 	std::vector<double> input(nfft, 0.0);
 	std::vector<std::complex<double>> output(nfft, std::complex<double>(0, 0));
-	fftw_plan plan = fftw_plan_dft_r2c_1d(nfft, input.data(), (fftw_complex*)output.data(), FFTW_ESTIMATE);
+	fftw_plan plan;
+	{
+		std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+		plan = fftw_plan_dft_r2c_1d(nfft, input.data(), (fftw_complex*)output.data(), FFTW_ESTIMATE);
+	}
 	auto len = data.size();
 	auto win = create_window(window_size, nfft, window_type);
 	intptr_t j = 1;
@@ -407,7 +478,8 @@ Array<std::complex<double>> specgram(const Array<double> &data, int nfft, intptr
 		j++;
 	}
 	assert(j-1 == result.ncol());
-	fftw_free(plan);
+	std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+	fftw_destroy_plan(plan);
 
 	return result;
 }
@@ -415,14 +487,22 @@ Array<std::complex<double>> specgram(const Array<double> &data, int nfft, intptr
 
 //---------------------------------------------------------------------------------------------------------------------
 
+std::mutex &fftw_planner_mutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
 FFT::FFT(intptr_t length) : nfft(length), input(length, 0.0), output(length, std::complex<double>(0, 0))
 {
+	std::lock_guard<std::mutex> lock(fftw_planner_mutex());
 	impl = fftw_plan_dft_r2c_1d((int)length, input.data(), (fftw_complex*)output.data(), FFTW_ESTIMATE);
 }
 
 FFT::~FFT()
 {
-	fftw_free(reinterpret_cast<fftw_plan>(impl));
+	std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+	fftw_destroy_plan(reinterpret_cast<fftw_plan>(impl));
 }
 
 Array<std::complex<double>> &FFT::process(const Array<double> &data)
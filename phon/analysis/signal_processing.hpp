@@ -30,7 +30,9 @@
 
 #include <cmath>
 #include <complex>
+#include <functional>
 #include <vector>
+#include <mutex>
 #include <phon/array.hpp>
 #include <phon/utils/span.hpp>
 #include <phon/utils/matrix.hpp>
@@ -68,6 +70,9 @@ private:
 	Array<std::complex<double>> output;
 };
 
+// The FFTW planner is not thread-safe: plans must be created and destroyed while holding this lock. Executing a plan
+// does not require it.
+std::mutex &fftw_planner_mutex();
 
 Array<double> create_window(intptr_t N, intptr_t fftlen, WindowType type);
 
@@ -79,12 +84,36 @@ Array<double> get_intensity(std::span<double> input, int samplerate, intptr_t wi
 // Apply pre-emphasis for formant analysis.
 void pre_emphasis(Array<double> &data, double Fs, double threshold);
 
+// Buffers for LPC analysis, which can be reused to avoid allocations when many frames are analyzed.
+struct LpcWorkspace
+{
+	std::vector<double> coeffs, previous, forward, backward, truncated, freqs, bandwidths;
+};
+
+using LpcCallback = std::function<void(int order, const std::vector<double> &coeffs)>;
+
 // Calculate LPC coefficients from a speech frame.
 std::vector<double> get_lpc_coefficients(const Array<double> &frame, int npole);
 
+// Same as above, but the coefficients are stored in the workspace.
+const std::vector<double> &get_lpc_coefficients(const double *frame, intptr_t size, int npole, LpcWorkspace &ws);
+
+// Burg's method computes the coefficients of each order from those of the previous order: call `callback` with the
+// coefficients of each order from 1 to max_order. This gives the same results as one call per order.
+void get_lpc_coefficients(const double *frame, intptr_t size, int max_order, LpcWorkspace &ws, const LpcCallback &callback);
+
 // Get formant frequencies and bandwidths from a set of LPC coefficients.
 bool get_formants(const std::vector<double> &lpc_coeffs, double Fs, std::vector<double> &freqs, std::vector<double> &bw);
 
+// Estimate the first nformant formants (between 50 Hz and Fs/2 - 50 Hz) and their bandwidths from a windowed frame.
+// Formants that can't be found are set to NaN. Returns false if the LPC polynomial couldn't be solved.
+bool estimate_formants(const double *frame, intptr_t size, double Fs, int lpc_order, int nformant, LpcWorkspace &ws,
+                       double *freqs, double *bandwidths);
+
+// Same as above, from LPC coefficients.
+bool estimate_formants(const std::vector<double> &lpc_coeffs, double Fs, int nformant, LpcWorkspace &ws, double *freqs,
+                       double *bandwidths);
+
 Array<std::complex<double>> specgram(const Array<double> &data, int nfft, intptr_t noverlap, intptr_t window_size, WindowType window_type = WindowType::Hann);
 
 Array<double> medfilt1(const Array<double> &signal, int n);
@@ -19,10 +19,15 @@
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
+#include <algorithm>
+#include <future>
+#include <numeric>
 #include <phon/file.hpp>
 #include <phon/analysis/weenink.hpp>
+#include <phon/analysis/signal_processing.hpp>
 #include <phon/analysis/speech_utils.hpp>
 #include <phon/application/sound.hpp>
+#include <phon/utils/thread_pool.hpp>
 
 #define MIN_POINTS 8
 
@@ -187,55 +192,202 @@ double WeeninkModel::score(double t) const
 	return pow(s2, t) * (x2 / d);
 }
 
-std::pair<double, double>
-find_lpc_parameters(Sound *sound, int channel, int nformant, double win_size, double t1, double t2, double max_freq1, double max_freq2, double step, int lpc_order1, int lpc_order2)
+namespace {
+
+// Formant tracks for a <Nyquist frequency, LPC order> pair. Rows are filled as the search progresses.
+struct Candidate
 {
-	// Take at least 8 points, or about one measurement every 5 ms.
-	int npoint = 1000 * (t2 - t1) / 5;
-	if (npoint < MIN_POINTS) npoint = MIN_POINTS;
-	auto time_points = linspace(t1, t2, npoint, false);
-	double best_score = (std::numeric_limits<double>::max)();
-	std::pair<double,double> best_parameters;
+	intptr_t ceiling;
+	int order;
+	Matrix<double> F, B;
+	double score;
+};
 
-	Matrix<double> F(npoint, nformant); // formants (each column is a formant track)
-	Matrix<double> B(npoint, nformant); // bandwidths
-	double nyquist = max_freq1;
+ThreadPool &search_pool()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+// Call fn(i) for i in [0, n) on the search pool and wait for all the calls to complete. Exceptions are rethrown.
+template<class Function>
+void parallel_for(intptr_t n, Function fn)
+{
+	std::vector<std::future<void>> results;
+	results.reserve(n);
 
-	while (nyquist <= max_freq2)
+	for (intptr_t i = 0; i < n; i++)
 	{
-		for (int order = lpc_order1; order <= lpc_order2; order++)
+		auto task = std::make_shared<std::packaged_task<void()>>([=]() { fn(i); });
+		results.push_back(task->get_future());
+		search_pool().submit([task]() { (*task)(); });
+	}
+	// Don't rethrow before all the tasks have completed, since they refer to the caller's data.
+	for (auto &result : results) {
+		result.wait();
+	}
+	for (auto &result : results) {
+		result.get();
+	}
+}
+
+// Measure formants at the given time points for candidates that share a Nyquist frequency. The frames are shared by all
+// the candidates, and a single run of Burg's recursion gives the LPC coefficients for all the orders.
+void measure_formants(const Array<double> &frames, double Fs, int nformant, const std::vector<intptr_t> &rows,
+                      const std::vector<Candidate*> &candidates)
+{
+	if (candidates.empty()) {
+		return;
+	}
+	int max_order = 0;
+	for (auto c : candidates) {
+		max_order = (std::max)(max_order, c->order);
+	}
+
+	auto nframe = frames.nrow();
+	LpcWorkspace ws;
+	std::vector<double> freqs(nformant), bw(nformant);
+
+	for (auto i : rows)
+	{
+		auto frame = frames.data() + i * nframe;
+
+		// Undefined formants are ignored by the model.
+		if (std::isnan(frame[0]))
 		{
-			// Calculate formant tracks for the given parameters.
-			F.setZero(npoint, nformant);
-			B.setZero(npoint, nformant);
-			intptr_t i = 0;
+			for (auto c : candidates)
+			{
+				for (int j = 0; j < nformant; j++) {
+					c->F(i,j) = c->B(i,j) = std::nan("");
+				}
+			}
+			continue;
+		}
 
-			for (auto t : time_points)
+		get_lpc_coefficients(frame, nframe, max_order, ws, [&](int order, const std::vector<double> &coeffs) {
+			for (auto c : candidates)
 			{
-				auto formants = sound->get_formants(channel, t, nformant, nyquist, win_size, order);
+				if (c->order != order) continue;
+				estimate_formants(coeffs, Fs, nformant, ws, freqs.data(), bw.data());
 
-				for (intptr_t j = 0; j < nformant; j++)
+				for (int j = 0; j < nformant; j++)
 				{
-					F(i,j) = formants(j+1, 1);
-					B(i,j) = formants(j+1, 2);
+					c->F(i,j) = freqs[j];
+					c->B(i,j) = bw[j];
 				}
-
-				i++;
 			}
+		});
+	}
+}
+
+// Score a candidate using the given time points, or return the largest possible value if it can't be modeled.
+double score_candidate(const Candidate &c, const std::vector<intptr_t> &rows)
+{
+	auto model = [&]() {
+		if ((intptr_t) rows.size() == c.F.rows()) {
+			return model_segment(c.F, c.B);
+		}
+		Matrix<double> F(rows.size(), c.F.cols()), B(rows.size(), c.B.cols());
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			F.row(i) = c.F.row(rows[i]);
+			B.row(i) = c.B.row(rows[i]);
+		}
+		return model_segment(F, B);
+	}();
+	auto W = model.success ? model.score() : std::nan("");
 
-			// Model formants
-			auto model = model_segment(F, B);
-			if (!model.success) continue;
-			auto W = model.score();
+	return std::isfinite(W) ? W : (std::numeric_limits<double>::max)();
+}
 
-			if (std::isfinite(W) && W < best_score)
-			{
-				best_score = W;
-				best_parameters = { nyquist, order };
+} // namespace
+
+std::pair<double, double>
+find_lpc_parameters(Sound *sound, int channel, int nformant, double win_size, double t1, double t2, double max_freq1, double max_freq2, double step, int lpc_order1, int lpc_order2, double keep)
+{
+	// Take at least 8 points, or about one measurement every 5 ms.
+	int npoint = 1000 * (t2 - t1) / 5;
+	if (npoint < MIN_POINTS) npoint = MIN_POINTS;
+	auto time_points = linspace(t1, t2, npoint, false);
+	Array<double> times(npoint, 0.0);
+	std::copy(time_points.begin(), time_points.end(), times.begin());
+
+	// The signal is read, resampled and windowed once per Nyquist frequency, and the frames are shared by all the LPC
+	// orders. This is done on the calling thread since sounds can't be opened concurrently.
+	std::vector<double> ceilings;
+	std::vector<Array<double>> frames;
+	for (double nyquist = max_freq1; nyquist <= max_freq2; nyquist += step)
+	{
+		ceilings.push_back(nyquist);
+		frames.push_back(sound->get_formant_frames(channel, times, nyquist, win_size));
+	}
+
+	std::vector<Candidate> candidates;
+	for (intptr_t k = 0; k < (intptr_t) ceilings.size(); k++)
+	{
+		for (int order = lpc_order1; order <= lpc_order2; order++)
+		{
+			Matrix<double> F(npoint, nformant), B(npoint, nformant);
+			F.setZero();
+			B.setZero();
+			candidates.push_back(Candidate{k, order, std::move(F), std::move(B), 0.0});
+		}
+	}
+	if (candidates.empty()) {
+		return {};
+	}
+
+	// Evaluate the candidates for each Nyquist frequency in parallel, using the given time points.
+	auto evaluate = [&](const std::vector<Candidate*> &selection, const std::vector<intptr_t> &rows, const std::vector<intptr_t> &scored_rows) {
+		parallel_for(ceilings.size(), [&](intptr_t k) {
+			std::vector<Candidate*> group;
+			for (auto c : selection) {
+				if (c->ceiling == k) group.push_back(c);
 			}
+			measure_formants(frames[k], ceilings[k] * 2, nformant, rows, group);
+			for (auto c : group) {
+				c->score = score_candidate(*c, scored_rows);
+			}
+		});
+	};
+
+	std::vector<Candidate*> selection;
+	for (auto &c : candidates) {
+		selection.push_back(&c);
+	}
+	std::vector<intptr_t> all_rows(npoint);
+	std::iota(all_rows.begin(), all_rows.end(), 0);
+	std::vector<intptr_t> remaining_rows = all_rows;
+
+	// Optionally score all the candidates on every other time point, and only keep the best ones. Formants that have
+	// been measured are kept, so the remaining candidates only need to be measured at the other time points.
+	if (keep < 1.0 && npoint / 2 >= MIN_POINTS && selection.size() > 1)
+	{
+		std::vector<intptr_t> even_rows, odd_rows;
+		for (auto i : all_rows) {
+			(i % 2 == 0 ? even_rows : odd_rows).push_back(i);
 		}
+		evaluate(selection, even_rows, even_rows);
+
+		auto count = (std::max<size_t>)(1, size_t(ceil(keep * selection.size())));
+		// Stable sort so that ties are resolved in grid order.
+		std::stable_sort(selection.begin(), selection.end(), [](Candidate *c1, Candidate *c2) { return c1->score < c2->score; });
+		selection.resize(count);
+		std::sort(selection.begin(), selection.end());
+		remaining_rows = std::move(odd_rows);
+	}
+	evaluate(selection, remaining_rows, all_rows);
+
+	double best_score = (std::numeric_limits<double>::max)();
+	std::pair<double,double> best_parameters;
 
-		nyquist += step;
+	for (auto c : selection)
+	{
+		if (c->score < best_score)
+		{
+			best_score = c->score;
+			best_parameters = { ceilings[c->ceiling], c->order };
+		}
 	}
 
 	return best_parameters;
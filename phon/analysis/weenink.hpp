@@ -92,9 +92,11 @@ double legendre(double x, unsigned int n);
  */
 WeeninkModel model_segment(const Matrix<double> &F, const Matrix<double> &B, unsigned int p = 4);
 
-// Find the best <Nyquist frequency, LPC order> pair for a vocoid given a set of parameter to search for.
+// Find the best <Nyquist frequency, LPC order> pair for a vocoid given a set of parameter to search for. The grid is
+// evaluated in parallel. If keep is less than 1, all the candidates are first scored on half of the time points, and only
+// the best fraction `keep` of them is evaluated on all the time points.
 std::pair<double, double>
-find_lpc_parameters(Sound *sound, int channel, int nformant, double win_size, double t1, double t2, double max_freq1, double max_freq2, double step, int lpc_order1, int lpc_order2);
+find_lpc_parameters(Sound *sound, int channel, int nformant, double win_size, double t1, double t2, double max_freq1, double max_freq2, double step, int lpc_order1, int lpc_order2, double keep = 1.0);
 
 
 } // namespace phonometrica::speech
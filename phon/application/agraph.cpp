@@ -20,6 +20,7 @@
  ***********************************************************************************************************************/
 
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <phon/error.hpp>
 #include <phon/application/agraph.hpp>
@@ -28,19 +29,21 @@
 
 namespace phonometrica { 
 
+static constexpr intptr_t anchor_block_size = 256;
+
 struct AnchorLess
 {
-	bool operator()(const std::unique_ptr<Anchor> &lhs, const std::unique_ptr<Anchor> &rhs) const
+	bool operator()(const Anchor *lhs, const Anchor *rhs) const
 	{
 		return lhs->time < rhs->time;
 	}
 
-	bool operator()(const std::unique_ptr<Anchor> &lhs, double time) const
+	bool operator()(const Anchor *lhs, double time) const
 	{
 		return lhs->time < time;
 	}
 
-	bool operator()(double time, const std::unique_ptr<Anchor> &lhs) const
+	bool operator()(double time, const Anchor *lhs) const
 	{
 		return time < lhs->time;
 	}
@@ -278,9 +281,9 @@ AnchorList::iterator AGraph::get_anchor_iter(double time)
 {
 	auto it = std::lower_bound(m_anchors.begin(), m_anchors.end(), time, AnchorLess());
 
-	if (it == m_anchors.end() || time < it->get()->time)
+	if (it == m_anchors.end() || time < (*it)->time)
 	{
-		return m_anchors.insert(it, std::make_unique<Anchor>(time));
+		return m_anchors.insert(it, allocate_anchor(time));
 	}
 
 	return it;
@@ -288,7 +291,66 @@ AnchorList::iterator AGraph::get_anchor_iter(double time)
 
 Anchor *AGraph::get_anchor(double time)
 {
-	return get_anchor_iter(time)->get();
+	return *get_anchor_iter(time);
+}
+
+void AGraph::add_anchors(Array<double> times)
+{
+	std::sort(times.begin(), times.end());
+	times.drop(intptr_t(times.end() - std::unique(times.begin(), times.end())));
+	reserve_anchors(times.size());
+
+	AnchorList anchors;
+	anchors.reserve(m_anchors.size() + times.size());
+	auto it = m_anchors.begin();
+
+	for (double time : times)
+	{
+		while (it != m_anchors.end() && (*it)->time < time) {
+			anchors.append(*it++);
+		}
+		if (it == m_anchors.end() || time < (*it)->time) {
+			anchors.append(allocate_anchor(time));
+		}
+	}
+	while (it != m_anchors.end()) {
+		anchors.append(*it++);
+	}
+
+	m_anchors = std::move(anchors);
+}
+
+Anchor *AGraph::allocate_anchor(double time)
+{
+	if (!m_free_anchors.empty())
+	{
+		auto anchor = m_free_anchors.take_last();
+		anchor->time = time;
+		return anchor;
+	}
+
+	reserve_anchors(1);
+	auto &block = m_anchor_arena.back();
+	block.emplace_back(time);
+
+	return &block.back();
+}
+
+void AGraph::reserve_anchors(intptr_t count)
+{
+	if (m_anchor_arena.empty() || intptr_t(m_anchor_arena.back().capacity() - m_anchor_arena.back().size()) < count)
+	{
+		m_anchor_arena.emplace_back();
+		m_anchor_arena.back().reserve(size_t(std::max(count, anchor_block_size)));
+	}
+}
+
+void AGraph::release_anchor(AnchorList::iterator it)
+{
+	auto anchor = *it;
+	assert(anchor->empty());
+	m_anchors.remove_at(it);
+	m_free_anchors.append(anchor);
 }
 
 void AGraph::check_free_anchor(const Array<Event *> &events, intptr_t index)
@@ -328,40 +390,43 @@ EventList AGraph::get_layer_events(intptr_t index, double t1, double t2) const
 
 void AGraph::read_textgrid(const String &path)
 {
-	File infile(path);
+	// Parse the whole file before clearing the graph, so that a reloaded annotation is left untouched on error.
+	auto tiers = praat::read_textgrid(path);
 	clear(); // in case we are reloading a file
 
-	do
+	Array<double> times;
+	for (auto &tier : tiers)
+	{
+		for (auto &interval : tier.intervals)
+		{
+			times.append(interval.xmin);
+			times.append(interval.xmax);
+		}
+		for (auto &point : tier.points) {
+			times.append(point.time);
+		}
+	}
+	add_anchors(std::move(times));
+
+	for (auto &tier : tiers)
 	{
-		auto line = infile.read_line();
-		auto view = line.to_wide();
-		praat::TierHeader header;
+		add_layer(-1, tier.label, tier.has_points);
 
-		if (praat::parse_tier_header(infile, line, header))
+		if (tier.has_points)
 		{
-			add_layer(-1, header.label, header.has_points);
-			m_layers.last()->events.reserve(header.size);
+			m_layers.last()->events.reserve(tier.points.size());
+			for (auto &point : tier.points) {
+				add_instant(-1, point.time, point.text);
+			}
 		}
-		else if (!m_layers.empty())
+		else
 		{
-			praat::Interval interval;
-
-			if (praat::parse_interval(infile, line, interval))
-			{
+			m_layers.last()->events.reserve(tier.intervals.size());
+			for (auto &interval : tier.intervals) {
 				add_interval(-1, interval.xmin, interval.xmax, interval.text);
 			}
-			else
-			{
-				praat::Point point;
-
-				if (praat::parse_point(infile, line, point))
-				{
-					add_instant(-1, point.time, point.text);
-				}
-			}
 		}
 	}
-	while (!infile.at_end());
 }
 
 void AGraph::write_textgrid(const String &path)
@@ -450,7 +515,7 @@ AutoEvent AGraph::previous_event(intptr_t layer, const AutoEvent &e) const
         }
 		it--;
 
-        auto anchor = it->get();
+        auto anchor = *it;
 
         for (auto event : anchor->outgoing)
         {
@@ -479,7 +544,7 @@ AutoEvent AGraph::next_event(intptr_t layer, const AutoEvent &e) const
             return AutoEvent();
         }
 
-        auto anchor = it->get();
+        auto anchor = *it;
 
         for (auto event : anchor->incoming)
         {
@@ -578,6 +643,230 @@ bool AGraph::change_time(AutoEvent &event, AutoEvent &right_boundary, double new
     return true;
 }
 
+// Integers are written as LEB128 varints. Signed values are zigzag-encoded.
+static void write_varint(std::string &buffer, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		buffer.push_back(char(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back(char(value));
+}
+
+static void write_signed(std::string &buffer, int64_t value)
+{
+	write_varint(buffer, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+class BinaryGraphReader final
+{
+public:
+
+	explicit BinaryGraphReader(std::string_view data) : pos(data.data()), end(data.data() + data.size()) { }
+
+	uint64_t read_varint()
+	{
+		uint64_t value = 0;
+
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (pos == end) {
+				fail();
+			}
+			auto byte = uint8_t(*pos++);
+			value |= uint64_t(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0) {
+				return value;
+			}
+		}
+		fail();
+	}
+
+	int64_t read_signed()
+	{
+		auto value = read_varint();
+		return int64_t(value >> 1) ^ -int64_t(value & 1);
+	}
+
+	// Read a count or an index, which must be smaller than the given limit.
+	intptr_t read_size(intptr_t limit)
+	{
+		auto value = read_varint();
+		if (value >= uint64_t(limit)) {
+			fail();
+		}
+
+		return intptr_t(value);
+	}
+
+	String read_string()
+	{
+		auto size = read_size(end - pos + 1);
+		String s(pos, size);
+		pos += size;
+
+		return s;
+	}
+
+	uint8_t read_byte()
+	{
+		if (pos == end) {
+			fail();
+		}
+		return uint8_t(*pos++);
+	}
+
+	intptr_t remaining() const { return end - pos; }
+
+	[[noreturn]] void fail()
+	{
+		throw error("Invalid binary annotation: corrupted graph data");
+	}
+
+private:
+
+	const char *pos, *end;
+};
+
+void AGraph::to_binary(std::string &buffer) const
+{
+	Hashmap<Anchor*, intptr_t> anchor_map;
+	Hashmap<String, intptr_t> string_map;
+	Array<const String*> strings;
+
+	auto get_string_id = [&](const String &s) {
+		auto it = string_map.find(s);
+		if (it != string_map.end()) {
+			return it->second;
+		}
+		auto id = strings.size();
+		string_map.insert({s, id});
+		strings.append(&s);
+
+		return id;
+	};
+
+	for (auto &layer : m_layers)
+	{
+		get_string_id(layer->label);
+		for (auto &event : layer->events) {
+			get_string_id(event->text());
+		}
+	}
+
+	write_varint(buffer, strings.size());
+	for (auto s : strings)
+	{
+		write_varint(buffer, uint64_t(s->size()));
+		buffer.append(s->data(), size_t(s->size()));
+	}
+
+	// Anchors are sorted, so we store the difference between the bit patterns of consecutive times. This is lossless,
+	// and small intervals yield small differences.
+	write_varint(buffer, m_anchors.size());
+	uint64_t previous_time = 0;
+	for (intptr_t i = 1; i <= m_anchors.size(); i++)
+	{
+		auto anchor = m_anchors[i];
+		uint64_t bits;
+		memcpy(&bits, &anchor->time, sizeof bits);
+		write_signed(buffer, int64_t(bits - previous_time));
+		previous_time = bits;
+		anchor_map[anchor] = i - 1;
+	}
+
+	write_varint(buffer, m_layers.size());
+	for (auto &layer : m_layers)
+	{
+		auto &events = layer->events;
+		write_varint(buffer, get_string_id(layer->label));
+		buffer.push_back(char(layer->has_instants));
+		write_varint(buffer, events.size());
+
+		intptr_t previous = 0;
+		for (auto &event : events)
+		{
+			auto start = anchor_map[event->m_start];
+			write_signed(buffer, start - previous);
+			previous = start;
+		}
+		for (auto &event : events) {
+			write_varint(buffer, uint64_t(anchor_map[event->m_end] - anchor_map[event->m_start]));
+		}
+		for (auto &event : events) {
+			write_varint(buffer, get_string_id(event->text()));
+		}
+	}
+}
+
+void AGraph::from_binary(std::string_view data)
+{
+	BinaryGraphReader reader(data);
+	clear();
+
+	// Each string or anchor uses at least one byte, which bounds the counts in corrupted files.
+	auto string_count = reader.read_size(reader.remaining() + 1);
+	Array<String> strings;
+	strings.reserve(string_count);
+	for (intptr_t i = 0; i < string_count; i++) {
+		strings.append(reader.read_string());
+	}
+
+	auto anchor_count = reader.read_size(reader.remaining() + 1);
+	m_anchors.reserve(anchor_count);
+	reserve_anchors(anchor_count);
+	uint64_t bits = 0;
+
+	for (intptr_t i = 0; i < anchor_count; i++)
+	{
+		bits += uint64_t(reader.read_signed());
+		double time;
+		memcpy(&time, &bits, sizeof time);
+		if (!m_anchors.empty() && !(m_anchors.last()->time < time)) {
+			reader.fail();
+		}
+		m_anchors.append(allocate_anchor(time));
+	}
+
+	auto layer_count = reader.read_size(reader.remaining() + 1);
+	m_layers.reserve(layer_count);
+	Array<intptr_t> starts, ends;
+
+	for (intptr_t k = 1; k <= layer_count; k++)
+	{
+		auto &label = strings[reader.read_size(string_count) + 1];
+		bool has_instants = reader.read_byte() != 0;
+		m_layers.append(std::make_shared<Layer>(k, label, has_instants));
+		auto event_count = reader.read_size(reader.remaining() + 1);
+		m_layers.last()->events.reserve(event_count);
+		starts.clear();
+		ends.clear();
+
+		intptr_t start = 0;
+		for (intptr_t i = 0; i < event_count; i++)
+		{
+			start += intptr_t(reader.read_signed());
+			if (start < 0 || start >= anchor_count) {
+				reader.fail();
+			}
+			starts.append(start);
+		}
+		for (intptr_t i = 1; i <= event_count; i++) {
+			ends.append(starts[i] + reader.read_size(anchor_count - starts[i]));
+		}
+		for (intptr_t i = 1; i <= event_count; i++)
+		{
+			auto &text = strings[reader.read_size(string_count) + 1];
+			append_event(k, m_anchors[starts[i] + 1], m_anchors[ends[i] + 1], text);
+		}
+	}
+
+	if (reader.remaining() != 0) {
+		reader.fail();
+	}
+}
+
 void AGraph::to_xml(xml_node graph_node)
 {
 	auto anchors_node = graph_node.append_child("Anchors");
@@ -585,13 +874,13 @@ void AGraph::to_xml(xml_node graph_node)
 
 	for (intptr_t i = 1; i <= m_anchors.size(); i++)
 	{
-		auto &anchor = m_anchors[i];
+		auto anchor = m_anchors[i];
 		auto anchor_node = anchors_node.append_child("Anchor");
 		auto attr = anchor_node.append_attribute("id");
 		attr.set_value(i);
 		auto time = String::convert(anchor->time);
 		add_data_node(anchor_node, "Time", time);
-		anchor_map[anchor.get()] = i;
+		anchor_map[anchor] = i;
 	}
 
 	auto layers_node = graph_node.append_child("Layers");
@@ -653,8 +942,11 @@ void AGraph::from_xml(xml_node graph_node)
 
 void AGraph::clear()
 {
-	m_anchors.clear();
+	// Events detach themselves from their anchors when they are destroyed, so layers must be cleared first.
 	m_layers.clear();
+	m_anchors.clear();
+	m_free_anchors.clear();
+	m_anchor_arena.clear();
 	m_modified = false;
 }
 
@@ -662,7 +954,15 @@ void AGraph::parse_anchors(xml_node anchors_node)
 {
 	static std::string_view anchor_tag = "Anchor";
 	AnchorList anchors;
+	intptr_t count = 0;
 
+	for (auto node = anchors_node.first_child(); node; node = node.next_sibling()) {
+		if (node.name() == anchor_tag) count++;
+	}
+	anchors.reserve(count);
+	reserve_anchors(count);
+
+	// Anchors are written in chronological order, so there is no need to sort them.
 	for (auto node = anchors_node.first_child(); node; node = node.next_sibling())
 	{
 		if (node.name() == anchor_tag)
@@ -670,7 +970,7 @@ void AGraph::parse_anchors(xml_node anchors_node)
 			auto attr = node.attribute("id");
 			auto id = String::to_int(attr.value());
 			double time = String::to_float(node.child_value("Time"));
-			anchors.append(std::make_unique<Anchor>(time));
+			anchors.append(allocate_anchor(time));
 
 			if (anchors.size() != id) {
 				throw error("Inconsistent anchor ID: (expected %, got %)", anchors.size(), id);
@@ -720,11 +1020,11 @@ void AGraph::parse_events(xml_node events_node)
 			auto start_node = node.child("Start");
 			attr = start_node.attribute("anchor");
 			intptr_t id1 = String::to_int(attr.value());
-			auto anchor1 = m_anchors[id1].get();
+			auto anchor1 = m_anchors[id1];
 			auto end_node = node.child("End");
 			attr = end_node.attribute("anchor");
 			intptr_t id2 = String::to_int(attr.value());
-			auto anchor2 = m_anchors[id2].get();
+			auto anchor2 = m_anchors[id2];
 			auto label = node.child_value("Text");
 			append_event(layer, anchor1, anchor2, label);
 		}
@@ -812,7 +1112,7 @@ bool AGraph::remove_anchor(intptr_t layer_index, double time)
 	if (it == m_anchors.end()) {
 		return false;
 	}
-	auto anchor = it->get();
+	auto anchor = *it;
 
 	auto lambda = [=](Event *e) {
 		return e->layer_index() == layer_index;
@@ -826,10 +1126,8 @@ bool AGraph::remove_anchor(intptr_t layer_index, double time)
 		auto e = *it;
 		e->detach();
 
-		if (anchor->empty())
-		{
-			auto it = get_anchor_iter(anchor->time);
-			m_anchors.remove(*it);
+		if (anchor->empty()) {
+			release_anchor(get_anchor_iter(anchor->time));
 		}
 
 		layer->events.remove(e->shared_from_this());
@@ -856,10 +1154,8 @@ bool AGraph::remove_anchor(intptr_t layer_index, double time)
 		e2->detach_left();
 		e2->attach_left(first_anchor);
 
-		if (mid_anchor->empty())
-		{
-			auto it = get_anchor_iter(mid_anchor->time);
-			m_anchors.remove(*it);
+		if (mid_anchor->empty()) {
+			release_anchor(get_anchor_iter(mid_anchor->time));
 		}
 
 		layer->events.remove(e1->shared_from_this());
@@ -1034,4 +1330,45 @@ AutoEvent AGraph::time_to_event(intptr_t layer_index, double time) const
 	return *it;
 }
 
+intptr_t AGraph::memory_size() const
+{
+	// Each event is referenced from its layer and from its start and end anchors. The shared pointer's control block
+	// is allocated together with the event.
+	constexpr intptr_t event_size = sizeof(Event) + sizeof(AutoEvent) * 2 + sizeof(Event*) * 2;
+	intptr_t size = m_anchors.size() * intptr_t(sizeof(Anchor*));
+
+	for (auto &block : m_anchor_arena) {
+		size += intptr_t(block.capacity() * sizeof(Anchor));
+	}
+
+	for (auto &layer : m_layers)
+	{
+		size += sizeof(Layer) + layer->label.size();
+
+		for (auto &event : layer->events) {
+			size += event_size + event->m_text.size();
+		}
+	}
+
+	return size;
+}
+
+bool AGraph::shared() const
+{
+	for (auto &layer : m_layers)
+	{
+		if (layer.use_count() > 1) {
+			return true;
+		}
+		for (auto &event : layer->events)
+		{
+			if (event.use_count() > 1) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 } // namespace phonometrica
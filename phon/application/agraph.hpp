@@ -24,6 +24,7 @@
 #define PHONOMETRICA_AGRAPH_HPP
 
 #include <memory>
+#include <vector>
 #include <algorithm>
 #include <phon/string.hpp>
 #include <phon/utils/xml.hpp>
@@ -196,7 +197,7 @@ private:
 
 using AutoLayer = std::shared_ptr<Layer>;
 using LayerList = Array<AutoLayer>;
-using AnchorList = Array<std::unique_ptr<Anchor>>;
+using AnchorList = Array<Anchor*>;
 
 class AGraph
 {
@@ -252,6 +253,12 @@ public:
 
     void from_xml(xml_node graph_node);
 
+	// Compact binary encoding of the graph, used by the native annotation format. Event texts and layer labels are
+	// stored once in a string pool, and anchor times and event boundaries are delta-encoded in columns.
+	void to_binary(std::string &buffer) const;
+
+	void from_binary(std::string_view data);
+
     AutoEvent get_event(intptr_t layer, intptr_t event) const;
 
     void remove_layer(intptr_t index);
@@ -288,6 +295,15 @@ public:
 
 	AutoEvent time_to_event(intptr_t layer_index, double time) const;
 
+	// Erase content.
+	void clear();
+
+	// Approximate number of bytes used by the graph.
+	intptr_t memory_size() const;
+
+	// Check whether some layers or events are referenced from outside the graph (e.g. by a view or a concordance).
+	bool shared() const;
+
 private:
 
 	void append_event(intptr_t layer_index, Anchor *start, Anchor *end, const String &text);
@@ -297,22 +313,39 @@ private:
 
 	AnchorList::iterator get_anchor_iter(double time);
 
+	// Create anchors for a batch of time stamps. The times are sorted and deduplicated once and merged with the existing
+	// anchors, which avoids a sorted insertion for each anchor when a whole annotation is loaded.
+	void add_anchors(Array<double> times);
+
+	// Allocate an anchor from the arena.
+	Anchor *allocate_anchor(double time);
+
+	// Make sure that the current arena block can hold at least `count` new anchors.
+	void reserve_anchors(intptr_t count);
+
+	// Remove an anchor from the sorted list. Its memory is recycled for the next anchor.
+	void release_anchor(AnchorList::iterator it);
+
 	// Check that there is no events in a given anchor's outgoing or incoming nodes on a given layer.
 	void check_free_anchor(const Array<Event *> &events, intptr_t index);
 
 	// Change end time of event, if possible.
 	bool change_time(AutoEvent &event, AutoEvent &right_boundary, double new_time);
 
-	// Erase content.
-	void clear();
-
 	void parse_anchors(xml_node anchors_node);
 
 	void parse_layers(xml_node layers_node);
 
 	void parse_events(xml_node events_node);
 
-	// Sorted list of anchors.
+	// Anchors are allocated in blocks which are never reallocated, so that pointers to anchors remain valid until the
+	// graph is cleared. The arena must outlive the layers, since events detach themselves from their anchors.
+	std::vector<std::vector<Anchor>> m_anchor_arena;
+
+	// Anchors that were removed from the graph and can be reused.
+	Array<Anchor*> m_free_anchors;
+
+	// Sorted list of anchors (owned by the arena).
     AnchorList m_anchors;
 
     // Sorted list of Layers.
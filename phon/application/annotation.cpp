@@ -19,32 +19,151 @@
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
+#include <sstream>
 #include <phon/application/annotation.hpp>
 #include <phon/application/macros.hpp>
 #include <phon/runtime/runtime.hpp>
 #include <phon/runtime/object.hpp>
 #include <phon/application/project.hpp>
+#include <phon/application/settings.hpp>
 #include <phon/utils/file_system.hpp>
+#include <phon/utils/helpers.hpp>
 
 namespace phonometrica {
 
 Signal<const Handle<Annotation>&, const AutoEvent&, const String&> Annotation::edit_event;
 
+// Binary annotations start with a 16-byte header: a magic string, the format version and the size of the metadata,
+// which are stored as an XML fragment. The header can be read without loading the graph, which follows the metadata.
+// Integers in the header are little-endian.
+static constexpr std::string_view binary_magic("PHONANNB", 8);
+static constexpr uint32_t binary_version = 1;
+static constexpr size_t binary_header_size = 16;
+
+static uint32_t read_uint32(const char *data)
+{
+	auto p = reinterpret_cast<const uint8_t*>(data);
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static void write_uint32(std::string &buffer, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		buffer.push_back(char((value >> (8 * i)) & 0xFF));
+	}
+}
+
+// Returns the size of the metadata if the header is a binary header, or -1 if the file is an XML file.
+static intptr_t parse_binary_header(const char *header, size_t size, const String &path)
+{
+	if (size < binary_header_size || std::string_view(header, binary_magic.size()) != binary_magic) {
+		return -1;
+	}
+	auto version = read_uint32(header + 8);
+	if (version > binary_version) {
+		throw error("Annotation % was created by a more recent version of Phonometrica (format version %)", path, version);
+	}
+
+	return intptr_t(read_uint32(header + 12));
+}
+
+static std::string read_file(const String &path)
+{
+	FILE *file = utils::open_file(path, "rb");
+	if (!file) {
+		throw error("Cannot open annotation '%'", path);
+	}
+	std::string data;
+	char buffer[65536];
+	size_t count;
+
+	while ((count = fread(buffer, 1, sizeof buffer, file)) > 0) {
+		data.append(buffer, count);
+	}
+	bool ok = !ferror(file);
+	fclose(file);
+	if (!ok) {
+		throw error("Cannot read annotation '%'", path);
+	}
+
+	return data;
+}
+
 Annotation::Annotation(Directory *parent, String path) :
 		Document(meta::get_class<Annotation>(), parent, std::move(path))
 {
 	m_type = guess_type();
+	m_binary = Settings::get_boolean("binary_annotations");
 	// Native files are loaded in 2 steps: first, we load the metadata when the file is created. Next,
 	// we load the graph when open() is called.
 	if (is_native() && has_path()) preload();
 }
 
+Annotation::Annotation(const Snapshot &snapshot) :
+		Document(meta::get_class<Annotation>(), snapshot)
+{
+	m_type = guess_type();
+	m_binary = snapshot.binary;
+
+	if (snapshot.sound) {
+		m_sound = make_handle<Sound>(*snapshot.sound);
+	}
+	if (!snapshot.graph.empty())
+	{
+		m_graph.from_binary(snapshot.graph);
+		m_loaded = true;
+	}
+}
+
+Annotation::Snapshot Annotation::snapshot() const
+{
+	Snapshot s;
+	static_cast<Document::Snapshot&>(s) = Document::snapshot();
+	s.binary = m_binary;
+
+	if (has_sound()) {
+		s.sound = m_sound->snapshot();
+	}
+	// The file is up to date unless the graph was modified in memory.
+	if (m_loaded && content_modified()) {
+		m_graph.to_binary(s.graph);
+	}
+
+	return s;
+}
+
 void Annotation::preload()
 {
 	assert(!m_path.empty());
 	static std::string_view project_tag("Phonometrica");
 	static std::string_view meta_tag = "Metadata";
 
+	// For binary files, only read the header and the metadata.
+	FILE *file = utils::open_file(m_path, "rb");
+	if (!file) {
+		throw error("Cannot open annotation '%'", m_path);
+	}
+	char header[binary_header_size];
+	auto count = fread(header, 1, sizeof header, file);
+	auto meta_size = parse_binary_header(header, count, m_path);
+	m_binary = (meta_size >= 0);
+
+	if (m_binary)
+	{
+		std::string meta(size_t(meta_size), '\0');
+		count = fread(meta.data(), 1, meta.size(), file);
+		fclose(file);
+		xml_document doc;
+
+		if (count != meta.size() || !doc.load_buffer(meta.data(), meta.size())) {
+			throw error("Invalid metadata in binary annotation %", m_path);
+		}
+		metadata_from_xml(doc.first_child());
+
+		return;
+	}
+	fclose(file);
+
 	xml_document doc;
 	auto root = read_xml(doc, m_path);
 
@@ -102,6 +221,18 @@ void Annotation::write()
 		default:
 			throw error("Cannot write annotation: unsupported format");
 	}
+
+	// Keep the text index in sync with the file. If this fails, the entry's time stamp no longer matches the file and it
+	// will be treated as stale, so there is no need to report the error.
+	if (auto index = Project::get()->text_index())
+	{
+		try
+		{
+			index->update(*this);
+		}
+		catch (std::exception &)
+		{ }
+	}
 }
 
 bool Annotation::has_sound() const
@@ -194,6 +325,7 @@ void Annotation::initialize(Runtime &rt)
 	auto bind_to_sound = [](Runtime &, std::span<Variant> args) -> Variant  {
 		auto &annot = cast<Annotation>(args[0]);
 		auto &path = cast<String>(args[1]);
+		annot.check_writable();
 		auto project = Project::get();
 		project->import_file(path);
 		auto snd = recast<Sound>(project->get(path));
@@ -273,6 +405,7 @@ void Annotation::initialize(Runtime &rt)
 		auto layer = cast<intptr_t>(args[1]);
 		auto event = cast<intptr_t>(args[2]);
 		auto &text = cast<intptr_t>(args[3]);
+		annot.check_writable();
 		annot.open();
 
 		try
@@ -305,6 +438,7 @@ void Annotation::initialize(Runtime &rt)
 		auto &annot = cast<Annotation>(args[0]);
 		auto layer = cast<intptr_t>(args[1]);
 		auto &value = cast<String>(args[2]);
+		annot.check_writable();
 		annot.open();
 		try {
 			annot.set_layer_label(layer, value);
@@ -406,8 +540,22 @@ void Annotation::metadata_to_xml(xml_node meta_node)
 	add_data_node(meta_node, "Sound", snd);
 }
 
+void Annotation::set_binary(bool value)
+{
+	if (m_binary != value)
+	{
+		m_binary = value;
+		m_content_modified = true;
+	}
+}
+
 void Annotation::write_as_native(const String &path)
 {
+	if (m_binary)
+	{
+		write_as_binary(path);
+		return;
+	}
 	open();
 	xml_document doc;
 
@@ -423,6 +571,34 @@ void Annotation::write_as_native(const String &path)
     write_xml(doc, p);
 }
 
+void Annotation::write_as_binary(const String &path)
+{
+	open();
+	xml_document doc;
+	auto meta_node = doc.append_child("Metadata");
+	metadata_to_xml(meta_node);
+	std::ostringstream meta;
+	doc.save(meta, "", format_raw|format_no_declaration);
+	auto meta_text = meta.str();
+
+	std::string buffer(binary_magic);
+	write_uint32(buffer, binary_version);
+	write_uint32(buffer, uint32_t(meta_text.size()));
+	buffer.append(meta_text);
+	m_graph.to_binary(buffer);
+
+	auto &p = path.empty() ? m_path : path;
+	FILE *file = utils::open_file(p, "wb");
+	if (!file) {
+		throw error("Cannot write annotation '%'", p);
+	}
+	bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+	ok = (fclose(file) == 0) && ok;
+	if (!ok) {
+		throw error("Cannot write annotation '%'", p);
+	}
+}
+
 void Annotation::write_as_textgrid(const String &path)
 {
 	open();
@@ -434,9 +610,26 @@ void Annotation::read_from_native()
 	assert(!m_path.empty());
 	static std::string_view project_tag("Phonometrica");
 	static std::string_view graph_tag = "Graph";
+	auto data = read_file(m_path);
+	auto meta_size = parse_binary_header(data.data(), data.size(), m_path);
+	m_binary = (meta_size >= 0);
+
+	if (m_binary)
+	{
+		if (data.size() < binary_header_size + size_t(meta_size)) {
+			throw error("Invalid binary annotation %", m_path);
+		}
+		m_graph.from_binary(std::string_view(data).substr(binary_header_size + size_t(meta_size)));
+
+		return;
+	}
 
 	xml_document doc;
-	auto root = read_xml(doc, m_path);
+	auto result = doc.load_buffer(data.data(), data.size());
+	if (!result) {
+		throw error(result.description());
+	}
+	auto root = doc.document_element();
 
 	if (root.name() != project_tag) {
 		throw error("Invalid XML project root in %", m_path);
@@ -512,6 +705,22 @@ void Annotation::clear_layer(intptr_t index)
 	m_graph.clear_layer(index);
 }
 
+intptr_t Annotation::memory_size() const
+{
+	return m_graph.memory_size();
+}
+
+bool Annotation::release_content()
+{
+	// Views and concordances keep references to layers and events, which point to anchors owned by the graph.
+	if (m_graph.shared()) {
+		return false;
+	}
+	m_graph.clear();
+
+	return true;
+}
+
 void Annotation::discard_changes()
 {
 	Element::discard_changes();
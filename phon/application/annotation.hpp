@@ -22,6 +22,7 @@
 #ifndef PHONOMETRICA_ANNOTATION_HPP
 #define PHONOMETRICA_ANNOTATION_HPP
 
+#include <optional>
 #include <phon/application/sound.hpp>
 #include <phon/application/agraph.hpp>
 #include <phon/error.hpp>
@@ -42,6 +43,16 @@ public:
 		WaveSurfer
 	};
 
+	struct Snapshot : public Document::Snapshot
+	{
+		// Binary encoding of the graph if it has unsaved changes. Otherwise, the copy reads the graph from the file.
+		std::string graph;
+
+		std::optional<Sound::Snapshot> sound;
+
+		bool binary = false;
+	};
+
 	// Constructor used to create a new annotation from a sound file.
 	Annotation() :
 		Annotation(nullptr, String())
@@ -49,6 +60,9 @@ public:
 
 	explicit Annotation(Directory *parent, String path = String());
 
+	// Create a detached copy of an annotation.
+	explicit Annotation(const Snapshot &snapshot);
+
 	void set_path(String path, bool mutate) override;
 
 	bool has_sound() const;
@@ -63,8 +77,17 @@ public:
 
 	bool is_native() const { return m_type == Native; }
 
+	// Native annotations are stored either as XML or in a compact binary format.
+	bool is_binary() const { return m_binary; }
+
+	// Change the format used for the next write of a native annotation.
+	void set_binary(bool value);
+
 	static void initialize(Runtime &rt);
 
+	// Must be called in the thread which owns the annotation.
+	Snapshot snapshot() const;
+
 	const LayerList &layers() const { return m_graph.layers(); }
 
 	AGraph &graph() { return m_graph; }
@@ -73,6 +96,8 @@ public:
 
 	bool modified() const override;
 
+	intptr_t memory_size() const override;
+
 	void set_event_text(AutoEvent &event, const String &new_text);
 
 	String left_context(intptr_t layer, intptr_t event, intptr_t offset, intptr_t length, const String &separator = String()) const;
@@ -81,6 +106,8 @@ public:
 
 	void write_as_native(const String &path = String());
 
+	void write_as_binary(const String &path = String());
+
 	void write_as_textgrid(const String &path = String());
 
 	AutoEvent get_event(intptr_t layer, intptr_t event) const;
@@ -131,6 +158,8 @@ protected:
 
 	void write() override;
 
+	bool release_content() override;
+
 	void save_metadata() override;
 
 	bool uses_external_metadata() const override;
@@ -149,6 +178,8 @@ private:
 
 	Type m_type = Undefined;
 
+	bool m_binary = false;
+
 };
 
 
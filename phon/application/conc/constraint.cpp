@@ -34,7 +34,7 @@ Constraint::Constraint(const Constraint &other) :
 		regex = std::make_unique<Regex>(other.regex->pattern(), other.regex->flags());
 	}
 	if (other.layer_regex) {
-		layer_regex = std::make_unique<Regex>(other.layer_regex->pattern(), other.regex->flags());
+		layer_regex = std::make_unique<Regex>(other.layer_regex->pattern(), other.layer_regex->flags());
 	}
 }
 
@@ -68,6 +68,12 @@ Match::Match(const Handle<Annotation> &annot, std::unique_ptr<Target> t) :
 
 }
 
+Match::Match(std::unique_ptr<Target> t) :
+	m_target(std::move(t))
+{
+
+}
+
 Match::Match(const Match &other) : m_annot(other.annotation())
 {
 	auto target = other.m_target.get();
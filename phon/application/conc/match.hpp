@@ -71,6 +71,9 @@ public:
 
 	Match(const Handle<Annotation> &annot, std::unique_ptr<Target> t);
 
+	// Create a match whose annotation is set later with set_annotation().
+	explicit Match(std::unique_ptr<Target> t);
+
 	const AutoEvent &get_event(intptr_t i) const;
 
 	double get_start_time(intptr_t i) const;
@@ -85,6 +88,8 @@ public:
 
 	const Handle<Annotation> &annotation() const;
 
+	void set_annotation(const Handle<Annotation> &annot) { m_annot = annot; }
+
 	Target & last_target();
 
 	Target *reference_target() const;
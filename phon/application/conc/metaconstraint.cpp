@@ -20,9 +20,18 @@
  ***********************************************************************************************************************/
 
 #include <phon/application/conc/metaconstraint.hpp>
+#include <phon/application/database.hpp>
+#include <phon/application/property.hpp>
 
 namespace phonometrica {
 
+// Add a parameter and return its placeholder.
+static String add_param(Array<String> &params, String value)
+{
+	params.append(std::move(value));
+	return utils::format("?%", params.size());
+}
+
 DescMetaConstraint::DescMetaConstraint(DescMetaConstraint::Operator op, const String &value) :
 	MetaConstraint(), op(op), value(value)
 {
@@ -44,14 +53,36 @@ bool DescMetaConstraint::filter(const Document *file) const
 		case Operator::NotContains:
 			return !file->description().contains(value);
 		case Operator::Match:
-			return regex->match(value);
+			return regex->match(file->description());
 		case Operator::NotMatch:
-			return !regex->match(value);
+			return !regex->match(file->description());
 		default:
 			return false;
 	}
 }
 
+bool DescMetaConstraint::to_sql(MetaDatabase &, String &sql, Array<String> &params) const
+{
+	switch (op)
+	{
+		case Operator::Equal:
+			sql = utils::format("_description = %", add_param(params, value));
+			return true;
+		case Operator::NotEqual:
+			sql = utils::format("_description <> %", add_param(params, value));
+			return true;
+		case Operator::Contains:
+			sql = utils::format("instr(_description, %) > 0", add_param(params, value));
+			return true;
+		case Operator::NotContains:
+			sql = utils::format("instr(_description, %) = 0", add_param(params, value));
+			return true;
+		default:
+			// SQLite has no regular expressions.
+			return false;
+	}
+}
+
 const char *DescMetaConstraint::op_to_name(Operator op)
 {
 	switch (op)
@@ -112,6 +143,24 @@ bool TextMetaConstraint::filter(const Document *file) const
 	return false;
 }
 
+bool TextMetaConstraint::to_sql(MetaDatabase &db, String &sql, Array<String> &params) const
+{
+	if (values.empty())
+	{
+		sql = "0";
+		return true;
+	}
+	Array<String> placeholders;
+	for (auto &value : values) {
+		placeholders.append(add_param(params, value));
+	}
+	// Missing properties are stored as empty strings.
+	auto col = db.column(category);
+	sql = utils::format("(% <> '' AND % IN (%))", col, col, String::join(placeholders, ", "));
+
+	return true;
+}
+
 void TextMetaConstraint::to_xml(xml_node node)
 {
 	auto prop_node = node.append_child("Property");
@@ -140,6 +189,73 @@ bool NumericMetaConstraint::filter(const Document *file) const
 	return false;
 }
 
+bool NumericMetaConstraint::to_sql(MetaDatabase &db, String &sql, Array<String> &params) const
+{
+	const char *sql_op;
+
+	switch (op)
+	{
+		case Operator::Equal:
+			sql_op = "=";
+			break;
+		case Operator::NotEqual:
+			sql_op = "<>";
+			break;
+		case Operator::Less:
+			sql_op = "<";
+			break;
+		case Operator::LessEqual:
+			sql_op = "<=";
+			break;
+		case Operator::Greater:
+			sql_op = ">";
+			break;
+		case Operator::GreaterEqual:
+			sql_op = ">=";
+			break;
+		case Operator::InclusiveRange:
+		case Operator::ExclusiveRange:
+			sql_op = nullptr;
+			break;
+		default:
+			return false;
+	}
+
+	// Numbers are stored as text. Parameters are bound as text too, so they are cast to make sure that the comparison
+	// is numeric. Undefined values are NaN, which are only different from other numbers.
+	char buffer[32];
+	auto add_number = [&](double num) {
+		snprintf(buffer, sizeof buffer, "%.17g", num);
+		return utils::format("CAST(% AS REAL)", add_param(params, buffer));
+	};
+	auto col = db.column(category);
+	auto num = utils::format("CAST(% AS REAL)", col);
+	auto undefined = add_param(params, Property::undefined_string());
+	String test;
+
+	if (sql_op)
+	{
+		test = utils::format("% % %", num, sql_op, add_number(value.first));
+	}
+	else
+	{
+		auto lower = (op == Operator::InclusiveRange) ? ">=" : ">";
+		auto upper = (op == Operator::InclusiveRange) ? "<=" : "<";
+		auto v1 = add_number(value.first);
+		auto v2 = add_number(value.second);
+		test = utils::format("% % % AND % % %", num, lower, v1, num, upper, v2);
+	}
+
+	if (op == Operator::NotEqual) {
+		sql = utils::format("(% <> '' AND (% = % OR %))", col, col, undefined, test);
+	}
+	else {
+		sql = utils::format("(% <> '' AND % <> % AND %)", col, col, undefined, test);
+	}
+
+	return true;
+}
+
 bool NumericMetaConstraint::check_value(double num) const
 {
 	switch (op)
@@ -245,6 +361,14 @@ bool BooleanMetaConstraint::filter(const Document *file) const
 	return false;
 }
 
+bool BooleanMetaConstraint::to_sql(MetaDatabase &db, String &sql, Array<String> &params) const
+{
+	auto text = value ? Property::true_string() : Property::false_string();
+	sql = utils::format("% = %", db.column(category), add_param(params, text));
+
+	return true;
+}
+
 void BooleanMetaConstraint::to_xml(xml_node node)
 {
 	auto prop_node = node.append_child("Property");
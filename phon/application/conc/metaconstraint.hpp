@@ -29,6 +29,8 @@
 
 namespace phonometrica {
 
+class MetaDatabase;
+
 struct MetaConstraint
 {
 	MetaConstraint() = default;
@@ -37,6 +39,11 @@ struct MetaConstraint
 
 	virtual bool filter(const Document * file) const = 0;
 
+	// Compile the constraint to a boolean SQL expression over the files table, which must give the same result as
+	// filter(). Values are appended to params and referenced by their position (?N). Returns false if the constraint
+	// can't be expressed in SQL, in which case it must be checked with filter().
+	virtual bool to_sql(MetaDatabase &db, String &sql, Array<String> &params) const { return false; }
+
 	virtual void to_xml(xml_node node) = 0;
 };
 
@@ -64,6 +71,8 @@ struct DescMetaConstraint final : public MetaConstraint
 
 	bool filter(const Document * file) const override;
 
+	bool to_sql(MetaDatabase &db, String &sql, Array<String> &params) const override;
+
 	void to_xml(xml_node node) override;
 
 	Operator op;
@@ -94,6 +103,8 @@ struct TextMetaConstraint : public PropertyMetaConstraint
 
 	bool filter(const Document * file) const override;
 
+	bool to_sql(MetaDatabase &db, String &sql, Array<String> &params) const override;
+
 	void to_xml(xml_node node) override;
 
 	Array<String> values;
@@ -120,6 +131,8 @@ struct NumericMetaConstraint : public PropertyMetaConstraint
 
 	bool filter(const Document * file) const override;
 
+	bool to_sql(MetaDatabase &db, String &sql, Array<String> &params) const override;
+
 	static const char * op_to_name(Operator op);
 
 	static Operator name_to_op(std::string_view name);
@@ -142,6 +155,8 @@ struct BooleanMetaConstraint : public PropertyMetaConstraint
 
 	bool filter(const Document * file) const override;
 
+	bool to_sql(MetaDatabase &db, String &sql, Array<String> &params) const override;
+
 	void to_xml(xml_node node) override;
 
 	bool value;
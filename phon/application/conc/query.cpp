@@ -19,10 +19,15 @@
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
-#include <wx/progdlg.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <phon/runtime.hpp>
 #include <phon/application/conc/query.hpp>
 #include <phon/application/project.hpp>
+#include <phon/application/settings.hpp>
 #include <phon/utils/xml.hpp>
 #include <phon/utils/file_system.hpp>
 
@@ -55,9 +60,60 @@ Array<Handle<Annotation>> Query::filter_annotations(Array<Handle<Annotation>> ca
 	}
 	Array<Handle<Annotation>> result;
 
+	// Constraints which can be expressed in SQL are resolved by the metadata database, which avoids checking each file.
+	// This only works for files whose metadata are stored in the database and have not been modified: other files are
+	// checked in memory.
+	auto &db = Project::get()->database();
+	Array<String> clauses, params;
+	Array<const MetaConstraint*> residual;
+
+	for (auto &constraint : m_metaconstraints)
+	{
+		String clause;
+
+		if (constraint->to_sql(db, clause, params)) {
+			clauses.append(std::move(clause));
+		}
+		else {
+			residual.append(constraint.get());
+		}
+	}
+
+	if (clauses.empty())
+	{
+		for (auto &candidate : candidates)
+		{
+			if (filter_metadata(candidate.get())) {
+				result.append(std::move(candidate));
+			}
+		}
+
+		return result;
+	}
+
+	std::set<String> selected;
+	bool match_empty = db.select_files(String::join(clauses, " AND "), params, selected);
+
 	for (auto &candidate : candidates)
 	{
-		if (filter_metadata(candidate.get())) {
+		bool ok;
+
+		if (candidate->metadata_in_database())
+		{
+			// Files which are not in the database don't have any metadata.
+			auto &path = candidate->path();
+			ok = selected.find(path) != selected.end() || (match_empty && !db.has_file(path));
+
+			for (auto it = residual.begin(); ok && it != residual.end(); it++) {
+				ok = (*it)->filter(candidate.get());
+			}
+		}
+		else
+		{
+			ok = filter_metadata(candidate.get());
+		}
+
+		if (ok) {
 			result.append(std::move(candidate));
 		}
 	}
@@ -508,9 +564,9 @@ Handle<Query> Query::copy() const
 	return copy;
 }
 
-Handle<Concordance> Query::execute()
+Handle<Concordance> Query::execute(const Progress &progress)
 {
-	auto conc = make_handle<Concordance>(m_constraints.size(), m_context, m_context_length, search(), nullptr);
+	auto conc = make_handle<Concordance>(m_constraints.size(), m_context, m_context_length, search(progress), nullptr);
 	auto label = this->label();
 	if (label.starts_with("Query ")) {
 		label.replace_first("Query ", "Concordance ");
@@ -521,8 +577,11 @@ Handle<Concordance> Query::execute()
 	return conc;
 }
 
-Array<AutoMatch> Query::search()
+Array<AutoMatch> Query::search(const Progress &progress)
 {
+	if (m_constraints.empty()) {
+		throw error("[Query error] The query has no constraint");
+	}
 	Array<AutoMatch> result;
 	auto tmp = selected_annotations.empty() ? Project::get()->get_annotations() : selected_annotations;
 	auto annotations = filter_annotations(std::move(tmp));
@@ -532,32 +591,64 @@ Array<AutoMatch> Query::search()
 	}
 
 	int count = (int)annotations.size(), t = 0;
-	wxProgressDialog progress(_("Executing query"), _("Processing annotations..."), count, nullptr, wxPD_AUTO_HIDE|wxPD_APP_MODAL|wxPD_CAN_ABORT);
 
 #ifdef PHON_TIMING
 	auto first_time = clock();
 #endif
 
-	for (auto &annot : annotations)
+	// All matches start from the first constraint, so candidate events for this constraint are enough to rule out
+	// annotations and events. Annotations which are not yet indexed are indexed as they are opened.
+	auto index = Project::get()->text_index();
+	TextIndex::HitMap hit_map;
+	const TextIndex::HitMap *hits = nullptr;
+	std::unique_ptr<Database::Transaction> transaction;
+
+	if (index)
 	{
-		// Cancelled by user?
-		if (!progress.Update(t++)) {
-			return result;
+		if (!m_constraints.empty() && index->lookup(m_constraints[1], hit_map)) {
+			hits = &hit_map;
 		}
-		try
+		transaction = std::make_unique<Database::Transaction>(*index);
+	}
+
+	int nthread = thread_count(count);
+
+	if (nthread > 1)
+	{
+		result = parallel_search(annotations, hits, progress, nthread);
+	}
+	else
+	{
+		for (auto &annot : annotations)
 		{
-			annot->open();
-			auto matches = search_annotation(annot);
+			// Cancelled by user?
+			if (progress && !progress(t++, count)) {
+				break;
+			}
+			try
+			{
+				const TextIndex::Hits *candidates;
+				if (!open_annotation(annot, hits, candidates)) {
+					continue;
+				}
+				auto matches = search_annotation(annot, m_constraints, candidates);
 
-			result.reserve(result.size() + matches.size());
-			for (auto &m : matches) {
-				result.append(std::move(m));
+				result.reserve(result.size() + matches.size());
+				for (auto &m : matches)
+				{
+					m->set_annotation(annot);
+					result.append(std::move(m));
+				}
+			}
+			catch (std::exception &e)
+			{
+				throw error("error in annotation %: %", annot->path(), e.what());
 			}
 		}
-		catch (std::exception &e)
-		{
-			throw error("error in annotation %: %", annot->path(), e.what());
-		}
+	}
+
+	if (transaction) {
+		transaction->commit();
 	}
 
 #ifdef PHON_TIMING
@@ -570,19 +661,216 @@ Array<AutoMatch> Query::search()
 	return result;
 }
 
-Array<AutoMatch> Query::search_annotation(const Handle<Annotation> &annot)
+Array<AutoMatch> Query::parallel_search(const Array<Handle<Annotation>> &annotations, const TextIndex::HitMap *hits,
+                                        const Progress &progress, int thread_count)
+{
+	// Annotations are opened on the calling thread, since loading touches the project and shared parsers, and are then
+	// handed over to a pool of workers which only read them. Each annotation is searched by exactly one worker, and each
+	// worker owns a copy of the constraints because compiled regexes hold their match state. Matches are stored per
+	// annotation and concatenated in the original order, so that the result is identical to a serial search.
+	struct Task
+	{
+		Array<AutoMatch> matches;
+		const TextIndex::Hits *candidates = nullptr;
+		String error;
+		bool searched = false;
+	};
+
+	intptr_t count = annotations.size();
+	std::vector<Task> tasks(size_t(count + 1)); // 1-based, like annotations
+	std::vector<Array<Constraint>> constraints(size_t(thread_count), m_constraints);
+	std::deque<intptr_t> queue;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::atomic<bool> cancelled(false);
+	std::atomic<int> completed(0);
+	// Lowest index of an annotation that raised an error. Annotations after it don't need to be searched.
+	std::atomic<intptr_t> failure(count + 1);
+	bool closed = false;
+
+	auto fail = [&](intptr_t i) {
+		intptr_t current = failure;
+		while (i < current && !failure.compare_exchange_weak(current, i)) { }
+	};
+
+	auto work = [&](const Array<Constraint> &worker_constraints) {
+		while (true)
+		{
+			intptr_t i;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&]() { return closed || !queue.empty(); });
+				if (queue.empty()) {
+					return;
+				}
+				i = queue.front();
+				queue.pop_front();
+			}
+			auto &task = tasks[size_t(i)];
+
+			if (!cancelled && i < failure)
+			{
+				try
+				{
+					task.matches = search_annotation(annotations[i], worker_constraints, task.candidates);
+					task.searched = true;
+				}
+				catch (std::exception &e)
+				{
+					task.error = e.what();
+					fail(i);
+				}
+			}
+			annotations[i]->unpin();
+			++completed;
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(size_t(thread_count));
+	for (auto &c : constraints) {
+		workers.emplace_back(work, std::cref(c));
+	}
+
+	intptr_t dispatched = 0;
+
+	for (intptr_t i = 1; i <= count && i < failure; i++)
+	{
+		if (progress && !progress(completed, int(count))) {
+			cancelled = true;
+			break;
+		}
+		auto &task = tasks[size_t(i)];
+		try
+		{
+			if (!open_annotation(annotations[i], hits, task.candidates))
+			{
+				// Nothing to search: the annotation can't match.
+				task.searched = true;
+				continue;
+			}
+		}
+		catch (std::exception &e)
+		{
+			task.error = e.what();
+			fail(i);
+			break;
+		}
+		// Opening the next annotations may unload this one from memory before a worker gets to it.
+		annotations[i]->pin();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(i);
+		}
+		cond.notify_one();
+		dispatched++;
+	}
+
+	// Keep the dialog responsive while the workers catch up.
+	while (!cancelled && completed < dispatched)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		if (progress && !progress(completed, int(count))) {
+			cancelled = true;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+	}
+	cond.notify_all();
+	for (auto &w : workers) {
+		w.join();
+	}
+
+	// Merge in annotation order. Stop at the first annotation that was not searched (if the user cancelled the query)
+	// or report the first error, as the serial search does.
+	Array<AutoMatch> result;
+
+	for (intptr_t i = 1; i <= count; i++)
+	{
+		auto &task = tasks[size_t(i)];
+
+		if (!task.error.empty()) {
+			throw error("error in annotation %: %", annotations[i]->path(), task.error);
+		}
+		if (!task.searched) {
+			break;
+		}
+		result.reserve(result.size() + task.matches.size());
+		for (auto &m : task.matches)
+		{
+			// Handles are not thread-safe, so matches only get a reference to their annotation here.
+			m->set_annotation(annotations[i]);
+			result.append(std::move(m));
+		}
+	}
+
+	return result;
+}
+
+int Query::thread_count(intptr_t annotation_count)
+{
+	int n = Settings::get_int("concordance", "query_threads");
+
+	if (n <= 0) {
+		n = (int) std::thread::hardware_concurrency();
+	}
+
+	return (int) std::min<intptr_t>(n, annotation_count);
+}
+
+bool Query::open_annotation(const Handle<Annotation> &annot, const TextIndex::HitMap *hits, const TextIndex::Hits *&candidates)
+{
+	auto index = Project::get()->text_index();
+	candidates = nullptr;
+
+	if (index && index->is_current(*annot))
+	{
+		if (hits)
+		{
+			auto it = hits->find(annot->path());
+			if (it == hits->end()) {
+				return false;
+			}
+			candidates = &it->second;
+		}
+		annot->open();
+	}
+	else
+	{
+		annot->open();
+
+		if (index && !annot->content_modified())
+		{
+			// The index is only a cache: if the annotation can't be indexed, it will be scanned next time.
+			try
+			{
+				index->update(*annot);
+			}
+			catch (std::exception &)
+			{ }
+		}
+	}
+
+	return true;
+}
+
+Array<AutoMatch> Query::search_annotation(const Handle<Annotation> &annot, const Array<Constraint> &constraints,
+                                          const TextIndex::Hits *candidates) const
 {
 	// We maintain a list of the layer indices we have already seen, so that we don't scan the same layer twice
 	Array<int> seen;
 
-	auto matches = find_matches(annot, m_constraints[1], Array<AutoMatch>(), seen, Constraint::Relation::None, m_ref_constraint == 1);
+	auto matches = find_matches(annot, constraints[1], Array<AutoMatch>(), seen, Constraint::Relation::None, m_ref_constraint == 1, candidates);
 
-	for (intptr_t i = 2; i <= m_constraints.size(); i++)
+	for (intptr_t i = 2; i <= constraints.size(); i++)
 	{
 		if (matches.empty()) {
 			return matches;
 		}
-		matches = find_matches(annot, m_constraints[i], std::move(matches), seen, m_constraints[i - 1].relation, m_ref_constraint == i);
+		matches = find_matches(annot, constraints[i], std::move(matches), seen, constraints[i - 1].relation, m_ref_constraint == i);
 	}
 
 	return matches;
@@ -590,7 +878,7 @@ Array<AutoMatch> Query::search_annotation(const Handle<Annotation> &annot)
 
 Array <AutoMatch>
 Query::find_matches(const Handle<Annotation> &annot, const Constraint &constraint, Array <AutoMatch> matches,
-                    Array<int> &blacklist, Constraint::Relation op, bool is_ref) const
+                    Array<int> &blacklist, Constraint::Relation op, bool is_ref, const TextIndex::Hits *candidates) const
 {
 	if (constraint.use_index())
 	{
@@ -598,14 +886,14 @@ Query::find_matches(const Handle<Annotation> &annot, const Constraint &constrain
 		{
 			for (intptr_t i = 1; i <= annot->layer_count(); i++)
 			{
-				matches = find_matches(annot, constraint, std::move(matches), i, blacklist, op, is_ref);
+				matches = find_matches(annot, constraint, std::move(matches), i, blacklist, op, is_ref, candidates);
 			}
 
 			return matches;
 		}
 		else
 		{
-			return find_matches(annot, constraint, std::move(matches), constraint.layer_index, blacklist, op, is_ref);
+			return find_matches(annot, constraint, std::move(matches), constraint.layer_index, blacklist, op, is_ref, candidates);
 		}
 	}
 	else
@@ -618,7 +906,7 @@ Query::find_matches(const Handle<Annotation> &annot, const Constraint &constrain
 
 			if (constraint.layer_regex->match(layer->label))
 			{
-				matches = find_matches(annot, constraint, std::move(matches), i, blacklist, op, is_ref);
+				matches = find_matches(annot, constraint, std::move(matches), i, blacklist, op, is_ref, candidates);
 			}
 		}
 
@@ -628,7 +916,8 @@ Query::find_matches(const Handle<Annotation> &annot, const Constraint &constrain
 
 Array <AutoMatch>
 Query::find_matches(const Handle<Annotation> &annot, const Constraint &constraint, Array <AutoMatch> matches,
-                    intptr_t layer_index, Array<int> &seen, Constraint::Relation op, bool is_ref) const
+                    intptr_t layer_index, Array<int> &seen, Constraint::Relation op, bool is_ref,
+                    const TextIndex::Hits *candidates) const
 {
 	using Op = Constraint::Relation;
 
@@ -641,8 +930,7 @@ Query::find_matches(const Handle<Annotation> &annot, const Constraint &constrain
 	{
 		auto &events = annot->get_layer_events(layer_index);
 
-		for (auto &event : events)
-		{
+		auto search_event = [&](const AutoEvent &event) {
 			intptr_t pos = 0;
 			std::unique_ptr<Match::Target> target;
 			while (true)
@@ -650,7 +938,7 @@ Query::find_matches(const Handle<Annotation> &annot, const Constraint &constrain
 				target = find_target(event, constraint, layer_index, pos, is_ref);
 				if (target)
 				{
-					matches.append(std::make_unique<Match>(annot, std::move(target)));
+					matches.append(std::make_unique<Match>(std::move(target)));
 					if (pos == -1) {
 						break; // found a match with "equals", don't need to search again
 					}
@@ -660,6 +948,27 @@ Query::find_matches(const Handle<Annotation> &annot, const Constraint &constrain
 					break;
 				}
 			}
+		};
+
+		if (candidates)
+		{
+			// Only visit the events that the text index reports for this layer.
+			auto it = candidates->find(layer_index);
+			if (it != candidates->end())
+			{
+				for (auto i : it->second)
+				{
+					if (i <= events.size()) {
+						search_event(events[i]);
+					}
+				}
+			}
+		}
+		else
+		{
+			for (auto &event : events) {
+				search_event(event);
+			}
 		}
 		seen.append(layer_index);
 
@@ -27,6 +27,8 @@
 #include <phon/application/conc/metaconstraint.hpp>
 #include <phon/application/conc/constraint.hpp>
 #include <phon/application/conc/concordance.hpp>
+#include <phon/application/text_index.hpp>
+#include <functional>
 #include <phon/regex.hpp>
 
 namespace phonometrica {
@@ -47,6 +49,11 @@ public:
 
 	using Context = Concordance::Context;
 
+	// Progress callback: receives the number of annotations processed so far and the total number of annotations, and
+	// returns false to cancel the search. The query engine doesn't depend on the GUI: a progress dialog can be driven
+	// from here, and batch runs can simply pass an empty callback.
+	using Progress = std::function<bool(int, int)>;
+
 	Query(Directory *parent, String path);
 
 	~Query() override = default;
@@ -63,7 +70,7 @@ public:
 
 	virtual void clear();
 
-	virtual Handle<Concordance> execute();
+	virtual Handle<Concordance> execute(const Progress &progress = Progress());
 
 	// Note: subclasses must override this method and return false
 	virtual bool is_text_query() const { return true; }
@@ -102,6 +109,8 @@ public:
 
 	static void initialize(Runtime &rt);
 
+	static int thread_count(intptr_t annotation_count);
+
 protected:
 
 	void load() override;
@@ -118,16 +127,29 @@ protected:
 
 	bool filter_metadata(const Document *file) const;
 
-	Array<AutoMatch> search();
+	Array<AutoMatch> search(const Progress &progress);
+
+	Array<AutoMatch> parallel_search(const Array<Handle<Annotation>> &annotations, const TextIndex::HitMap *hits,
+	                                 const Progress &progress, int thread_count);
+
+	// Open an annotation before it is searched. Returns false if the text index shows that the annotation can't match,
+	// in which case it is not opened. Otherwise, candidates points to the events that may match the first constraint,
+	// or is null if all events must be scanned.
+	static bool open_annotation(const Handle<Annotation> &annot, const TextIndex::HitMap *hits, const TextIndex::Hits *&candidates);
 
-	Array<AutoMatch> search_annotation(const Handle<Annotation> &annot);
+	// Search an opened annotation. This is called from worker threads, so the matches don't hold a handle to the
+	// annotation: the caller must set it.
+	Array<AutoMatch> search_annotation(const Handle<Annotation> &annot, const Array<Constraint> &constraints,
+	                                   const TextIndex::Hits *candidates = nullptr) const;
 
 	Array <AutoMatch> find_matches(const Handle<Annotation> &annot, const Constraint &constraint, Array <AutoMatch> matches,
-	                               Array<int> &blacklist, Constraint::Relation op, bool is_ref) const;
+	                               Array<int> &blacklist, Constraint::Relation op, bool is_ref,
+	                               const TextIndex::Hits *candidates = nullptr) const;
 
 	Array <AutoMatch> find_matches(const Handle<Annotation> &annot, const Constraint &constraint, Array <AutoMatch> matches,
 	                               intptr_t layer_index,
-	                               Array<int> &seen, Constraint::Relation op, bool is_ref) const;
+	                               Array<int> &seen, Constraint::Relation op, bool is_ref,
+	                               const TextIndex::Hits *candidates = nullptr) const;
 
 	std::unique_ptr<Match::Target>
 	find_target(const AutoEvent &event, const Constraint &constraint, intptr_t layer_index, intptr_t &pos,
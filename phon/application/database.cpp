@@ -20,6 +20,7 @@
  ***********************************************************************************************************************/
 
 #include <cmath>
+#include <functional>
 #include <phon/application/database.hpp>
 #include <phon/application/sound.hpp>
 #include <phon/application/annotation.hpp>
@@ -151,6 +152,65 @@ String Database::escape_string(const String &str)
 	return result;
 }
 
+Database::Transaction::Transaction(Database &db) :
+	db(db), active(true)
+{
+	db.execute("BEGIN TRANSACTION;");
+}
+
+Database::Transaction::~Transaction()
+{
+	if (active) {
+		db.execute("ROLLBACK;", false);
+	}
+}
+
+void Database::Transaction::commit()
+{
+	if (active)
+	{
+		active = false;
+		db.commit();
+	}
+}
+
+sqlite3_stmt *Database::prepare(std::string_view sql)
+{
+	sqlite3_stmt *stmt = nullptr;
+
+	if (sqlite3_prepare_v2(db, sql.data(), int(sql.size()), &stmt, nullptr) != SQLITE_OK)
+	{
+		auto msg = utils::format("[SQL error] An error occurred in sqlite3_prepare() with the following query: %", sql);
+		throw std::runtime_error(msg);
+	}
+
+	return stmt;
+}
+
+void Database::run(sqlite3_stmt *stmt)
+{
+	int status = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+
+	if (status != SQLITE_DONE && status != SQLITE_ROW)
+	{
+		auto msg = utils::format("[SQL error] An error occurred in sqlite3_step(): %", sqlite3_errmsg(db));
+		throw std::runtime_error(msg);
+	}
+}
+
+String Database::quote_identifier(const String &name)
+{
+	// Values are never inserted in the SQL code: they are bound to prepared statements.
+	String result("\"");
+	auto escaped = name;
+	escaped.replace("\"", "\"\"");
+	result.append(escaped);
+	result.append('"');
+
+	return result;
+}
+
 bool Database::has_column(std::string_view col)
 {
     auto result = sqlite3_table_column_metadata(db, nullptr, "files", col.data(),
@@ -164,14 +224,58 @@ bool Database::has_column(std::string_view col)
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+static void bind_text(sqlite3_stmt *stmt, int index, const String &value)
+{
+	// Values must stay alive until the statement has been run.
+	sqlite3_bind_text(stmt, index, value.data(), int(value.size()), SQLITE_STATIC);
+}
+
 MetaDatabase::MetaDatabase(const String &path, bool create_table) : Database(path)
 {
+	// Write-ahead logging makes commits much cheaper, and readers don't block the writer.
+	execute("PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL;", false);
+
 	if (create_table)
 	{
 		create_main_table();
 	}
 }
 
+MetaDatabase::~MetaDatabase()
+{
+	// Statements must be finalized before the connection is closed by the base class.
+	finalize_statements();
+}
+
+void MetaDatabase::close()
+{
+	finalize_statements();
+	Database::close();
+}
+
+void MetaDatabase::finalize_statements()
+{
+	for (auto &item : m_statements) {
+		sqlite3_finalize(item.second);
+	}
+	m_statements.clear();
+}
+
+sqlite3_stmt *MetaDatabase::get_statement(const String &sql)
+{
+	auto it = m_statements.find(sql);
+
+	if (it != m_statements.end())
+	{
+		sqlite3_clear_bindings(it->second);
+		return it->second;
+	}
+	auto stmt = prepare(sql);
+	m_statements.insert({sql, stmt});
+
+	return stmt;
+}
+
 void MetaDatabase::create_main_table()
 {
 	// Internal fields start with an underscore
@@ -179,6 +283,37 @@ void MetaDatabase::create_main_table()
 _soundref TEXT NOT NULL DEFAULT "",
 _type TEXT NOT NULL DEFAULT "",
 _description TEXT NOT NULL DEFAULT "");)__");
+	m_columns_loaded = false;
+}
+
+void MetaDatabase::load_columns()
+{
+	m_columns.clear();
+	auto stmt = prepare("PRAGMA table_info(files);");
+
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		auto name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+		if (name) m_columns.insert(name);
+	}
+	sqlite3_finalize(stmt);
+	m_columns_loaded = true;
+
+	// Databases created by older versions don't have indexes on categories.
+	for (auto &col : m_columns)
+	{
+		if (!col.starts_with("_")) {
+			create_index(col);
+		}
+	}
+}
+
+void MetaDatabase::create_index(const String &cat)
+{
+	// Indexes speed up metadata filtering in queries.
+	auto sql = utils::format("CREATE INDEX IF NOT EXISTS % ON files (%);",
+			quote_identifier(String("files_").append(cat)), quote_identifier(cat));
+	execute(sql, false);
 }
 
 void MetaDatabase::add_file(Document &file)
@@ -193,25 +328,32 @@ void MetaDatabase::add_file(Document &file)
 	columns.append("_type");
 	columns.append("_description");
 
-	values.append(escape_string(file.path()));
-	values.append(escape_string(sound_ref));
-	values.append(escape_string(type));
-	values.append(escape_string(file.description()));
+	values.append(file.path());
+	values.append(sound_ref);
+	values.append(type);
+	values.append(file.description());
 
 	for (const Property &p: file.properties())
 	{
 		auto category = p.category();
 
 		add_category(category);
-		columns.append(escape_string(category));
-		values.append(escape_string(p.value()));
+		columns.append(quote_identifier(category));
+		values.append(p.value());
 	}
 
-	String col_stmt = String::join(columns, ", ");
-	String val_stmt = String::join(values, ", ");
+	Array<String> params;
+	for (intptr_t i = 1; i <= values.size(); i++) {
+		params.append(utils::format("?%", i));
+	}
+
+	auto sql = utils::format("INSERT INTO files (%) VALUES (%);", String::join(columns, ", "), String::join(params, ", "));
+	auto stmt = get_statement(sql);
 
-	auto query = utils::format("INSERT INTO files (%) VALUES (%)", col_stmt, val_stmt);
-	execute(query);
+	for (intptr_t i = 1; i <= values.size(); i++) {
+		bind_text(stmt, int(i), values[i]);
+	}
+	run(stmt);
 }
 
 void MetaDatabase::save_file_metadata(Document &file)
@@ -221,121 +363,117 @@ void MetaDatabase::save_file_metadata(Document &file)
 	msg.append(path);
 	saving_metadata(msg);
 
-	if (has_file(path))
-	{
-		Array<String> columns, values;
-
-		columns.append("_description");
-		columns.append("_soundref");
-
-		values.append(file.description());
-		values.append(get_sound_path_if_exists(file));
-
-		// Update all properties: existing properties are overwritten
-		// (even if they haven't changed). Other properties are emptied.
-		auto categories = Property::get_categories();
-
-		for (auto &cat : categories) {
-            add_category(cat);
-		}
+	// Update all properties: existing properties are overwritten (even if they haven't changed). Other properties
+	// are emptied. The statement only depends on the set of categories, so it is compiled once for all the files.
+	auto &categories = Property::get_categories();
+	Array<String> columns, updates, params, values;
 
-		for (auto &p: file.properties())
-		{
-			columns.append(p.category());
-			values.append(p.value());
-			categories.erase(p.category());
-		}
+	columns.append("_path");
+	columns.append("_soundref");
+	columns.append("_type");
+	columns.append("_description");
 
-		// Make sure absent properties are empty
-		for (auto &cat : categories)
-		{
-			columns.append(cat);
-			values.append(String());
-		}
+	values.append(path);
+	values.append(get_sound_path_if_exists(file));
+	values.append(file.class_name());
+	values.append(file.description());
 
-		String col, val;
-		Array<String> stmts;
+	for (auto &cat : categories)
+	{
+		add_category(cat);
+		auto col = quote_identifier(cat);
+		updates.append(utils::format("% = excluded.%", col, col));
+		columns.append(std::move(col));
+		values.append(file.get_property_value(cat));
+	}
 
-		for (intptr_t i = 1; i <= values.size(); i++)
-		{
-			col = columns[i];
-			val = values[i];
-            auto stmt = escape_string(col);
-            stmt.append(" = ");
-            stmt.append(escape_string(val));
-            stmts.append(std::move(stmt));
-		}
+	for (intptr_t i = 1; i <= values.size(); i++) {
+		params.append(utils::format("?%", i));
+	}
 
-		String updates = String::join(stmts, ", ");
-		auto query = utils::format("UPDATE files SET % where _path = \"%\";",
-		                           updates, path);
-		execute(query);
+	String sql = utils::format("INSERT INTO files (%) VALUES (%) ON CONFLICT (_path) DO UPDATE SET "
+			"_soundref = excluded._soundref, _description = excluded._description",
+			String::join(columns, ", "), String::join(params, ", "));
+	for (auto &update : updates) {
+		sql.append(", ").append(update);
 	}
-	else
-	{
-		add_file(file);
+	sql.append(';');
+	auto stmt = get_statement(sql);
+
+	for (intptr_t i = 1; i <= values.size(); i++) {
+		bind_text(stmt, int(i), values[i]);
 	}
+	run(stmt);
 }
 
 void MetaDatabase::add_metadata_to_file(const Handle<Document> &file)
 {
-	String sql("SELECT * FROM files WHERE _path = ");
-	sql.append(escape_string(file->path())).append(';');
-
-	parse(sql);
+	auto stmt = get_statement("SELECT * FROM files WHERE _path = ?1;");
+	auto &path = file->path();
+	bind_text(stmt, 1, path);
 
-	if (read_row())
+	try
 	{
-		int count = field_count();
-
-		for (int i = 0; i < count; ++i)
+		if (sqlite3_step(stmt) == SQLITE_ROW)
 		{
-			String name(get_column_name(i));
-			String field(get_field(i));
-			if (name == "_description")
-			{
-				file->set_description(field, false);
-			}
-			else if (name == "_soundref" && (!field.empty()) && file->is<Annotation>())
-			{
-				auto annot = recast<Annotation>(file);
-				notify_annotation_needs_sound(annot, field);
-			}
-			else if (!name.starts_with("_") && !field.empty())
+			int count = sqlite3_column_count(stmt);
+
+			for (int i = 0; i < count; ++i)
 			{
-				Property p;
-				bool ok = false;
-				double num;
+				String name(sqlite3_column_name(stmt, i));
+				auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+				String field = text ? String(text) : String();
 
-				// Boolean
-				if (field == Property::true_string())
-				{
-					p = Property(name, true);
-				}
-				else if (field == Property::false_string())
-				{
-					p = Property(name, false);
-				}
-				// Numeric
-				else if (field == Property::undefined_string())
+				if (name == "_description")
 				{
-					p = Property(name, std::nan(""));
+					file->set_description(field, false);
 				}
-				else if ((num = field.to_float(&ok)) != std::nan("") && ok)
+				else if (name == "_soundref" && (!field.empty()) && file->is<Annotation>())
 				{
-					p = Property(name, num);
+					auto annot = recast<Annotation>(file);
+					notify_annotation_needs_sound(annot, field);
 				}
-				// Text
-				else
+				else if (!name.starts_with("_") && !field.empty())
 				{
-					p = Property(name, field);
+					Property p;
+					bool ok = false;
+					double num;
+
+					// Boolean
+					if (field == Property::true_string())
+					{
+						p = Property(name, true);
+					}
+					else if (field == Property::false_string())
+					{
+						p = Property(name, false);
+					}
+					// Numeric
+					else if (field == Property::undefined_string())
+					{
+						p = Property(name, std::nan(""));
+					}
+					else if ((num = field.to_float(&ok)) != std::nan("") && ok)
+					{
+						p = Property(name, num);
+					}
+					// Text
+					else
+					{
+						p = Property(name, field);
+					}
+					file->add_property(p, false);
 				}
-				file->add_property(p, false);
 			}
 		}
 	}
+	catch (...)
+	{
+		sqlite3_reset(stmt);
+		throw;
+	}
 
-	finalize_statement();
+	sqlite3_reset(stmt);
 }
 
 std::set<String> MetaDatabase::get_categories()
@@ -365,52 +503,102 @@ std::set<String> MetaDatabase::get_categories()
 
 void MetaDatabase::add_category(const String &cat)
 {
-    if (!has_column(cat))
-    {
-        String sql("ALTER TABLE files ADD COLUMN \"");
-        sql.append(cat)
-                .append("\" TEXT NOT NULL DEFAULT \"\";");
+	if (!m_columns_loaded) {
+		load_columns();
+	}
 
-        execute(sql, false);
-    }
+	if (m_columns.find(cat) == m_columns.end())
+	{
+		String sql("ALTER TABLE files ADD COLUMN ");
+		sql.append(quote_identifier(cat)).append(" TEXT NOT NULL DEFAULT \"\";");
+		execute(sql, false);
+		create_index(cat);
+		m_columns.insert(cat);
+	}
 }
 
-void MetaDatabase::remove_category_from_file(const String &path, const String &cat)
+String MetaDatabase::column(const String &cat)
+{
+	if (!m_columns_loaded) {
+		load_columns();
+	}
+
+	return (m_columns.find(cat) == m_columns.end()) ? String("''") : quote_identifier(cat);
+}
+
+bool MetaDatabase::select_files(const String &where, const Array<String> &params, std::set<String> &paths)
 {
-	String sql("UPDATE files SET ");
+	if (!m_columns_loaded) {
+		load_columns();
+	}
+
+	// Queries are not cached since each one is only run once.
+	auto run_query = [&](const String &sql, const std::function<void(sqlite3_stmt*)> &callback) {
+		auto stmt = prepare(sql);
+		for (intptr_t i = 1; i <= params.size(); i++) {
+			bind_text(stmt, int(i), params[i]);
+		}
+		int status;
+		while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+			callback(stmt);
+		}
+		sqlite3_finalize(stmt);
+		if (status != SQLITE_DONE) {
+			throw std::runtime_error(utils::format("[SQL error] An error occurred in sqlite3_step(): %", sqlite3_errmsg(db)));
+		}
+	};
 
-	sql.append(cat)
-			.append("= \"\" WHERE _path = ")
-			.append(escape_string(path))
-			.append(';');
+	run_query(utils::format("SELECT _path FROM files WHERE %;", where), [&](sqlite3_stmt *stmt) {
+		auto path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+		if (path) paths.insert(path);
+	});
 
-	execute(sql);
+	// Evaluate the expression on a row in which all the fields have their default value.
+	Array<String> defaults;
+	for (auto &col : m_columns) {
+		defaults.append(utils::format("'' AS %", quote_identifier(col)));
+	}
+	bool result = false;
+	run_query(utils::format("SELECT % FROM (SELECT %);", where, String::join(defaults, ", ")), [&](sqlite3_stmt *stmt) {
+		result = (sqlite3_column_int(stmt, 0) != 0);
+	});
+
+	return result;
+}
+
+void MetaDatabase::remove_category_from_file(const String &path, const String &cat)
+{
+	auto sql = utils::format("UPDATE files SET % = '' WHERE _path = ?1;", quote_identifier(cat));
+	auto stmt = get_statement(sql);
+	bind_text(stmt, 1, path);
+	run(stmt);
 }
 
 String MetaDatabase::get_value(const String &path, const String &cat)
 {
-	String sql("SELECT ");
+	auto sql = utils::format("SELECT % FROM files WHERE _path = ?1;", quote_identifier(cat));
+	auto stmt = get_statement(sql);
 	String value;
+	bind_text(stmt, 1, path);
 
-	sql.append(escape_string(cat))
-			.append(" FROM files WHERE _path = ")
-			.append(escape_string(path))
-			.append(';');
-	parse(sql);
-
-	if (read_row())
-	{ value = get_field(0); }
-	finalize_statement();
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+		if (text) value = text;
+	}
+	sqlite3_reset(stmt);
 
 	return value;
 }
 
 bool MetaDatabase::has_file(const String &path)
 {
-	auto sql = utils::format("SELECT * FROM files WHERE _path = \"%\";", path);
-	parse(sql);
+	auto stmt = get_statement("SELECT 1 FROM files WHERE _path = ?1;");
+	bind_text(stmt, 1, path);
+	bool found = (sqlite3_step(stmt) == SQLITE_ROW);
+	sqlite3_reset(stmt);
 
-	return check_statement();
+	return found;
 }
 
 String MetaDatabase::get_sound_path_if_exists(const Document &file) const
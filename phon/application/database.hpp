@@ -24,6 +24,7 @@
 
 #include <set>
 #include <phon/string.hpp>
+#include <phon/hashmap.hpp>
 #include <phon/third_party/sqlite/sqlite3.h>
 #include <phon/runtime/typed_object.hpp>
 #include <phon/utils/signal.hpp>
@@ -40,6 +41,24 @@ class Database
 {
 public:
 
+	// Group statements in a single transaction, which is rolled back unless it is explicitly committed.
+	class Transaction final
+	{
+	public:
+
+		explicit Transaction(Database &db);
+
+		~Transaction();
+
+		void commit();
+
+	private:
+
+		Database &db;
+
+		bool active;
+	};
+
 	explicit Database(const String &path);
 
 	virtual ~Database();
@@ -62,7 +81,7 @@ public:
 
 	bool has_column(std::string_view col);
 
-	void close();
+	virtual void close();
 
 	/* Check whether the query returned any rows and clean up */
 	bool check_statement();
@@ -71,6 +90,9 @@ public:
 
 	String path() const { return m_path; }
 
+	// Quote a table or column name.
+	static String quote_identifier(const String &name);
+
 protected:
 
 	/* Database connection */
@@ -82,6 +104,12 @@ protected:
 	String m_path;
 
 	String escape_string(const String &str);
+
+	// Compile a statement which can be executed many times. The caller owns the statement.
+	sqlite3_stmt *prepare(std::string_view sql);
+
+	// Execute a prepared statement and reset it so that it can be reused.
+	void run(sqlite3_stmt *stmt);
 };
 
 
@@ -97,6 +125,10 @@ public:
 
 	MetaDatabase(const String &path, bool create_table);
 
+	~MetaDatabase() override;
+
+	void close() override;
+
 	void create_main_table();
 
 	bool has_file(const String &path);
@@ -113,6 +145,13 @@ public:
 
 	std::set<String> get_categories();
 
+	// Get the SQL expression for a category's column. Categories which are not in the database yet are empty strings.
+	String column(const String &cat);
+
+	// Select the files whose metadata satisfy a boolean SQL expression over the files table. Returns true if a file which
+	// is not in the database, and therefore has no metadata, would also satisfy the expression.
+	bool select_files(const String &where, const Array<String> &params, std::set<String> &paths);
+
 	Signal<const Property &> notify_property;
 
 	// Send annotation and sound path. The project will associate the Annotation with
@@ -124,6 +163,23 @@ private:
 	String get_value(const String &path, const String &cat);
 
 	String get_sound_path_if_exists(const Document &file) const;
+
+	// Get a prepared statement from the cache, or compile it. Statements stay valid when columns are added.
+	sqlite3_stmt *get_statement(const String &sql);
+
+	void finalize_statements();
+
+	void load_columns();
+
+	void create_index(const String &cat);
+
+	// Cache of prepared statements, indexed by their SQL code.
+	Hashmap<String, sqlite3_stmt*> m_statements;
+
+	// Columns in the files table (loaded on demand).
+	std::set<String> m_columns;
+
+	bool m_columns_loaded = false;
 };
 
 
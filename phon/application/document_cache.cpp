@@ -0,0 +1,121 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <cassert>
+#include <phon/application/document_cache.hpp>
+#include <phon/application/vfs.hpp>
+
+namespace phonometrica {
+
+static intptr_t cache_budget = intptr_t(256) << 20;
+static intptr_t cache_size = 0;
+
+
+DocumentCache::EntryList &DocumentCache::entries()
+{
+	// Documents may be destroyed after static objects when the application exits, so the cache is never destroyed.
+	static auto list = new EntryList;
+	return *list;
+}
+
+std::unordered_map<Document*, DocumentCache::EntryList::iterator> &DocumentCache::positions()
+{
+	static auto map = new std::unordered_map<Document*, EntryList::iterator>;
+	return *map;
+}
+
+void DocumentCache::touch(Document *doc)
+{
+	auto &list = entries();
+	auto &map = positions();
+	auto it = map.find(doc);
+
+	if (it != map.end())
+	{
+		list.splice(list.begin(), list, it->second);
+		return;
+	}
+
+	auto size = doc->memory_size();
+	if (size == 0) return;
+
+	list.push_front(Entry{doc, size});
+	map[doc] = list.begin();
+	cache_size += size;
+
+	if (cache_size > cache_budget) {
+		evict(doc);
+	}
+}
+
+void DocumentCache::remove(Document *doc)
+{
+	auto &map = positions();
+	auto it = map.find(doc);
+
+	if (it != map.end())
+	{
+		cache_size -= it->second->size;
+		entries().erase(it->second);
+		map.erase(it);
+	}
+}
+
+void DocumentCache::evict(Document *current)
+{
+	auto &list = entries();
+	// Documents that can't be unloaded are moved to the front of the list, so that each document is visited at most
+	// once. The document that was just opened is at the front, so it is never unloaded.
+	auto n = list.size();
+
+	while (cache_size > cache_budget && n-- > 1)
+	{
+		auto doc = list.back().doc;
+		assert(doc != current);
+
+		// On success, the document removes itself from the cache.
+		if (!doc->unload()) {
+			list.splice(list.begin(), list, std::prev(list.end()));
+		}
+	}
+}
+
+intptr_t DocumentCache::budget()
+{
+	return cache_budget;
+}
+
+void DocumentCache::set_budget(intptr_t bytes)
+{
+	cache_budget = bytes;
+}
+
+intptr_t DocumentCache::resident_size()
+{
+	return cache_size;
+}
+
+intptr_t DocumentCache::count()
+{
+	return (intptr_t) entries().size();
+}
+
+} // namespace phonometrica
@@ -0,0 +1,79 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: keep track of the documents whose content is loaded in memory, and unload the least recently used          *
+ * ones when their total size exceeds a budget. This class only has static methods.                                    *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_DOCUMENT_CACHE_HPP
+#define PHONOMETRICA_DOCUMENT_CACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+namespace phonometrica {
+
+class Document;
+
+
+// Documents register themselves when they are opened. Only documents that report a non-zero memory size are tracked.
+// When the total size of the tracked documents exceeds the budget, documents are unloaded in least recently used order,
+// except for the one that was just opened and for documents that can't be unloaded (because they are modified, pinned
+// or otherwise in use). Unloaded documents are transparently reloaded the next time they are opened.
+// Documents are opened on the main thread, and so is this class used.
+class DocumentCache final
+{
+public:
+
+	// Mark a document as the most recently used one, and unload other documents if needed.
+	static void touch(Document *doc);
+
+	// Stop tracking a document (when it is unloaded or destroyed).
+	static void remove(Document *doc);
+
+	// Maximum number of bytes used by the tracked documents.
+	static intptr_t budget();
+
+	static void set_budget(intptr_t bytes);
+
+	// Approximate number of bytes used by the tracked documents.
+	static intptr_t resident_size();
+
+	static intptr_t count();
+
+private:
+
+	struct Entry
+	{
+		Document *doc;
+		intptr_t size;
+	};
+
+	using EntryList = std::list<Entry>;
+
+	static void evict(Document *current);
+
+	static EntryList &entries();
+
+	static std::unordered_map<Document*, EntryList::iterator> &positions();
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_DOCUMENT_CACHE_HPP
@@ -0,0 +1,255 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <phon/application/peak_pyramid.hpp>
+#include <phon/error.hpp>
+#include <phon/utils/helpers.hpp>
+
+namespace phonometrica {
+
+static const char peak_magic[4] = { 'P', 'H', 'P', 'K' };
+static const int32_t peak_version = 1;
+
+// Number of bins read from the sound file at once.
+static const intptr_t bins_per_read = 128;
+
+
+void PeakPyramid::build(SndfileHandle &handle, const Callback &callback)
+{
+	int nchannel = handle.channels();
+	m_nframe = (intptr_t) handle.frames();
+	auto nbin = (m_nframe + BIN_SIZE - 1) / BIN_SIZE;
+	m_tracks.assign(nchannel == 1 ? 1 : size_t(nchannel + 1), std::vector<Level>(1));
+
+	for (auto &track : m_tracks) {
+		track.front().reserve(size_t(nbin));
+	}
+
+	std::vector<double> buffer(size_t(BIN_SIZE * bins_per_read * nchannel));
+	std::vector<Peak> peaks(m_tracks.size());
+	const Peak empty_peak = { (std::numeric_limits<float>::max)(), std::numeric_limits<float>::lowest() };
+	intptr_t frame_count = 0;
+	handle.seek(0, SEEK_SET);
+
+	while (frame_count < m_nframe)
+	{
+		auto count = (intptr_t) handle.readf(buffer.data(), BIN_SIZE * bins_per_read);
+		if (count <= 0) break;
+		auto ptr = buffer.data();
+
+		for (intptr_t offset = 0; offset < count; offset += BIN_SIZE)
+		{
+			auto limit = (std::min)(offset + BIN_SIZE, count);
+			std::fill(peaks.begin(), peaks.end(), empty_peak);
+
+			for (intptr_t i = offset; i < limit; i++)
+			{
+				if (nchannel == 1)
+				{
+					auto value = float(*ptr++);
+					peaks[0].min = (std::min)(peaks[0].min, value);
+					peaks[0].max = (std::max)(peaks[0].max, value);
+				}
+				else
+				{
+					double sum = 0.0;
+					for (int j = 1; j <= nchannel; j++)
+					{
+						auto value = *ptr++;
+						peaks[j].min = (std::min)(peaks[j].min, float(value));
+						peaks[j].max = (std::max)(peaks[j].max, float(value));
+						sum += value;
+					}
+					auto value = float(sum / nchannel);
+					peaks[0].min = (std::min)(peaks[0].min, value);
+					peaks[0].max = (std::max)(peaks[0].max, value);
+				}
+			}
+
+			for (size_t k = 0; k < m_tracks.size(); k++) {
+				m_tracks[k].front().push_back(peaks[k]);
+			}
+		}
+
+		frame_count += count;
+		if (callback) callback(frame_count);
+	}
+	handle.seek(0, SEEK_SET);
+
+	// If the file is truncated, the missing frames are treated as silence, as in SampleStore.
+	for (auto &track : m_tracks) {
+		track.front().resize(size_t(nbin), Peak{0.0f, 0.0f});
+	}
+
+	build_levels();
+}
+
+void PeakPyramid::build_levels()
+{
+	for (auto &track : m_tracks)
+	{
+		track.resize(1);
+
+		while (track.back().size() > 1)
+		{
+			auto &lower = track.back();
+			Level upper((lower.size() + 1) / 2);
+
+			for (size_t i = 0; i < upper.size(); i++)
+			{
+				auto &p1 = lower[2 * i];
+				auto &p2 = (2 * i + 1 < lower.size()) ? lower[2 * i + 1] : p1;
+				upper[i] = Peak{(std::min)(p1.min, p2.min), (std::max)(p1.max, p2.max)};
+			}
+			track.push_back(std::move(upper));
+		}
+	}
+}
+
+const std::vector<PeakPyramid::Level> &PeakPyramid::get_levels(int channel) const
+{
+	assert(channel >= 0);
+	return (m_tracks.size() == 1) ? m_tracks.front() : m_tracks[size_t(channel)];
+}
+
+intptr_t PeakPyramid::bin_count() const
+{
+	return m_tracks.empty() ? 0 : (intptr_t) m_tracks.front().front().size();
+}
+
+void PeakPyramid::get(int channel, intptr_t first, intptr_t last, double &min_value, double &max_value) const
+{
+	assert(first >= 0 && last <= bin_count());
+	auto &levels = get_levels(channel);
+	auto lo = (std::numeric_limits<float>::max)();
+	auto hi = std::numeric_limits<float>::lowest();
+
+	auto merge = [&](const Peak &p) {
+		lo = (std::min)(lo, p.min);
+		hi = (std::max)(hi, p.max);
+	};
+
+	// Bottom-up range query: a bin which is not paired with its sibling within the range is merged at this level, and
+	// the remaining bins are covered by their parents.
+	for (size_t k = 0; first < last; k++)
+	{
+		auto &level = levels[k];
+		if (first & 1) {
+			merge(level[size_t(first++)]);
+		}
+		if (last & 1) {
+			merge(level[size_t(--last)]);
+		}
+		first >>= 1;
+		last >>= 1;
+	}
+
+	min_value = (std::min)(min_value, double(lo));
+	max_value = (std::max)(max_value, double(hi));
+}
+
+bool PeakPyramid::load(const String &path, const String &sound_path, int64_t stamp, intptr_t nframe, int nchannel)
+{
+	FILE *file = utils::open_file(path, "rb");
+	if (!file) return false;
+
+	char magic[4];
+	int32_t version, bin_size, file_nchannel;
+	int64_t file_stamp, file_nframe, path_size;
+	bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, peak_magic, 4) == 0 &&
+			fread(&version, sizeof version, 1, file) == 1 && version == peak_version &&
+			fread(&bin_size, sizeof bin_size, 1, file) == 1 && bin_size == BIN_SIZE &&
+			fread(&file_nchannel, sizeof file_nchannel, 1, file) == 1 && file_nchannel == nchannel &&
+			fread(&file_stamp, sizeof file_stamp, 1, file) == 1 && file_stamp == stamp &&
+			fread(&file_nframe, sizeof file_nframe, 1, file) == 1 && file_nframe == nframe &&
+			fread(&path_size, sizeof path_size, 1, file) == 1 && path_size == sound_path.size();
+
+	if (ok)
+	{
+		std::string file_path(size_t(path_size), '\0');
+		ok = fread(file_path.data(), 1, file_path.size(), file) == file_path.size() && file_path == sound_path.data();
+	}
+
+	if (ok)
+	{
+		auto nbin = size_t((nframe + BIN_SIZE - 1) / BIN_SIZE);
+		m_tracks.assign(nchannel == 1 ? 1 : size_t(nchannel + 1), std::vector<Level>(1));
+
+		for (auto &track : m_tracks)
+		{
+			auto &level = track.front();
+			level.resize(nbin);
+			if (fread(level.data(), sizeof(Peak), nbin, file) != nbin)
+			{
+				ok = false;
+				break;
+			}
+		}
+	}
+	fclose(file);
+
+	if (!ok)
+	{
+		m_tracks.clear();
+		return false;
+	}
+	m_nframe = nframe;
+	build_levels();
+
+	return true;
+}
+
+void PeakPyramid::save(const String &path, const String &sound_path, int64_t stamp) const
+{
+	FILE *file = utils::open_file(path, "wb");
+	if (!file) {
+		throw error("Cannot write peak file '%'", path);
+	}
+
+	int32_t nchannel = (m_tracks.size() == 1) ? 1 : int32_t(m_tracks.size() - 1);
+	int32_t bin_size = BIN_SIZE;
+	int64_t nframe = m_nframe;
+	int64_t path_size = sound_path.size();
+	bool ok = fwrite(peak_magic, 1, 4, file) == 4 &&
+			fwrite(&peak_version, sizeof peak_version, 1, file) == 1 &&
+			fwrite(&bin_size, sizeof bin_size, 1, file) == 1 &&
+			fwrite(&nchannel, sizeof nchannel, 1, file) == 1 &&
+			fwrite(&stamp, sizeof stamp, 1, file) == 1 &&
+			fwrite(&nframe, sizeof nframe, 1, file) == 1 &&
+			fwrite(&path_size, sizeof path_size, 1, file) == 1 &&
+			fwrite(sound_path.data(), 1, size_t(path_size), file) == size_t(path_size);
+
+	for (auto &track : m_tracks)
+	{
+		auto &level = track.front();
+		ok = ok && fwrite(level.data(), sizeof(Peak), level.size(), file) == level.size();
+	}
+
+	if (fclose(file) != 0 || !ok) {
+		throw error("Cannot write peak file '%'", path);
+	}
+}
+
+} // namespace phonometrica
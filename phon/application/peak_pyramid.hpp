@@ -0,0 +1,92 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: multi-resolution minimum and maximum sample values of a sound file, used to draw waveforms at any zoom     *
+ * level in time proportional to the number of pixels.                                                                 *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_PEAK_PYRAMID_HPP
+#define PHONOMETRICA_PEAK_PYRAMID_HPP
+
+#if PHON_WINDOWS
+#include <windows.h>
+#define ENABLE_SNDFILE_WINDOWS_PROTOTYPES 1
+#endif
+
+#include <functional>
+#include <vector>
+#include <sndfile.hh>
+#include <phon/string.hpp>
+
+namespace phonometrica {
+
+
+// The lowest level of the pyramid stores the minimum and maximum values of each bin of BIN_SIZE frames. Each level
+// above it merges pairs of bins from the level below, up to a single bin which covers the whole file. The extrema of
+// any range of bins can then be found by visiting at most 2 bins per level.
+class PeakPyramid final
+{
+public:
+
+	// Number of frames in a bin at the lowest level.
+	static constexpr intptr_t BIN_SIZE = 512;
+
+	using Callback = std::function<void(intptr_t)>;
+
+	PeakPyramid() = default;
+
+	// Read the whole file and compute the peaks of each channel, and of their average if there are several channels.
+	// The callback (if any) receives the number of frames read so far.
+	void build(SndfileHandle &handle, const Callback &callback = Callback());
+
+	// Read peaks saved by save(). The stamp is the modification time of the sound file when the peaks were computed.
+	// Returns false if the file doesn't exist or doesn't match the sound.
+	bool load(const String &path, const String &sound_path, int64_t stamp, intptr_t nframe, int nchannel);
+
+	void save(const String &path, const String &sound_path, int64_t stamp) const;
+
+	// Minimum and maximum values in bins first to last - 1 (0-based) at the lowest level. Channel 0 is the average of
+	// all the channels.
+	void get(int channel, intptr_t first, intptr_t last, double &min_value, double &max_value) const;
+
+	intptr_t bin_count() const;
+
+private:
+
+	struct Peak
+	{
+		float min;
+		float max;
+	};
+
+	using Level = std::vector<Peak>;
+
+	void build_levels();
+
+	const std::vector<Level> &get_levels(int channel) const;
+
+	// Levels for each channel. The first track is the average of all the channels, except for mono files, which have a
+	// single track.
+	std::vector<std::vector<Level>> m_tracks;
+
+	intptr_t m_nframe = 0;
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_PEAK_PYRAMID_HPP
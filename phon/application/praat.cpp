@@ -19,135 +19,451 @@
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
+#include <charconv>
+#include <cstring>
 #include <phon/application/praat.hpp>
-#include <phon/regex.hpp>
 #include <phon/error.hpp>
 #include <phon/file.hpp>
 #include <phon/utils/file_system.hpp>
+#include <phon/utils/helpers.hpp>
+#include <phon/third_party/utf8/utf8.h>
 
 extern "C" char *sendpraat (void *display, const char *programName, long timeOut, const char *text);
 
 namespace phonometrica { namespace praat {
 
-static Regex pattern_interval_tier("class\\s+=\\s+\"IntervalTier\"");
-static Regex pattern_point_tier("class\\s+=\\s+\"TextTier\"");
-static Regex pattern_name("name\\s+=\\s+\"(.*)\"");
-static Regex pattern_size("size\\s+=\\s+(\\d*)");
+static std::string utf16_to_utf8(const std::u16string &text)
+{
+	std::string result;
+	result.reserve(text.size());
+	utf8::utf16to8(text.begin(), text.end(), std::back_inserter(result));
+
+	return result;
+}
 
-static Regex pattern_interval("intervals\\s+\\[\\d*\\]:");
-static Regex pattern_xmin("xmin\\s+=\\s+-?(\\d+\\.?\\d*)"); // Some files have -0 in the Seoul Speech Corpus
-static Regex pattern_xmax("xmax\\s+=\\s+(\\d+\\.?\\d*)");
-static Regex pattern_text("text\\s+=\\s+\"(.*)\"", Regex::Multiline);
+static std::string utf16_to_utf8(const char *begin, const char *end, bool big_endian)
+{
+	std::u16string text;
+	text.reserve(size_t(end - begin) / 2);
+
+	for (auto p = begin; p + 1 < end; p += 2)
+	{
+		auto b1 = uint8_t(p[0]), b2 = uint8_t(p[1]);
+		text.push_back(big_endian ? char16_t((b1 << 8) | b2) : char16_t((b2 << 8) | b1));
+	}
 
-static Regex pattern_point("points\\s+\\[\\d*\\]:");
-static Regex pattern_time("number\\s+=\\s+(\\d+\\.?\\d*)");
-static Regex pattern_mark("mark\\s+=\\s+\"(.*)\"", Regex::Multiline);
+	return utf16_to_utf8(text);
+}
 
-static
-bool search(File &infile, Regex &pattern, String &result)
+// Praat's text format is a sequence of values (numbers, strings and flags such as <exists>). Everything else, such as
+// labels ("xmin =") and indices ("intervals [3]:") in the long format, is ignored, so the long and short formats can be
+// read by the same code.
+class TextReader final
 {
-	String line;
+public:
+
+	TextReader(const char *begin, const char *end) : pos(begin), end(end) { }
+
+	double read_number()
+	{
+		skip();
+		if (pos < end && *pos == '+') pos++;
+		double value;
+		auto result = std::from_chars(pos, end, value);
+		if (result.ec != std::errc()) {
+			fail("a number");
+		}
+		pos = result.ptr;
+
+		return value;
+	}
 
-	while (!infile.at_end())
+	intptr_t read_integer()
 	{
-		line.append(infile.read_line());
-		line.rtrim();
+		skip();
+		int64_t value;
+		auto result = std::from_chars(pos, end, value);
+		if (result.ec != std::errc() || value < 0) {
+			fail("a positive integer");
+		}
+		pos = result.ptr;
 
-		if (pattern.match(line))
+		return intptr_t(value);
+	}
+
+	// Read the number of items in a list. Each item takes at least `item_size` bytes, so the count can't exceed the size
+	// of the rest of the file: this rejects corrupted counts before we reserve memory for them.
+	intptr_t read_count(intptr_t item_size)
+	{
+		auto count = read_integer();
+		if (count > (end - pos) / item_size) {
+			throw error("Invalid TextGrid file: list size exceeds file size");
+		}
+
+		return count;
+	}
+
+	// Minimum size of each item in the file: a tier has a class, a label and two numbers, an interval has two numbers and
+	// a string, and a point has a number and a string (numbers take at least one digit and strings two quotes).
+	static constexpr intptr_t tier_size = 6;
+	static constexpr intptr_t interval_size = 5;
+	static constexpr intptr_t point_size = 3;
+
+	String read_string()
+	{
+		skip();
+		if (pos == end || *pos != '"') {
+			fail("a string");
+		}
+		auto start = ++pos;
+		std::string unescaped;
+
+		// Double quotes are escaped by doubling them.
+		while (true)
 		{
-			result = pattern.capture(1);
-			return true;
+			auto quote = static_cast<const char*>(memchr(pos, '"', size_t(end - pos)));
+			if (!quote) {
+				throw error("Invalid TextGrid file: unterminated string");
+			}
+			pos = quote + 1;
+
+			if (pos < end && *pos == '"')
+			{
+				unescaped.append(start, pos);
+				start = ++pos;
+			}
+			else if (unescaped.empty())
+			{
+				return String(start, intptr_t(quote - start));
+			}
+			else
+			{
+				unescaped.append(start, quote);
+				return String(unescaped.data(), intptr_t(unescaped.size()));
+			}
 		}
 	}
 
-	return false;
-}
+	bool read_flag()
+	{
+		skip();
+		if (pos == end || *pos != '<') {
+			fail("a flag");
+		}
+		auto start = ++pos;
+		while (pos < end && *pos != '>') pos++;
+		if (pos == end) {
+			fail("a flag");
+		}
 
-static
-double validate(const String &value)
-{
-	bool ok = false;
-	double result = value.to_float(&ok);
+		return std::string_view(start, size_t(pos++ - start)) == "exists";
+	}
 
-	if (!ok) {
-		throw error("Invalid TextGrid file: conversion to float failed");
+private:
+
+	void skip()
+	{
+		while (pos < end)
+		{
+			char c = *pos;
+
+			if (isspace(uint8_t(c)) || c == '=' || c == ':' || c == '?')
+			{
+				pos++;
+			}
+			else if (isalpha(uint8_t(c)) || c == '_')
+			{
+				while (pos < end && (isalnum(uint8_t(*pos)) || *pos == '_')) pos++;
+			}
+			else if (c == '[')
+			{
+				while (pos < end && *pos != ']') pos++;
+				if (pos < end) pos++;
+			}
+			else if (c == '!')
+			{
+				// Comment
+				while (pos < end && *pos != '\n') pos++;
+			}
+			else
+			{
+				break;
+			}
+		}
 	}
 
-	return result;
-}
+	[[noreturn]] void fail(const char *expected)
+	{
+		if (pos == end) {
+			throw error("Invalid TextGrid file: expected % but reached the end of the file", expected);
+		}
+		throw error("Invalid TextGrid file: expected % at character '%'", expected, String(pos, 1));
+	}
 
-bool parse_tier_header(File &infile, const String &line, TierHeader &header)
+	const char *pos, *end;
+};
+
+// Binary files are written by Praat's "Save as binary file". Numbers are big-endian, and strings are either ASCII or
+// UTF-16 (flagged by a length of 0xFF or 0xFFFF).
+class BinaryReader final
 {
-	bool has_intervals = pattern_interval_tier.match(line);
-	bool has_points = false;
+public:
+
+	BinaryReader(const char *begin, const char *end) : pos(begin), end(end) { }
+
+	uint8_t read_u8()
+	{
+		check(1);
+		return uint8_t(*pos++);
+	}
+
+	uint16_t read_u16()
+	{
+		check(2);
+		uint16_t value = uint16_t((uint8_t(pos[0]) << 8) | uint8_t(pos[1]));
+		pos += 2;
 
-	if (!has_intervals) {
-		has_points = pattern_point_tier.match(line);
+		return value;
 	}
 
-	if (has_intervals || has_points)
+	intptr_t read_integer()
 	{
-		search(infile, pattern_name, header.label);
-		header.has_points = has_points;
-		String tmp;
-		search(infile, pattern_xmin, tmp);
-		header.xmin = validate(tmp);
-		search(infile, pattern_xmax, tmp);
-		header.xmax = validate(tmp);
-		search(infile, pattern_size, tmp);
+		check(4);
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++) value = (value << 8) | uint8_t(*pos++);
+		auto result = int32_t(value);
+		if (result < 0) {
+			throw error("Invalid binary TextGrid file: negative size");
+		}
 
-		bool ok;
-		int item_count = int(pattern_size.capture(1).to_int(&ok));
-		if (ok) header.size = item_count;
+		return result;
+	}
 
-		return true;
+	// See TextReader::read_count().
+	intptr_t read_count(intptr_t item_size)
+	{
+		auto count = read_integer();
+		if (count > (end - pos) / item_size) {
+			throw error("Invalid binary TextGrid file: list size exceeds file size");
+		}
+
+		return count;
 	}
 
-	return false;
-}
+	// Strings have a 1-byte (class) or 2-byte (label, text) length and numbers take 8 bytes.
+	static constexpr intptr_t tier_size = 19;
+	static constexpr intptr_t interval_size = 18;
+	static constexpr intptr_t point_size = 10;
 
-bool parse_interval(File &infile, const String &line, Interval &interval)
-{
-	if (pattern_interval.match(line))
+	double read_number()
+	{
+		check(8);
+		uint64_t bits = 0;
+		for (int i = 0; i < 8; i++) bits = (bits << 8) | uint8_t(*pos++);
+		double value;
+		memcpy(&value, &bits, sizeof value);
+
+		return value;
+	}
+
+	String read_w8()
 	{
-		String result;
+		intptr_t size = read_u8();
+		if (size == 0xFF) {
+			return read_utf16(read_u8());
+		}
 
-		search(infile, pattern_xmin, result);
-		interval.xmin = validate(result);
-		search(infile, pattern_xmax, result);
-		interval.xmax = validate(result);
-		bool ok = search(infile, pattern_text, interval.text);
+		return read_ascii(size);
+	}
 
-		if (! ok) {
-			throw error("Invalid TextGrid File: could not parse interval");
+	String read_w16()
+	{
+		intptr_t size = read_u16();
+		if (size == 0xFFFF) {
+			return read_utf16(read_u16());
 		}
-		interval.text.replace("\"\"", "\"");
 
-		return true;
+		return read_ascii(size);
+	}
+
+private:
+
+	String read_ascii(intptr_t size)
+	{
+		check(size);
+		String s(pos, size);
+		pos += size;
+
+		return s;
+	}
+
+	String read_utf16(intptr_t size)
+	{
+		std::u16string s;
+		s.reserve(size_t(size));
+		for (intptr_t i = 0; i < size; i++) s.push_back(char16_t(read_u16()));
+
+		return utf16_to_utf8(s);
+	}
+
+	void check(intptr_t size)
+	{
+		if (end - pos < size) {
+			throw error("Invalid binary TextGrid file: unexpected end of file");
+		}
 	}
 
-	return false;
+	const char *pos, *end;
+};
+
+template<class Reader>
+static void read_tier(Reader &reader, const String &kind, Tier &tier)
+{
+	if (kind == "IntervalTier")
+	{
+		auto count = reader.read_count(Reader::interval_size);
+		tier.intervals.reserve(count);
+
+		for (intptr_t i = 0; i < count; i++)
+		{
+			Interval interval;
+			interval.xmin = reader.read_number();
+			interval.xmax = reader.read_number();
+			if constexpr (std::is_same_v<Reader, BinaryReader>) {
+				interval.text = reader.read_w16();
+			}
+			else {
+				interval.text = reader.read_string();
+			}
+			tier.intervals.append(std::move(interval));
+		}
+	}
+	else if (kind == "TextTier")
+	{
+		tier.has_points = true;
+		auto count = reader.read_count(Reader::point_size);
+		tier.points.reserve(count);
+
+		for (intptr_t i = 0; i < count; i++)
+		{
+			Point point;
+			point.time = reader.read_number();
+			if constexpr (std::is_same_v<Reader, BinaryReader>) {
+				point.text = reader.read_w16();
+			}
+			else {
+				point.text = reader.read_string();
+			}
+			tier.points.append(std::move(point));
+		}
+	}
+	else
+	{
+		throw error("Invalid TextGrid file: unknown tier class \"%\"", kind);
+	}
 }
 
-bool parse_point(File &infile, const String &line, Point &point)
+static Array<Tier> read_text(const char *begin, const char *end)
 {
-	if (pattern_point.match(line))
+	TextReader reader(begin, end);
+	Array<Tier> tiers;
+
+	// Old versions of Praat write "ooTextFile short" in short files.
+	if (!reader.read_string().starts_with("ooTextFile") || reader.read_string() != "TextGrid") {
+		throw error("Invalid TextGrid file: wrong file type");
+	}
+	reader.read_number(); // xmin
+	reader.read_number(); // xmax
+
+	if (reader.read_flag())
 	{
-		String result;
+		auto count = reader.read_count(TextReader::tier_size);
+		tiers.reserve(count);
+
+		for (intptr_t i = 0; i < count; i++)
+		{
+			Tier tier;
+			auto kind = reader.read_string();
+			tier.label = reader.read_string();
+			tier.xmin = reader.read_number();
+			tier.xmax = reader.read_number();
+			read_tier(reader, kind, tier);
+			tiers.append(std::move(tier));
+		}
+	}
 
-		search(infile, pattern_time, result);
-		point.time = validate(result);
-		bool ok = search(infile, pattern_mark, point.text);
+	return tiers;
+}
 
-		if (! ok) {
-			throw error("Invalid TextGrid File: could not parse point");
+static Array<Tier> read_binary(const char *begin, const char *end)
+{
+	BinaryReader reader(begin, end);
+	Array<Tier> tiers;
+
+	if (reader.read_w8() != "TextGrid") {
+		throw error("Invalid binary TextGrid file: wrong object class");
+	}
+	reader.read_number(); // xmin
+	reader.read_number(); // xmax
+
+	if (reader.read_u8())
+	{
+		auto count = reader.read_count(BinaryReader::tier_size);
+		tiers.reserve(count);
+
+		for (intptr_t i = 0; i < count; i++)
+		{
+			Tier tier;
+			auto kind = reader.read_w8();
+			tier.label = reader.read_w16();
+			tier.xmin = reader.read_number();
+			tier.xmax = reader.read_number();
+			read_tier(reader, kind, tier);
+			tiers.append(std::move(tier));
 		}
-		point.text.replace("\"\"", "\"");
+	}
+
+	return tiers;
+}
+
+Array<Tier> read_textgrid(const String &path)
+{
+	FILE *file = utils::open_file(path, "rb");
+	if (!file) {
+		throw error("Cannot open TextGrid file '%'", path);
+	}
+	std::string data;
+	char buffer[65536];
+	size_t count;
 
-		return true;
+	while ((count = fread(buffer, 1, sizeof buffer, file)) > 0) {
+		data.append(buffer, count);
+	}
+	bool ok = !ferror(file);
+	fclose(file);
+	if (!ok) {
+		throw error("Cannot read TextGrid file '%'", path);
+	}
+
+	std::string_view binary_tag("ooBinaryFile");
+	auto begin = data.data();
+	auto end = begin + data.size();
+
+	if (std::string_view(data).substr(0, binary_tag.size()) == binary_tag) {
+		return read_binary(begin + binary_tag.size(), end);
+	}
+	if (data.size() >= 2 && (uint8_t(data[0]) == 0xFE || uint8_t(data[0]) == 0xFF) && uint8_t(data[0]) + uint8_t(data[1]) == 0xFE + 0xFF)
+	{
+		data = utf16_to_utf8(begin + 2, end, uint8_t(data[0]) == 0xFE);
+		begin = data.data();
+		end = begin + data.size();
+	}
+	else if (data.size() >= 3 && memcmp(begin, "\xEF\xBB\xBF", 3) == 0)
+	{
+		begin += 3;
 	}
 
-	return false;
+	return read_text(begin, end);
 }
 
 static void run_temp_script(const String &script)
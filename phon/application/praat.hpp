@@ -24,19 +24,11 @@
 
 #include <utility>
 #include <phon/string.hpp>
+#include <phon/array.hpp>
 #include <phon/file.hpp>
 
 namespace phonometrica { namespace praat {
 
-struct TierHeader
-{
-	String label;
-	double xmin;
-	double xmax;
-	int size = 0;
-	bool has_points;
-};
-
 struct Point
 {
 	double time;
@@ -50,12 +42,19 @@ struct Interval
 	String text;
 };
 
-// If a tier was found, sets the name of the tier and whether it is a point tier.
-bool parse_tier_header(File &infile, const String &line, TierHeader &header);
-
-bool parse_interval(File &infile, const String &line, Interval &interval);
+struct Tier
+{
+	String label;
+	double xmin = 0;
+	double xmax = 0;
+	bool has_points = false;
+	Array<Interval> intervals;
+	Array<Point> points;
+};
 
-bool parse_point(File &infile, const String &line, Point &point);
+// Read a TextGrid in long or short text format (UTF-8 or UTF-16), or in binary format. The file is read in one block
+// and parsed in a single pass.
+Array<Tier> read_textgrid(const String &path);
 
 void open_textgrid(const String &tgd, const String &snd = String());
 
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <phon/regex.hpp>
 #include <phon/runtime/runtime.hpp>
+#include <phon/runtime/task_pool.hpp>
 #include <phon/application/project.hpp>
 #include <phon/application/settings.hpp>
 #include <phon/application/bookmark.hpp>
@@ -49,6 +50,109 @@ static const std::string_view VAR_HOME("$HOME");
 static const std::string_view VAR_PROJECT("$PHON_PROJECT");
 
 
+// Parallel tasks get detached copies of the project's annotations and sounds (see TaskPool).
+
+struct AnnotationSnapshot final : public TaskPool::Snapshot
+{
+	explicit AnnotationSnapshot(Annotation::Snapshot data) : data(std::move(data)) { }
+
+	Variant restore(Runtime &) const override { return make_handle<Annotation>(data); }
+
+	Annotation::Snapshot data;
+};
+
+struct SoundSnapshot final : public TaskPool::Snapshot
+{
+	explicit SoundSnapshot(Sound::Snapshot data) : data(std::move(data)) { }
+
+	Variant restore(Runtime &) const override { return make_handle<Sound>(data); }
+
+	Sound::Snapshot data;
+};
+
+// Read-only view of the project in a worker runtime. Each call to get_annotation() or get_sound() returns a new copy.
+struct ProjectSnapshot final : public TaskPool::Snapshot
+{
+	Variant restore(Runtime &rt) const override;
+
+	std::vector<Annotation::Snapshot> annotations;
+
+	std::vector<Sound::Snapshot> sounds;
+
+	// Indexes of the files by path.
+	Hashmap<String, size_t> annotation_index, sound_index;
+};
+
+Variant ProjectSnapshot::restore(Runtime &rt) const
+{
+	Project::preinitialize(rt);
+	Document::initialize(rt);
+	Annotation::initialize(rt);
+	Sound::initialize(rt);
+
+	// The snapshot outlives the worker runtimes.
+	auto view = this;
+
+	auto get_annotations = [view](Runtime &rt, std::span<Variant>) -> Variant {
+		Array<Variant> result;
+
+		for (auto &annot : view->annotations) {
+			result.append(make_handle<Annotation>(annot));
+		}
+
+		return make_handle<List>(&rt, std::move(result));
+	};
+
+	auto get_annotation = [view](Runtime &, std::span<Variant> args) -> Variant {
+		auto &path = cast<String>(args[0]);
+		auto it = view->annotation_index.find(path);
+
+		if (it != view->annotation_index.end()) {
+			return make_handle<Annotation>(view->annotations[it->second]);
+		}
+		else if (view->sound_index.find(path) != view->sound_index.end()) {
+			throw error("File \"%\" is not an annotation", path);
+		}
+
+		return Variant();
+	};
+
+	auto get_sounds = [view](Runtime &rt, std::span<Variant>) -> Variant {
+		Array<Variant> result;
+
+		for (auto &sound : view->sounds) {
+			result.append(make_handle<Sound>(sound));
+		}
+
+		return make_handle<List>(&rt, std::move(result));
+	};
+
+	auto get_sound = [view](Runtime &, std::span<Variant> args) -> Variant {
+		auto &path = cast<String>(args[0]);
+		auto it = view->sound_index.find(path);
+
+		if (it != view->sound_index.end()) {
+			return make_handle<Sound>(view->sounds[it->second]);
+		}
+		else if (view->annotation_index.find(path) != view->annotation_index.end()) {
+			throw error("File \"%\" is not a sound", path);
+		}
+
+		return Variant();
+	};
+
+#define CLS(T) get_class<T>()
+	rt.add_global("get_annotations", get_annotations, { });
+	rt.add_global("get_annotation", get_annotation, {CLS(String) });
+	rt.add_global("get_sounds", get_sounds, { });
+	rt.add_global("get_sound", get_sound, {CLS(String) });
+#undef CLS
+
+	return Variant();
+}
+
+
+
 void Project::open(String path)
 {
     close();
@@ -104,8 +208,17 @@ void Project::discard_database()
             filesystem::remove_file(path);
 		}
 	}
+	if (m_database_temp && m_text_index)
+	{
+		auto path = m_text_index->path();
+		m_text_index = nullptr;
+		if (filesystem::exists(path)) {
+			filesystem::remove_file(path);
+		}
+	}
 
     m_database = nullptr;
+	m_text_index = nullptr;
 	m_database_temp = true;
 }
 
@@ -135,11 +248,16 @@ void Project::save(String path)
 void Project::save()
 {
 	start_activity();
-	// Save content before writing the project, because write() will reset modifications on all VFiles.
-	m_corpus->save_content();
-	m_scripts->save_content();
-	m_data->save_content();
-	m_queries->save_content();
+	// Save content before writing the project, because write() will reset modifications on all VFiles. Metadata
+	// are written in a single transaction, which is much faster than committing each file separately.
+	{
+		Database::Transaction transaction(*m_database);
+		m_corpus->save_content();
+		m_scripts->save_content();
+		m_data->save_content();
+		m_queries->save_content();
+		transaction.commit();
+	}
 
 	write();
 
@@ -895,6 +1013,18 @@ void Project::open_database()
 	m_database_temp = !filesystem::exists(path);
 	m_database = std::make_unique<MetaDatabase>(path, m_database_temp);
 	m_database->notify_annotation_needs_sound.connect(&Project::bind_annotation, this);
+
+	// The text index is only a cache: if it can't be opened, queries fall back to scanning annotations.
+	try
+	{
+		String index_name(m_uuid);
+		index_name.append(".idx");
+		m_text_index = std::make_unique<TextIndex>(filesystem::join(Settings::metadata_directory(), index_name));
+	}
+	catch (std::exception &)
+	{
+		m_text_index = nullptr;
+	}
 }
 
 void Project::remove(DocList &files)
@@ -943,6 +1073,11 @@ MetaDatabase & Project::database() const
 	return *m_database;
 }
 
+TextIndex *Project::text_index() const
+{
+	return m_text_index.get();
+}
+
 void Project::bind_annotation(const Handle<Annotation> &annot, const String &sound_file)
 {
 	// The actual binding will occur in bind_annotations(), which is called once the project is loaded.
@@ -1149,6 +1284,34 @@ void Project::initialize(Runtime &rt)
 	auto &phon = cast<Module>(rt["phon"]);
 	phon.define("project", std::move(proj));
 #undef CLS
+
+	TaskPool::set_initializer([](Runtime &) -> std::shared_ptr<TaskPool::Snapshot> {
+		auto view = std::make_shared<ProjectSnapshot>();
+
+		for (auto &annot : Project::get()->get_annotations())
+		{
+			view->annotation_index[annot->path()] = view->annotations.size();
+			view->annotations.push_back(annot->snapshot());
+		}
+		for (auto &sound : Project::get()->get_sounds())
+		{
+			view->sound_index[sound->path()] = view->sounds.size();
+			view->sounds.push_back(sound->snapshot());
+		}
+
+		return view;
+	});
+
+	TaskPool::set_packer([](Variant &value) -> std::shared_ptr<TaskPool::Snapshot> {
+		if (check_type<Annotation>(value)) {
+			return std::make_shared<AnnotationSnapshot>(raw_cast<Annotation>(value).snapshot());
+		}
+		else if (check_type<Sound>(value)) {
+			return std::make_shared<SoundSnapshot>(raw_cast<Sound>(value).snapshot());
+		}
+
+		return nullptr;
+	});
 }
 
 void Project::clear()
@@ -1270,27 +1433,51 @@ void Project::import_metadata(const String &path, const String &separator)
 	auto header = csv.take_first();
 	const char *placeholders[] = { "%1", "%2", "%3", "%4", "%5", "%6", "%7", "%8", "%9" };
 
+	// Index files by base name, so that plain file names don't need to be matched against every file in the project.
+	Dictionary<Array<Handle<Document>*>> base_names;
+	Array<std::pair<String, Handle<Document>*>> all_files;
+
+	for (auto &item : m_files)
+	{
+		auto base = filesystem::base_name(item.first);
+		base_names[base].append(&item.second);
+		all_files.append({ std::move(base), &item.second });
+	}
+
 	// Scan each row
 	for (auto &row : csv)
 	{
 		// Either file name or a regular expression starting with '^' and ending with '$'
 		auto &filename = row.first();
 		std::unique_ptr<Regex> re;
+		Array<std::pair<String, Handle<Document>*>> matches;
 
 		if (filename.starts_with('^') && filename.ends_with('$'))
 		{
 			re = std::make_unique<Regex>(filename);
+			matches = all_files;
+		}
+		else
+		{
+			auto it = base_names.find(filename);
+
+			if (it != base_names.end())
+			{
+				for (auto file : it->second) {
+					matches.append({ filename, file });
+				}
+			}
 		}
 
 		// Scan each column
 		for (intptr_t j = 2; j <= header.size(); j++)
 		{
 			// Try to match each file
-			for (auto &item : m_files)
+			for (auto &item : matches)
 			{
-				auto base = filesystem::base_name(item.first);
+				auto &base = item.first;
 
-				if ((re && re->match(base)) || (base == filename))
+				if (!re || re->match(base))
 				{
 					auto category = header[j].trim();
 					auto value = row[j].trim();
@@ -1310,7 +1497,7 @@ void Project::import_metadata(const String &path, const String &separator)
 					}
 
 					if (!category.empty() && !value.empty()) {
-						tag_file(item.second, category, value);
+						tag_file(*item.second, category, value);
 					}
 				}
 			}
@@ -29,6 +29,7 @@
 #include <phon/application/dataset.hpp>
 #include <phon/application/metadata.hpp>
 #include <phon/application/database.hpp>
+#include <phon/application/text_index.hpp>
 #include <phon/application/conc/query.hpp>
 #include <phon/utils/signal.hpp>
 #include <phon/error.hpp>
@@ -96,6 +97,8 @@ public:
 
 	void add_query(Handle<Query> query);
 
+	static Query::Type get_query_type(const String &path);
+
 	void remove(DocList &files);
 
 	void remove(ElementList &files);
@@ -114,6 +117,8 @@ public:
 
 	MetaDatabase & database() const;
 
+	TextIndex *text_index() const;
+
 	void remove_empty_script();
 
 	DocList get_corpus_files() const;
@@ -256,8 +261,6 @@ private:
 
 	void get_statistics(const Directory &dir, Dictionary<int> &stat) const;
 
-    static Query::Type get_query_type(const String &path);
-
     static std::unique_ptr<Project> instance;
 
 	Runtime &rt;
@@ -299,6 +302,10 @@ private:
 
 	std::unique_ptr<MetaDatabase> m_database;
 
+	// Inverted index over event text, stored next to the metadata database. This may be null if the index could not
+	// be opened, in which case queries scan all events.
+	std::unique_ptr<TextIndex> m_text_index;
+
 	// Optional user-defined label for the project
 	String m_label;
 
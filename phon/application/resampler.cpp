@@ -27,13 +27,19 @@
 namespace phonometrica {
 
 Array<double> resample(std::span<double> input, double input_rate, double output_rate)
+{
+	Resampler resampler(input_rate, output_rate, RESAMPLER_BUFFER_SIZE);
+	return resample(resampler, input, input_rate, output_rate);
+}
+
+Array<double> resample(Resampler &resampler, std::span<double> input, double input_rate, double output_rate)
 {
 	assert(input_rate > 0);
 	assert(output_rate > 0);
-	const int BUFFER_SIZE = 1024;
+	const int BUFFER_SIZE = RESAMPLER_BUFFER_SIZE;
 	double buffer[BUFFER_SIZE];
 	memset(buffer, 0, sizeof(double) * BUFFER_SIZE);
-	Resampler resampler(input_rate, output_rate, BUFFER_SIZE);
+	resampler.clear();
 	intptr_t ol = double(input.size()) * output_rate / input_rate;
 	Array<double> output(ol, 0.0);
 	auto it = input.begin();
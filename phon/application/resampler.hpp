@@ -32,8 +32,15 @@ namespace phonometrica {
 
 using Resampler = r8b::CDSPResampler24;
 
+// Maximum number of samples passed to a resampler at once.
+static constexpr int RESAMPLER_BUFFER_SIZE = 1024;
+
 Array<double> resample(std::span<double> input, double input_rate, double output_rate);
 
+// Resample with an existing resampler, which must have been created with the same rates and RESAMPLER_BUFFER_SIZE.
+// Setting up a resampler is expensive, so this should be preferred when many signals are resampled.
+Array<double> resample(Resampler &resampler, std::span<double> input, double input_rate, double output_rate);
+
 } // namespace phonometrica
 
 
@@ -0,0 +1,177 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <phon/application/sample_store.hpp>
+#include <phon/error.hpp>
+
+namespace phonometrica {
+
+static std::mutex cache_mutex;
+static intptr_t cache_budget = intptr_t(512) << 20;
+static intptr_t cache_size = 0;
+
+
+SampleStore::SampleStore(const String &path)
+{
+#if PHON_WINDOWS
+	auto wpath = path.to_wide();
+	m_handle = SndfileHandle(wpath.data());
+#else
+	m_handle = SndfileHandle(path.data());
+#endif
+	if (!m_handle) {
+		throw error("Cannot open sound file '%': %", path, m_handle.strError());
+	}
+	m_nframes = (intptr_t) m_handle.frames();
+	m_nchannel = m_handle.channels();
+}
+
+SampleStore::~SampleStore()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	for (auto &item : m_blocks)
+	{
+		auto it = item.second;
+		cache_size -= intptr_t(it->samples.size() * sizeof(double));
+		blocks().erase(it);
+	}
+}
+
+SampleStore::BlockList &SampleStore::blocks()
+{
+	// Blocks are shared by all the stores. The list is never destroyed because sounds may be released after static
+	// objects have been destroyed when the application exits.
+	static auto list = new BlockList;
+	return *list;
+}
+
+intptr_t SampleStore::budget()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return cache_budget;
+}
+
+void SampleStore::set_budget(intptr_t bytes)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	cache_budget = bytes;
+
+	// Never evict the most recently used block: it may be in use.
+	while (cache_size > cache_budget && blocks().size() > 1) {
+		evict(std::prev(blocks().end()));
+	}
+}
+
+intptr_t SampleStore::resident_size()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return cache_size;
+}
+
+void SampleStore::evict(const BlockList::iterator &it)
+{
+	cache_size -= intptr_t(it->samples.size() * sizeof(double));
+	it->owner->m_blocks.erase(it->index);
+	blocks().erase(it);
+}
+
+const double *SampleStore::get_block(intptr_t index)
+{
+	// The caller must hold the cache lock.
+	auto found = m_blocks.find(index);
+
+	if (found != m_blocks.end())
+	{
+		auto it = found->second;
+		blocks().splice(blocks().begin(), blocks(), it);
+		return it->samples.data();
+	}
+
+	auto first_frame = index * BLOCK_SIZE;
+	auto nframe = std::min(BLOCK_SIZE, m_nframes - first_frame);
+	std::vector<double> samples(size_t(nframe * m_nchannel), 0.0);
+	m_handle.seek(first_frame, SEEK_SET);
+	// If the file is truncated, the missing samples are left to 0.
+	m_handle.readf(samples.data(), nframe);
+
+	blocks().push_front(Block{this, index, std::move(samples)});
+	auto it = blocks().begin();
+	m_blocks[index] = it;
+	cache_size += intptr_t(it->samples.size() * sizeof(double));
+
+	while (cache_size > cache_budget && blocks().size() > 1) {
+		evict(std::prev(blocks().end()));
+	}
+
+	return it->samples.data();
+}
+
+void SampleStore::read(int channel, intptr_t first, intptr_t last, double *buffer)
+{
+	assert(channel >= 0 && channel <= m_nchannel);
+	assert(first >= 1 && last <= m_nframes);
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	intptr_t frame = first - 1; // 0-based
+
+	while (frame < last)
+	{
+		auto index = frame / BLOCK_SIZE;
+		auto offset = frame - index * BLOCK_SIZE;
+		auto count = std::min(last - frame, BLOCK_SIZE - offset);
+		auto ptr = get_block(index) + offset * m_nchannel;
+
+		if (channel == 0)
+		{
+			for (intptr_t i = 0; i < count; i++)
+			{
+				double value = 0.0;
+				for (int j = 0; j < m_nchannel; j++) {
+					value += *ptr++;
+				}
+				*buffer++ = value / m_nchannel;
+			}
+		}
+		else
+		{
+			ptr += channel - 1;
+			for (intptr_t i = 0; i < count; i++)
+			{
+				*buffer++ = *ptr;
+				ptr += m_nchannel;
+			}
+		}
+		frame += count;
+	}
+}
+
+double SampleStore::get(int channel, intptr_t frame)
+{
+	double value;
+	read(channel, frame, frame, &value);
+
+	return value;
+}
+
+} // namespace phonometrica
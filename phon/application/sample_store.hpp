@@ -0,0 +1,106 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: random-access storage for the samples of a sound file. Samples are decoded in blocks when they are         *
+ * first needed, and the blocks of all open sounds share a single memory budget.                                       *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_SAMPLE_STORE_HPP
+#define PHONOMETRICA_SAMPLE_STORE_HPP
+
+#if PHON_WINDOWS
+#include <windows.h>
+#define ENABLE_SNDFILE_WINDOWS_PROTOTYPES 1
+#endif
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <sndfile.hh>
+#include <phon/string.hpp>
+
+namespace phonometrica {
+
+
+// A SampleStore gives random access to the samples of a sound file without decoding the whole file. The file is read
+// in blocks of BLOCK_SIZE frames, which are kept in a cache shared by all the stores: when the total size of the cached
+// blocks exceeds the budget, the least recently used blocks are discarded. Uncompressed formats are read directly at
+// the right offset, and compressed formats (FLAC, OGG) are decoded from the nearest seek point.
+// All the methods are thread-safe: each store has its own file handle, which is only used while holding the cache lock.
+class SampleStore final
+{
+public:
+
+	// Number of frames per block.
+	static constexpr intptr_t BLOCK_SIZE = 65536;
+
+	explicit SampleStore(const String &path);
+
+	SampleStore(const SampleStore &) = delete;
+
+	SampleStore &operator=(const SampleStore &) = delete;
+
+	~SampleStore();
+
+	int nchannel() const { return m_nchannel; }
+
+	intptr_t nframes() const { return m_nframes; }
+
+	// Copy frames first to last (1-based, inclusive) from the given channel to buffer, which must be large enough to
+	// hold them. Channel 0 is the average of all the channels.
+	void read(int channel, intptr_t first, intptr_t last, double *buffer);
+
+	double get(int channel, intptr_t frame);
+
+	// Maximum number of bytes used by cached blocks.
+	static intptr_t budget();
+
+	static void set_budget(intptr_t bytes);
+
+	// Number of bytes currently used by cached blocks.
+	static intptr_t resident_size();
+
+private:
+
+	struct Block
+	{
+		SampleStore *owner;
+		intptr_t index;
+		std::vector<double> samples; // interleaved frames
+	};
+
+	using BlockList = std::list<Block>;
+
+	const double *get_block(intptr_t index);
+
+	static void evict(const BlockList::iterator &it);
+
+	static BlockList &blocks();
+
+	SndfileHandle m_handle;
+
+	intptr_t m_nframes;
+
+	int m_nchannel;
+
+	std::unordered_map<intptr_t, BlockList::iterator> m_blocks;
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_SAMPLE_STORE_HPP
@@ -52,6 +52,10 @@ void Settings::initialize(Runtime *rt)
 	std_resource_path = "/usr/local/share/phonometrica";
 #endif
 
+	// Compiled scripts (plugins, modules and standard scripts, whether they are embedded or not) are cached in the
+	// metadata directory.
+	rt->set_bytecode_cache(join(metadata_directory(), "Bytecode"));
+
 	// Create global functions related to settings
 	auto get_settings_directory = [](Runtime &, std::span<Variant>) -> Variant {
 		return Settings::settings_directory();
@@ -330,7 +334,7 @@ void Settings::read()
 	catch (std::exception &)
 	{
 		// TODO: notify user that settings are invalid and have been reinitialized.
-		result = runtime->do_string(read_settings_script);
+		result = runtime->do_script("read_settings", read_settings_script);
 	}
 	// Versions of Phonometrica prior to 0.8 created phon.settings in settings.phon.
 	// We now simply store a table in this file, and create settings.phon ourselves to
@@ -447,6 +451,38 @@ void Settings::post_initialize()
 	catch (...) {
 		reset_formants();
 	}
+	try {
+		Settings::get_int("concordance", "query_threads");
+	}
+	catch (...) {
+		Settings::set_value("concordance", "query_threads", intptr_t(0));
+	}
+	if (!settings.contains("memory"))
+	{
+		reset_memory();
+	}
+	try {
+		Settings::get_int("memory", "document_cache");
+	}
+	catch (...) {
+		Settings::set_value("memory", "document_cache", intptr_t(256));
+	}
+	try {
+		Settings::get_boolean("waveform", "cache_peaks");
+	}
+	catch (...) {
+		Settings::set_value("waveform", "cache_peaks", true);
+	}
+	try {
+		Settings::get_int("memory", "spectrum_cache");
+	}
+	catch (...) {
+		Settings::set_value("memory", "spectrum_cache", intptr_t(128));
+	}
+	if (!settings.contains("binary_annotations"))
+	{
+		reset_binary_annotations();
+	}
 }
 
 void Settings::reset()
@@ -457,6 +493,7 @@ void Settings::reset()
 	reset_autohints();
 	reset_autoload();
 	reset_autosave();
+	reset_binary_annotations();
 	reset_last_directory();
 	reset_waveform();
 	reset_sound_plots();
@@ -466,6 +503,7 @@ void Settings::reset()
 	reset_intensity();
 	reset_mouse_tracking();
 	reset_concordance();
+	reset_memory();
 }
 
 void Settings::reset_waveform()
@@ -475,6 +513,8 @@ void Settings::reset_waveform()
 
 	map["magnitude"] = 1.0;
 	map["scaling"] = "local";
+	// Save waveform peaks in the metadata directory so that they don't need to be recomputed.
+	map["cache_peaks"] = true;
 
 	Settings::set_value("waveform", std::move(table));
 }
@@ -499,6 +539,12 @@ void Settings::reset_autosave()
 	Settings::set_value("autosave", false);
 }
 
+void Settings::reset_binary_annotations()
+{
+	// Save new annotations in the binary format rather than XML.
+	Settings::set_value("binary_annotations", false);
+}
+
 void Settings::reset_recent_views()
 {
 	auto &phon = cast<Module>((*runtime)[phon_key]);
@@ -531,9 +577,24 @@ void Settings::reset_concordance()
 	auto &map = table->data();
 	map["context_length"] = intptr_t(40);
 	map["discard_empty"] = true;
+	// Number of threads used to search annotations (0 means one per core).
+	map["query_threads"] = intptr_t(0);
 	Settings::set_value("concordance", std::move(table));
 }
 
+void Settings::reset_memory()
+{
+	auto table = make_handle<Table>(runtime);
+	auto &map = table->data();
+	// Maximum size (in MiB) of the decoded samples kept in memory for all open sounds.
+	map["sound_cache"] = intptr_t(512);
+	// Maximum size (in MiB) of the annotations kept in memory. Modified annotations are never unloaded.
+	map["document_cache"] = intptr_t(256);
+	// Maximum size (in MiB) of the power spectra kept in memory for spectrograms.
+	map["spectrum_cache"] = intptr_t(128);
+	Settings::set_value("memory", std::move(table));
+}
+
 void Settings::reset_mouse_tracking()
 {
 	Settings::set_value("enable_mouse_tracking", true);
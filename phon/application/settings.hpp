@@ -115,10 +115,14 @@ public:
 
     static void reset_autosave();
 
+    static void reset_binary_annotations();
+
     static void reset_recent_views();
 
     static void reset_concordance();
 
+    static void reset_memory();
+
     static void reset_geometry();
 
     static void reset_mouse_tracking();
@@ -19,7 +19,9 @@
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <set>
 #if PHON_WINDOWS
 #include <windows.h>
@@ -35,19 +37,12 @@
 #include <phon/analysis/speech_utils.hpp>
 #include <phon/third_party/swipe/swipe.h>
 #include <phon/utils/matrix.hpp>
-
-#if PHON_MACOS
-const int BUFFER_SIZE = 4096;
-#else
-const int BUFFER_SIZE = 2048;
-#endif
+#include <phon/utils/file_system.hpp>
 
 namespace phonometrica {
 
 Array<String> Sound::the_supported_sound_formats;
 Array<String> Sound::the_common_sound_formats;
-Signal<const String&, const String&, int> Sound::start_loading;
-Signal<int> Sound::update_loading;
 
 
 Sound::Sound(Directory *parent, String path) :
@@ -56,6 +51,12 @@ Sound::Sound(Directory *parent, String path) :
 
 }
 
+Sound::Sound(const Snapshot &snapshot) :
+		Document(meta::get_class<Sound>(), snapshot)
+{
+
+}
+
 void Sound::set_sound_formats()
 {
 	SF_FORMAT_INFO format_info;
@@ -96,62 +97,14 @@ const Array<String> &Sound::common_sound_formats()
 
 void Sound::load()
 {
-	auto h = handle();
-	int nchannel = h.channels();
-	h.seek(0, SEEK_SET);
-	// Samples are rows and channels are columns. For instance, the 5th sample in the second channel is at (i=5, j=2).
-	m_data = Array<double>((intptr_t) h.frames(), (intptr_t) nchannel);
-	auto slice = size_t(this->channel_size() / 100);
-	auto msg = String::format("Reading file %s from disk...", this->label().data());
-	start_loading(msg, "Loading data", 100);
-	size_t accumulator = 0;
-	int counter = 1;
-
-	if (nchannel == 1)
-	{
-		auto ptr = m_data.begin();
-		auto end = m_data.end();
-
-		while (ptr < end)
-		{
-			auto count = m_handle.readf(ptr, BUFFER_SIZE);
-			ptr += count * m_handle.channels();
-			accumulator += count;
-			while (accumulator >= slice)
-			{
-				update_loading(counter++);
-				accumulator = accumulator - slice;
-			}
-		}
-	}
-	else
-	{
-		Array<double> buffer;
-		buffer.resize(BUFFER_SIZE * nchannel);
-		auto ptr = buffer.begin();
-		intptr_t count = 1; // dummy value to enter the loop
-		intptr_t ioffset = 0;
-
-		while (count != 0)
-		{
-			count = (intptr_t) h.readf(ptr, BUFFER_SIZE);
-			auto p = ptr;
-			for (intptr_t i = 1; i <= count; ++i)
-			{
-				for (intptr_t j = 1; j <= nchannel; j++) {
-					m_data(ioffset+i, j) = *p++;
-				}
-			}
-			ioffset += count;
-			accumulator += count;
-			while (accumulator >= slice)
-			{
-				update_loading(counter++);
-				accumulator -=  slice;
-			}
-		}
-	}
-	h.seek(0, SEEK_SET);
+	// Nothing is decoded here: blocks of samples are read from disk the first time they are accessed. The budget is
+	// refreshed every time a sound is opened so that changes in the settings are taken into account.
+	auto budget = intptr_t(Settings::get_int("memory", "sound_cache")) << 20;
+	SampleStore::set_budget(budget);
+	SpectrumCache::set_budget(intptr_t(Settings::get_int("memory", "spectrum_cache")) << 20);
+	m_samples = std::make_unique<SampleStore>(m_path);
+	m_spectra = std::make_unique<SpectrumCache>(this);
+	m_peaks.reset();
 }
 
 void Sound::write()
@@ -209,22 +162,29 @@ String Sound::libsndfile_version()
 
 double Sound::duration() const
 {
-    auto h = handle();
+    auto &h = sf_handle();
     return double(h.frames()) / h.samplerate();
 }
 
 int Sound::sample_rate() const
 {
-	return handle().samplerate();
+	return sf_handle().samplerate();
 }
 
 intptr_t Sound::nframes() const
 {
-	return handle().frames();
+	return sf_handle().frames();
 }
 
 SndfileHandle Sound::handle() const
 {
+	return sf_handle();
+}
+
+const SndfileHandle &Sound::sf_handle() const
+{
+	// SndfileHandle has a non-atomic reference count: the accessors used by analysis threads go through
+	// this reference and never copy the handle.
 	if (m_handle) {
 		return m_handle;
 	}
@@ -241,7 +201,7 @@ SndfileHandle Sound::handle() const
 
 int Sound::nchannel() const
 {
-    return handle().channels();
+    return sf_handle().channels();
 }
 
 void Sound::convert(const String &path, int sample_rate, Sound::Format fmt)
@@ -288,17 +248,29 @@ Array<double>
 Sound::get_formants(int channel, const Array<double> &times, int nformant, double nyquist_frequency, double window_size,
                     int lpc_order)
 {
+	int nframe_orig = int(ceil(window_size * 2 * this->sample_rate()));
+
+	for (auto time : times)
+	{
+		auto first_sample = this->time_to_frame(time) - nframe_orig / 2;
+
+		if (first_sample < 1) {
+			throw error("File '%': time point % is too close to the beginning of the file", path(), time);
+		}
+		if (first_sample + nframe_orig > this->channel_size()) {
+			throw error("File '%': time point % is too close to the end of the file", path(), time);
+		}
+	}
+
+	auto formants = measure_formants(channel, times, nformant, nyquist_frequency, window_size, lpc_order);
 	Array<double> result(nformant, 2, 0.0);
 
-	for (auto t : times)
+	for (intptr_t i = 1; i <= times.size(); i++)
 	{
-		auto tmp = get_formants(channel, t, nformant, nyquist_frequency, window_size, lpc_order);
-		for (intptr_t i = 1; i <= nformant; i++)
+		for (intptr_t j = 1; j <= nformant; j++)
 		{
-			for (intptr_t j = 1; j <= 2; j++)
-			{
-				result(i, j) += tmp(i, j);
-			}
+			result(j, 1) += formants(i, j);
+			result(j, 2) += formants(i, nformant + j);
 		}
 	}
 
@@ -313,6 +285,129 @@ Sound::get_formants(int channel, const Array<double> &times, int nformant, doubl
 	return result;
 }
 
+Array<double>
+Sound::measure_formants(int channel, const Array<double> &times, int nformant, double nyquist_frequency,
+                        double window_size, int lpc_order)
+{
+	auto ntime = times.size();
+	Array<double> result(ntime, 2 * nformant, std::nan(""));
+	if (ntime == 0) {
+		return result;
+	}
+
+	auto frames = get_formant_frames(channel, times, nyquist_frequency, window_size);
+	auto nframe = frames.nrow();
+	double Fs = nyquist_frequency * 2;
+	speech::LpcWorkspace ws;
+	std::vector<double> freqs(nformant), bw(nformant);
+
+	for (intptr_t i = 1; i <= ntime; i++)
+	{
+		auto frame = frames.data() + (i - 1) * nframe;
+		if (std::isnan(frame[0])) {
+			continue;
+		}
+		speech::estimate_formants(frame, nframe, Fs, lpc_order, nformant, ws, freqs.data(), bw.data());
+
+		for (intptr_t j = 1; j <= nformant; j++)
+		{
+			result(i, j) = freqs[j-1];
+			result(i, nformant + j) = bw[j-1];
+		}
+	}
+
+	return result;
+}
+
+Array<double>
+Sound::get_formant_frames(int channel, const Array<double> &times, double nyquist_frequency, double window_size)
+{
+	using namespace speech;
+
+	open();
+	window_size *= 2; // for the Gaussian window
+	double Fs = nyquist_frequency * 2;
+	auto sample_rate = this->sample_rate();
+	int nframe_orig = int(ceil(window_size * sample_rate));
+	// This is the size of a frame resampled on its own in get_formants().
+	auto nframe = (Fs == sample_rate) ? intptr_t(nframe_orig + 1) : intptr_t(double(nframe_orig + 1) * Fs / sample_rate);
+	auto ntime = times.size();
+	Array<double> frames(nframe, ntime, std::nan(""));
+	auto win = create_window(nframe, nframe, WindowType::Gaussian);
+
+	// Sort valid time points by position, as (first sample, index) pairs.
+	std::vector<std::pair<intptr_t, intptr_t>> points;
+
+	for (intptr_t i = 1; i <= ntime; i++)
+	{
+		auto first_sample = this->time_to_frame(times[i]) - nframe_orig / 2;
+
+		if (first_sample >= 1 && first_sample + nframe_orig <= this->channel_size()) {
+			points.emplace_back(first_sample, i);
+		}
+	}
+	std::sort(points.begin(), points.end());
+
+	std::unique_ptr<Resampler> resampler;
+	if (Fs != sample_rate) {
+		resampler = std::make_unique<Resampler>(sample_rate, Fs, RESAMPLER_BUFFER_SIZE);
+	}
+	// Neighbouring points are read together, unless they are separated by a large gap or the region gets too long.
+	// The region is extended on each side so that the edge effects of the resampler don't affect the frames.
+	const intptr_t max_region = intptr_t(10 * sample_rate);
+	const intptr_t max_gap = 4 * nframe_orig;
+	const intptr_t margin = nframe_orig;
+	double ratio = Fs / sample_rate;
+	size_t i = 0;
+
+	while (i < points.size())
+	{
+		auto first = points[i].first;
+		auto last = first + nframe_orig;
+		size_t j = i + 1;
+
+		while (j < points.size() && points[j].first <= last + max_gap && points[j].first + nframe_orig - first <= max_region)
+		{
+			last = points[j++].first + nframe_orig;
+		}
+
+		auto region_first = (std::max<intptr_t>)(first - margin, 1);
+		auto region_last = (std::min<intptr_t>)(last + margin, this->channel_size());
+		auto input = get_channel(channel, region_first, region_last);
+		Array<double> tmp; // not needed if sampling rates are equal
+		std::span<double> output;
+
+		if (resampler)
+		{
+			tmp = resample(*resampler, input, sample_rate, Fs);
+			// Apply pre-emphasis from 50 Hz.
+			pre_emphasis(tmp, Fs, 50);
+			output = std::span<double>(tmp);
+		}
+		else
+		{
+			// Apply pre-emphasis from 50 Hz.
+			pre_emphasis(input, sample_rate, 50);
+			output = input;
+		}
+		auto size = intptr_t(output.size());
+
+		for (; i < j; i++)
+		{
+			auto pos = intptr_t(round((points[i].first - region_first) * ratio));
+			pos = (std::min)(pos, size - nframe);
+			auto src = output.data() + pos;
+			auto dst = frames.data() + (points[i].second - 1) * nframe;
+
+			for (intptr_t k = 0; k < nframe; k++) {
+				dst[k] = src[k] * win[k+1];
+			}
+		}
+	}
+
+	return frames;
+}
+
 Array<double>
 Sound::get_formants(int channel, double time, int nformant, double nyquist_frequency, double window_size, int lpc_order)
 {
@@ -363,38 +458,14 @@ Sound::get_formants(int channel, double time, int nformant, double nyquist_frequ
 		buffer[j] = *it++ * win[j];
 	}
 
-	auto coeffs = get_lpc_coefficients(buffer, lpc_order);
-	std::vector<double> freqs, bw;
-	bool ok = speech::get_formants(coeffs, Fs, freqs, bw);
+	LpcWorkspace ws;
+	std::vector<double> freqs(nformant), bw(nformant);
+	estimate_formants(buffer.data(), nframe, Fs, lpc_order, nformant, ws, freqs.data(), bw.data());
 
-	if (!ok)
+	for (int i = 1; i <= nformant; i++)
 	{
-		for (int i = 1; i <= nformant; i++)
-		{
-			result(i, 1) = std::nan("");
-			result(i, 2) = std::nan("");
-		}
-
-		return result;
-	}
-
-	int count = 0;
-	const double lowest_freq = 50.0;
-	const double highest_freq = Fs / 2 - lowest_freq;
-	for (size_t k = 0; k < freqs.size(); k++)
-	{
-		auto freq = freqs[k];
-		if (freq > 50 && freq < highest_freq)
-		{
-			result(++count, 1) = freq;
-			result(count, 2) = bw[k];
-		}
-		if (count == nformant) break;
-	}
-	for (int k = count+1; k <= nformant; k++)
-	{
-		result(k, 1) = std::nan("");
-		result(k, 2) = std::nan("");
+		result(i, 1) = freqs[i-1];
+		result(i, 2) = bw[i-1];
 	}
 
 	return result;
@@ -571,6 +642,47 @@ void Sound::initialize(Runtime &rt)
 		return sound.get_formants(channel, time, nformant, nyquist, win_size, lpc_order);
 	};
 
+	// Time points can be given as a vector, or as an n x 2 matrix of intervals which are measured at their midpoint.
+	auto get_time_points = [](const Array<double> &times) -> Array<double> {
+		if (times.ndim() == 2 && times.ncol() == 2)
+		{
+			Array<double> result(times.nrow(), 0.0);
+			for (intptr_t i = 1; i <= times.nrow(); i++) {
+				result[i] = (times(i, 1) + times(i, 2)) / 2;
+			}
+			return result;
+		}
+		if (times.ndim() == 2 && times.ncol() != 1) {
+			throw error("Time points must be a vector or a matrix with 2 columns");
+		}
+		return times;
+	};
+
+	auto get_formants3 = [=](Runtime &rt, std::span<Variant> args) -> Variant {
+		auto &sound = cast<Sound>(args[0]);
+		auto channel = (int) args[1].resolve().get_number();
+		auto times = get_time_points(cast<Array<double>>(args[2]));
+		String category("formants");
+		intptr_t nformant = Settings::get_number(category, "number_of_formants");
+		double nyquist = Settings::get_number(category, "max_frequency");
+		double win_size = Settings::get_number(category, "window_size");
+		intptr_t lpc_order = Settings::get_number(category, "lpc_order");
+		sound.open();
+		return sound.measure_formants(channel, times, nformant, nyquist, win_size, lpc_order);
+	};
+
+	auto get_formants4 = [=](Runtime &, std::span<Variant> args) -> Variant {
+		auto &sound = cast<Sound>(args[0]);
+		auto channel = (int) args[1].resolve().get_number();
+		auto times = get_time_points(cast<Array<double>>(args[2]));
+		intptr_t nformant = cast<intptr_t>(args[3]);
+		double nyquist = args[4].resolve().get_number();
+		double win_size = args[5].resolve().get_number();
+		intptr_t lpc_order = cast<intptr_t>(args[6]);
+		sound.open();
+		return sound.measure_formants(channel, times, nformant, nyquist, win_size, lpc_order);
+	};
+
 	auto hz2bark1 = [](Runtime &, std::span<Variant> args) -> Variant {
 		return speech::hertz_to_bark(args[0].resolve().get_number());
 	};
@@ -682,6 +794,8 @@ void Sound::initialize(Runtime &rt)
 	rt.add_global("get_pitch", get_pitch3, {CLS(Sound), CLS(Number), CLS(Number), CLS(Number), CLS(Number) });
 	rt.add_global("get_formants", get_formants1, {CLS(Sound), CLS(intptr_t), CLS(Number) });
 	rt.add_global("get_formants", get_formants2, {CLS(Sound), CLS(intptr_t), CLS(Number), CLS(intptr_t), CLS(Number), CLS(Number), CLS(intptr_t) });
+	rt.add_global("get_formants", get_formants3, {CLS(Sound), CLS(intptr_t), CLS(Array<double>) });
+	rt.add_global("get_formants", get_formants4, {CLS(Sound), CLS(intptr_t), CLS(Array<double>), CLS(intptr_t), CLS(Number), CLS(Number), CLS(intptr_t) });
 	rt.add_global("get_intensity", get_intensity, {CLS(Sound), CLS(intptr_t), CLS(Number) });
 	rt.add_global("hertz_to_bark", hz2bark1, {CLS(Number) });
 	rt.add_global("hertz_to_bark", hz2bark2, {CLS(Array<double>) });
@@ -708,22 +822,142 @@ void Sound::initialize(Runtime &rt)
 
 double Sound::max_value() const
 {
-	return *std::max_element(m_data.begin(), m_data.end());
+	double min_value, max_value;
+	get_extrema(min_value, max_value);
+
+	return max_value;
 }
 
 double Sound::min_value() const
 {
-	return *std::min_element(m_data.begin(), m_data.end());
+	double min_value, max_value;
+	get_extrema(min_value, max_value);
+
+	return min_value;
+}
+
+void Sound::get_extrema(double &min_value, double &max_value) const
+{
+	min_value = (std::numeric_limits<double>::max)();
+	max_value = std::numeric_limits<double>::lowest();
+
+	for (int channel = 1; channel <= nchannel(); channel++)
+	{
+		auto peaks = get_peaks(channel, 1, channel_size());
+		min_value = std::min(min_value, peaks.first);
+		max_value = std::max(max_value, peaks.second);
+	}
+}
+
+std::pair<double, double> Sound::get_peaks(int channel, intptr_t first, intptr_t last) const
+{
+	assert(first >= 1 && first <= last && last <= channel_size());
+	constexpr auto bin_size = PeakPyramid::BIN_SIZE;
+	auto &pyramid = peaks();
+	double min_value = (std::numeric_limits<double>::max)();
+	double max_value = std::numeric_limits<double>::lowest();
+	std::vector<double> buffer;
+
+	auto scan = [&](intptr_t from, intptr_t to) {
+		if (from > to) return;
+		buffer.resize(size_t(to - from + 1));
+		m_samples->read(channel, from, to, buffer.data());
+		auto result = std::minmax_element(buffer.begin(), buffer.end());
+		min_value = std::min(min_value, *result.first);
+		max_value = std::max(max_value, *result.second);
+	};
+
+	// Bin b covers frames b * bin_size + 1 to (b + 1) * bin_size. Bins that are entirely within the range are read
+	// from the pyramid, and the frames at each end of the range are read from the file.
+	auto first_bin = (first - 1 + bin_size - 1) / bin_size;
+	auto last_bin = last / bin_size; // past the end
+
+	if (first_bin >= last_bin)
+	{
+		scan(first, last);
+	}
+	else
+	{
+		scan(first, first_bin * bin_size);
+		pyramid.get(channel, first_bin, last_bin, min_value, max_value);
+		scan(last_bin * bin_size + 1, last);
+	}
+
+	return { min_value, max_value };
 }
 
-const Array<double> &Sound::data() const
+const PeakPyramid &Sound::peaks() const
 {
-	return m_data;
+	if (m_peaks) {
+		return *m_peaks;
+	}
+
+	auto peaks = std::make_unique<PeakPyramid>();
+	bool persist = Settings::get_boolean("waveform", "cache_peaks");
+	auto stamp = filesystem::last_modified(m_path);
+	String cache_path;
+
+	if (persist) {
+		cache_path = peak_cache_path();
+	}
+
+	if (!persist || !peaks->load(cache_path, m_path, stamp, nframes(), nchannel()))
+	{
+		// Use a separate handle: the main handle is shared with the audio player.
+#if PHON_WINDOWS
+		auto wpath = m_path.to_wide();
+		SndfileHandle h(wpath.data());
+#else
+		SndfileHandle h(m_path.data());
+#endif
+		auto nframe = std::max<intptr_t>(nframes(), 1);
+		auto msg = String::format("Computing waveform of %s...", label().data());
+		request_progress(msg, "Loading data", 100);
+		int percent = 0;
+
+		peaks->build(h, [&](intptr_t count) {
+			auto value = int(count * 100 / nframe);
+			if (value > percent) {
+				update_progress(percent = value);
+			}
+		});
+		if (percent < 100) {
+			update_progress(100);
+		}
+
+		if (persist)
+		{
+			// Peaks are only cached to speed up loading, so failing to save them is not an error.
+			try
+			{
+				peaks->save(cache_path, m_path, stamp);
+			}
+			catch (std::exception &)
+			{ }
+		}
+	}
+	m_peaks = std::move(peaks);
+
+	return *m_peaks;
 }
 
-Array<double> &Sound::data()
+String Sound::peak_cache_path() const
 {
-	return m_data;
+	// Peaks are stored in the metadata directory, since the sound's directory may not be writable. The file name is a
+	// hash of the sound's path (FNV-1a), and the path is stored in the file to detect collisions.
+	uint64_t hash = 14695981039346656037ULL;
+	for (intptr_t i = 0; i < m_path.size(); i++)
+	{
+		hash ^= uint8_t(m_path.data()[i]);
+		hash *= 1099511628211ULL;
+	}
+
+	auto dir = filesystem::join(Settings::metadata_directory(), "Peaks");
+	if (!filesystem::exists(dir)) {
+		filesystem::create_directory(dir);
+	}
+
+	return filesystem::join(dir, String::format("%016llx.peaks", (unsigned long long) hash));
 }
 
 intptr_t Sound::channel_size() const
@@ -752,50 +986,12 @@ bool Sound::is_mono() const
 	return nchannel() == 1;
 }
 
-std::span<const double> Sound::get_channel_view(int n) const
-{
-	assert(n <= nchannel());
-	auto start = m_data.data() + (n-1) * channel_size();
-
-	return { start, start + channel_size() };
-}
-
 Array<double> Sound::get_channel(int n, intptr_t first_sample, intptr_t last_sample) const
 {
 	assert(first_sample >= 1 && first_sample <= channel_size());
 	assert(last_sample > first_sample && last_sample <= channel_size());
-
-	if (n == 0)
-	{
-		return average_channels(first_sample, last_sample);
-	}
-	else
-	{
-		auto data = get_channel_view(n);
-		auto start = data.data() + first_sample - 1;
-		auto end = data.data() + last_sample;
-
-		return Array<double>(start, end);
-	}
-}
-
-Array<double> Sound::average_channels(intptr_t first_frame, intptr_t last_frame) const
-{
-	if (last_frame < 0) last_frame = (intptr_t) m_handle.frames() - 1;
-	assert(first_frame >= 0);
-	auto len = intptr_t(last_frame - first_frame + 1);
-	Array<double> result(len, 0.0);
-	auto nchannel = this->nchannel();
-	auto ptr = result.data();
-
-	for (intptr_t i = first_frame+1; i <= last_frame; i++)
-	{
-		double value = 0.0;
-		for (intptr_t j = 1; j <= nchannel; j++) {
-			value += m_data(i, j);
-		}
-		*ptr++ = value / nchannel;
-	}
+	Array<double> result(last_sample - first_sample + 1, 0.0);
+	m_samples->read(n, first_sample, last_sample, result.data());
 
 	return result;
 }
@@ -803,18 +999,7 @@ Array<double> Sound::average_channels(intptr_t first_frame, intptr_t last_frame)
 double Sound::get_sample(int channel, intptr_t index) const
 {
 	assert(index >= 1 && index <= channel_size());
-
-	if (channel == 0)
-	{
-		double value = 0.0;
-		for (intptr_t j = 1; j <= nchannel(); ++j) {
-			value += m_data(index, j);
-		}
-
-		return value / nchannel();
-	}
-
-	return m_data(index, channel);
+	return m_samples->get(channel, index);
 }
 
 } // namespace phonometrica
\ No newline at end of file
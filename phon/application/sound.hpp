@@ -31,6 +31,9 @@
 #include <memory>
 
 #include <phon/application/vfs.hpp>
+#include <phon/application/sample_store.hpp>
+#include <phon/application/peak_pyramid.hpp>
+#include <phon/application/spectrum_cache.hpp>
 #include <phon/third_party/rtaudio/RtAudio.h>
 #include <phon/utils/matrix.hpp>
 #include <sndfile.hh>
@@ -59,6 +62,9 @@ public:
 
 	Sound(Directory *parent, String path);
 
+	// Create a detached copy of a sound.
+	explicit Sound(const Snapshot &snapshot);
+
 	static void set_sound_formats();
 
 	static const Array<String> &supported_sound_formats();
@@ -83,9 +89,7 @@ public:
 
 	double min_value() const;
 
-    const Array<double> &data() const;
-
-    Array<double> &data();
+	void get_extrema(double &min_value, double &max_value) const;
 
     SndfileHandle handle() const;
 
@@ -101,8 +105,20 @@ public:
 
 	Array<double> get_formants(int channel, double time, int nformant, double nyquist_frequency, double window_size, int lpc_order);
 
+	// Average formants over several time points.
 	Array<double> get_formants(int channel, const Array<double> &times, int nformant, double nyquist_frequency, double window_size, int lpc_order);
 
+	// Formants at each time point, as an (ntime, 2 * nformant) matrix: row i contains F1...Fn followed by B1...Bn at
+	// time i. Values are the same as with get_formants(), but see get_formant_frames(). Time points which are too close
+	// to the edges of the file are undefined.
+	Array<double> measure_formants(int channel, const Array<double> &times, int nformant, double nyquist_frequency, double window_size, int lpc_order);
+
+	// Analysis frames used for formant estimation at each time point. The sound is read, resampled at twice the Nyquist
+	// frequency and pre-emphasised once for each group of neighbouring points (rather than once per point), and all the
+	// frames are multiplied by the same Gaussian window. Frame i is stored in column i, and is filled with NaNs if it
+	// doesn't fit in the file.
+	Array<double> get_formant_frames(int channel, const Array<double> &times, double nyquist_frequency, double window_size);
+
 	static void initialize(Runtime &rt);
 
 	intptr_t channel_size() const;
@@ -119,6 +135,13 @@ public:
 
 	double get_sample(int channel, intptr_t index) const;
 
+	// Minimum and maximum values in frames first to last (1-based, inclusive) of a channel (0 is the average of all
+	// the channels). The peaks of the whole file are computed the first time this function is called.
+	std::pair<double, double> get_peaks(int channel, intptr_t first, intptr_t last) const;
+
+	// Power spectra used by spectrograms. They are computed on demand and shared by all the views of the sound.
+	SpectrumCache &spectra() const { return *m_spectra; }
+
 	constexpr double get_intensity_window_duration() const
 	{
 		// Praat's settings: use 3.2 pitch periods
@@ -130,23 +153,27 @@ public:
 
 	int get_intensity_window_size() const;
 
-	static Signal<const String&, const String&, int> start_loading;
-
-	static Signal<int> update_loading;
-
 private:
 
 	void load() override;
 
 	void write() override;
 
-	Array<double> average_channels(intptr_t first_frame = 0, intptr_t last_frame = -1) const;
+	const PeakPyramid &peaks() const;
+
+	String peak_cache_path() const;
 
-	std::span<const double> get_channel_view(int n) const;
+	const SndfileHandle &sf_handle() const;
 
 	static Array<String> the_supported_sound_formats, the_common_sound_formats;
 
-	Array<double> m_data;
+	// Samples are decoded lazily and shared with the other sounds' budget.
+	std::unique_ptr<SampleStore> m_samples;
+
+	// Power spectra shared by all the spectrograms of this sound.
+	std::unique_ptr<SpectrumCache> m_spectra;
+
+	mutable std::unique_ptr<PeakPyramid> m_peaks;
 
 	mutable SndfileHandle m_handle;
 };
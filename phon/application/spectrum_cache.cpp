@@ -0,0 +1,225 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <phon/application/spectrum_cache.hpp>
+#include <phon/application/sound.hpp>
+
+namespace phonometrica {
+
+static std::mutex cache_mutex;
+static intptr_t cache_budget = intptr_t(128) << 20;
+static intptr_t cache_size = 0;
+
+static intptr_t tile_size(const SpectrumCache::Tile &tile)
+{
+	return intptr_t(tile.power.size() * sizeof(float));
+}
+
+
+bool SpectrumCache::Parameters::operator==(const Parameters &other) const
+{
+	return channel == other.channel && window_size == other.window_size && nfft == other.nfft &&
+	       window_type == other.window_type && preemphasis == other.preemphasis && hop == other.hop;
+}
+
+SpectrumCache::SpectrumCache(const Sound *sound) : m_sound(sound)
+{
+
+}
+
+SpectrumCache::~SpectrumCache()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	for (auto &grid : m_grids)
+	{
+		for (auto &item : grid.tiles)
+		{
+			auto it = item.second;
+			cache_size -= tile_size(*it->tile);
+			tiles().erase(it);
+		}
+	}
+}
+
+SpectrumCache::TileList &SpectrumCache::tiles()
+{
+	// See SampleStore::blocks().
+	static auto list = new TileList;
+	return *list;
+}
+
+intptr_t SpectrumCache::budget()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return cache_budget;
+}
+
+void SpectrumCache::set_budget(intptr_t bytes)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	cache_budget = bytes;
+
+	// Tiles are shared pointers, so the most recently used tile can be evicted safely.
+	while (cache_size > cache_budget && !tiles().empty()) {
+		evict(std::prev(tiles().end()));
+	}
+}
+
+intptr_t SpectrumCache::resident_size()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return cache_size;
+}
+
+void SpectrumCache::evict(const TileList::iterator &it)
+{
+	cache_size -= tile_size(*it->tile);
+	it->grid->tiles.erase(it->index);
+	tiles().erase(it);
+}
+
+SpectrumCache::Grid &SpectrumCache::get_grid(const Parameters &params)
+{
+	// The caller must hold the cache lock. There are only a few grids per sound (one per channel and zoom level).
+	for (auto &grid : m_grids)
+	{
+		if (grid.params == params) {
+			return grid;
+		}
+	}
+	m_grids.push_back(Grid{params, {}});
+
+	return m_grids.back();
+}
+
+intptr_t SpectrumCache::frame_count(const Parameters &params) const
+{
+	auto nframes = m_sound->channel_size();
+	if (nframes < params.window_size) {
+		return 0;
+	}
+
+	return (nframes - params.window_size) / params.hop + 1;
+}
+
+std::shared_ptr<const SpectrumCache::Tile> SpectrumCache::get_tile(const Parameters &params, intptr_t k)
+{
+	assert(k >= 0 && k < frame_count(params));
+	auto index = k / TILE_SIZE;
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		auto &grid = get_grid(params);
+		auto found = grid.tiles.find(index);
+
+		if (found != grid.tiles.end())
+		{
+			auto it = found->second;
+			tiles().splice(tiles().begin(), tiles(), it);
+			return it->tile;
+		}
+	}
+
+	// Another thread may compute the same tile concurrently, in which case the first result is kept.
+	auto tile = compute_tile(params, index);
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	auto &grid = get_grid(params);
+	auto found = grid.tiles.find(index);
+
+	if (found != grid.tiles.end()) {
+		return found->second->tile;
+	}
+	tiles().push_front(Entry{&grid, index, tile});
+	grid.tiles[index] = tiles().begin();
+	cache_size += tile_size(*tile);
+
+	while (cache_size > cache_budget && !tiles().empty()) {
+		evict(std::prev(tiles().end()));
+	}
+
+	return tile;
+}
+
+std::shared_ptr<const SpectrumCache::Tile> SpectrumCache::compute_tile(const Parameters &params, intptr_t index) const
+{
+	using namespace speech;
+
+	auto tile = std::make_shared<Tile>();
+	auto first_frame = index * TILE_SIZE;
+	auto nframe = (std::min)(TILE_SIZE, frame_count(params) - first_frame);
+	auto nfft = params.nfft;
+	int nbin = nfft / 2;
+	tile->first_frame = first_frame;
+	tile->nframe = nframe;
+	tile->nbin = nbin;
+	tile->power.resize(size_t(nframe * nbin));
+
+	auto sample_rate = m_sound->sample_rate();
+	auto window_size = params.window_size;
+	auto window = create_window(window_size, nfft, params.window_type);
+
+	// Weight power.
+	double weight = 0;
+	for (double x : window) weight += x * x;
+	double k1 = 1 / (sample_rate * weight); // at DC and Nyquist frequencies.
+	double k2 = 2 / (sample_rate * weight); // at other frequencies
+
+	FFT fft(nfft);
+	Array<double> input(nfft, 0.0);
+	auto power = tile->power.data();
+
+	for (intptr_t k = first_frame; k < first_frame + nframe; k++)
+	{
+		// Read one more sample before the frame (if possible) so that pre-emphasis gives the same result as if it
+		// had been applied to the whole sound.
+		auto first_sample = k * params.hop + 1; // 1-based
+		auto from = (std::max<intptr_t>)(first_sample - 1, 1);
+		auto data = m_sound->get_channel(params.channel, from, first_sample + window_size - 1);
+		pre_emphasis(data, sample_rate, params.preemphasis);
+		auto sample = data.data() + (first_sample - from);
+		auto buffer = input.data();
+
+		for (intptr_t j = 0; j < window_size; j++) {
+			buffer[j] = sample[j] * window[j + 1];
+		}
+		for (intptr_t j = window_size; j < nfft; j++) {
+			buffer[j] = 0.0;
+		}
+		auto output = fft.process(input).data();
+
+		for (int y = 0; y < nbin; y++)
+		{
+			double a = output[y].real() * output[y].real() + output[y].imag() * output[y].imag();
+			double c = (y == 0 || y == nbin - 1) ? k1 : k2;
+			a = c * a / nfft;
+			constexpr double Iref = 4.0e-10;
+			// Intensity is undefined if the raw amplitude is equal to 0.
+			*power++ = float(10 * log10(a / Iref));
+		}
+	}
+
+	return tile;
+}
+
+} // namespace phonometrica
@@ -0,0 +1,144 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: cache of short-time power spectra for spectrograms.                                                        *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_SPECTRUM_CACHE_HPP
+#define PHONOMETRICA_SPECTRUM_CACHE_HPP
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <phon/analysis/signal_processing.hpp>
+
+namespace phonometrica {
+
+class Sound;
+
+
+// A SpectrumCache holds the power spectra of a sound, computed on a regular grid of analysis frames: frame k starts at
+// sample k * hop (0-based). Frames are computed lazily in tiles of TILE_SIZE consecutive frames, and tiles are kept in
+// a cache shared by all the sounds: when their total size exceeds the budget, the least recently used tiles are
+// discarded. Since the grid only depends on the analysis parameters, all the views of a sound share the same tiles,
+// and a view only needs to compute the tiles that it hasn't seen yet when it is scrolled.
+// All the methods are thread-safe. Tiles are computed without holding the cache lock.
+class SpectrumCache final
+{
+public:
+
+	// Number of frames per tile.
+	static constexpr intptr_t TILE_SIZE = 64;
+
+	struct Parameters
+	{
+		// Channel analyzed (0 is the average of all channels).
+		int channel;
+
+		// Number of samples in an analysis window.
+		intptr_t window_size;
+
+		int nfft;
+
+		speech::WindowType window_type;
+
+		// Pre-emphasis threshold, in Hz.
+		double preemphasis;
+
+		// Number of samples between the start of two consecutive frames.
+		intptr_t hop;
+
+		bool operator==(const Parameters &other) const;
+	};
+
+	struct Tile
+	{
+		// Index of the first frame in the tile.
+		intptr_t first_frame;
+
+		// Number of frames in the tile. It may be less than TILE_SIZE at the end of the sound.
+		intptr_t nframe;
+
+		// Number of frequency bins per frame (nfft / 2).
+		int nbin;
+
+		// Power (in dB) of each bin, frame by frame.
+		std::vector<float> power;
+
+		const float *frame(intptr_t k) const { return power.data() + (k - first_frame) * nbin; }
+	};
+
+	explicit SpectrumCache(const Sound *sound);
+
+	SpectrumCache(const SpectrumCache &) = delete;
+
+	SpectrumCache &operator=(const SpectrumCache &) = delete;
+
+	~SpectrumCache();
+
+	// Number of frames that fit entirely in the sound.
+	intptr_t frame_count(const Parameters &params) const;
+
+	// Get the tile containing frame k, computing it if necessary. The tile remains valid after it is evicted.
+	std::shared_ptr<const Tile> get_tile(const Parameters &params, intptr_t k);
+
+	// Maximum number of bytes used by cached tiles.
+	static intptr_t budget();
+
+	static void set_budget(intptr_t bytes);
+
+	// Number of bytes currently used by cached tiles.
+	static intptr_t resident_size();
+
+private:
+
+	struct Grid;
+
+	struct Entry
+	{
+		Grid *grid;
+		intptr_t index;
+		std::shared_ptr<const Tile> tile;
+	};
+
+	using TileList = std::list<Entry>;
+
+	// Tiles computed with a given set of parameters.
+	struct Grid
+	{
+		Parameters params;
+		std::unordered_map<intptr_t, TileList::iterator> tiles;
+	};
+
+	std::shared_ptr<const Tile> compute_tile(const Parameters &params, intptr_t index) const;
+
+	Grid &get_grid(const Parameters &params);
+
+	static void evict(const TileList::iterator &it);
+
+	static TileList &tiles();
+
+	const Sound *m_sound;
+
+	std::list<Grid> m_grids;
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_SPECTRUM_CACHE_HPP
@@ -0,0 +1,289 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <set>
+#include <cstring>
+#include <phon/application/text_index.hpp>
+#include <phon/application/annotation.hpp>
+#include <phon/utils/file_system.hpp>
+
+namespace phonometrica {
+
+// Minimum number of code points in a target for a "contains" lookup.
+static const intptr_t NGRAM_SIZE = 3;
+
+TextIndex::TextIndex(const String &path) : Database(path)
+{
+	create_tables();
+	select_stamp = prepare("SELECT stamp, size FROM documents WHERE path = ?1;");
+	select_document = prepare("SELECT id FROM documents WHERE path = ?1;");
+	insert_document = prepare("INSERT INTO documents (path, stamp, size) VALUES (?1, ?2, ?3);");
+	update_document = prepare("UPDATE documents SET stamp = ?2, size = ?3 WHERE id = ?1;");
+	delete_postings = prepare("DELETE FROM postings WHERE document = ?1;");
+	insert_posting = prepare("INSERT INTO postings (term, document, layer, event) VALUES (?1, ?2, ?3, ?4);");
+}
+
+TextIndex::~TextIndex()
+{
+	// Statements must be finalized before the connection is closed by the base class.
+	for (auto stmt : { select_stamp, select_document, insert_document, update_document, delete_postings, insert_posting }) {
+		sqlite3_finalize(stmt);
+	}
+}
+
+void TextIndex::create_tables()
+{
+	// Older indexes only stored the modification time in seconds, which misses files saved again within the same
+	// second. The index can be rebuilt from the annotations, so we simply discard it.
+	auto stmt = prepare("PRAGMA table_info(documents);");
+	bool has_table = false, has_size = false;
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		has_table = true;
+		auto name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+		if (name && strcmp(name, "size") == 0) has_size = true;
+	}
+	sqlite3_finalize(stmt);
+
+	if (has_table && !has_size) {
+		execute("DROP TABLE IF EXISTS postings; DROP TABLE IF EXISTS documents;");
+	}
+
+	// Terms are either a whole event label prefixed with '=', or a trigram prefixed with '#'. Both are lower-cased.
+	execute(R"__(CREATE TABLE IF NOT EXISTS documents (id INTEGER PRIMARY KEY, path TEXT UNIQUE NOT NULL, stamp INTEGER NOT NULL, size INTEGER NOT NULL);
+CREATE TABLE IF NOT EXISTS postings (term TEXT NOT NULL, document INTEGER NOT NULL, layer INTEGER NOT NULL, event INTEGER NOT NULL);
+CREATE INDEX IF NOT EXISTS postings_term ON postings (term);
+CREATE INDEX IF NOT EXISTS postings_document ON postings (document);)__");
+}
+
+bool TextIndex::is_current(const Annotation &annot)
+{
+	if (annot.loaded() && annot.content_modified()) {
+		return false;
+	}
+	auto &path = annot.path();
+	int64_t stamp, size;
+	bool current = false;
+
+	if (filesystem::get_file_stamp(path, stamp, size))
+	{
+		sqlite3_bind_text(select_stamp, 1, path.data(), int(path.size()), SQLITE_STATIC);
+		if (sqlite3_step(select_stamp) == SQLITE_ROW) {
+			current = (sqlite3_column_int64(select_stamp, 0) == stamp && sqlite3_column_int64(select_stamp, 1) == size);
+		}
+		sqlite3_reset(select_stamp);
+	}
+
+	return current;
+}
+
+void TextIndex::update(const Annotation &annot)
+{
+	auto &path = annot.path();
+	int64_t stamp, size;
+
+	// Annotations that have never been saved can't be indexed.
+	if (!filesystem::get_file_stamp(path, stamp, size)) {
+		return;
+	}
+
+	execute("SAVEPOINT text_index;");
+
+	try
+	{
+		sqlite3_int64 id;
+		sqlite3_bind_text(select_document, 1, path.data(), int(path.size()), SQLITE_STATIC);
+
+		if (sqlite3_step(select_document) == SQLITE_ROW)
+		{
+			id = sqlite3_column_int64(select_document, 0);
+			sqlite3_reset(select_document);
+
+			sqlite3_bind_int64(delete_postings, 1, id);
+			run(delete_postings);
+			sqlite3_bind_int64(update_document, 1, id);
+			sqlite3_bind_int64(update_document, 2, stamp);
+			sqlite3_bind_int64(update_document, 3, size);
+			run(update_document);
+		}
+		else
+		{
+			sqlite3_reset(select_document);
+			sqlite3_bind_text(insert_document, 1, path.data(), int(path.size()), SQLITE_STATIC);
+			sqlite3_bind_int64(insert_document, 2, stamp);
+			sqlite3_bind_int64(insert_document, 3, size);
+			run(insert_document);
+			id = sqlite3_last_insert_rowid(db);
+		}
+
+		auto add_term = [&](const String &term, intptr_t layer, intptr_t event) {
+			sqlite3_bind_text(insert_posting, 1, term.data(), int(term.size()), SQLITE_STATIC);
+			sqlite3_bind_int64(insert_posting, 2, id);
+			sqlite3_bind_int64(insert_posting, 3, layer);
+			sqlite3_bind_int64(insert_posting, 4, event);
+			run(insert_posting);
+		};
+
+		for (intptr_t i = 1; i <= annot.layer_count(); i++)
+		{
+			auto &events = annot.get_layer_events(i);
+
+			for (intptr_t j = 1; j <= events.size(); j++)
+			{
+				auto &text = events[j]->text();
+				add_term(get_label_term(text), i, j);
+
+				for (auto &gram : get_trigrams(text)) {
+					add_term(gram, i, j);
+				}
+			}
+		}
+
+		execute("RELEASE text_index;");
+	}
+	catch (...)
+	{
+		execute("ROLLBACK TO text_index; RELEASE text_index;", false);
+		throw;
+	}
+}
+
+void TextIndex::remove(const String &path)
+{
+	for (auto sql : { "DELETE FROM postings WHERE document IN (SELECT id FROM documents WHERE path = ?1);",
+				   "DELETE FROM documents WHERE path = ?1;" })
+	{
+		auto stmt = prepare(sql);
+		sqlite3_bind_text(stmt, 1, path.data(), int(path.size()), SQLITE_STATIC);
+		int status = sqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+
+		if (status != SQLITE_DONE) {
+			throw std::runtime_error(utils::format("[SQL error] Could not remove % from the text index", path));
+		}
+	}
+}
+
+bool TextIndex::can_lookup(const Constraint &constraint)
+{
+	switch (constraint.op)
+	{
+		case Constraint::Operator::Equals:
+			return true;
+		case Constraint::Operator::Contains:
+			return String::utf8_length(constraint.target) >= NGRAM_SIZE;
+		default:
+			return false;
+	}
+}
+
+bool TextIndex::lookup(const Constraint &constraint, HitMap &hits)
+{
+	if (!can_lookup(constraint)) {
+		return false;
+	}
+
+	Array<String> terms;
+
+	if (constraint.op == Constraint::Operator::Equals) {
+		terms.append(get_label_term(constraint.target));
+	}
+	else {
+		terms = get_trigrams(constraint.target);
+	}
+
+	// An event is a candidate if it contains all the terms. Terms are case-folded, so the result is a superset of the
+	// matches for case-sensitive constraints too.
+	Array<String> params;
+	for (intptr_t i = 1; i <= terms.size(); i++) {
+		params.append("?");
+	}
+	auto sql = utils::format("SELECT d.path, p.layer, p.event FROM postings p JOIN documents d ON d.id = p.document "
+						  "WHERE p.term IN (%) GROUP BY p.document, p.layer, p.event HAVING COUNT(DISTINCT p.term) = % "
+						  "ORDER BY d.path, p.layer, p.event;", String::join(params, ", "), terms.size());
+	auto stmt = prepare(sql);
+
+	for (intptr_t i = 1; i <= terms.size(); i++) {
+		sqlite3_bind_text(stmt, int(i), terms[i].data(), int(terms[i].size()), SQLITE_STATIC);
+	}
+
+	int status;
+	while ((status = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		String path((const char*) sqlite3_column_text(stmt, 0));
+		auto layer = intptr_t(sqlite3_column_int64(stmt, 1));
+		auto event = intptr_t(sqlite3_column_int64(stmt, 2));
+		hits[path][layer].append(event);
+	}
+	sqlite3_finalize(stmt);
+
+	if (status != SQLITE_DONE)
+	{
+		hits.clear();
+		return false;
+	}
+
+	return true;
+}
+
+String TextIndex::get_label_term(const String &text)
+{
+	String term("=");
+	term.append(text.to_lower());
+
+	return term;
+}
+
+Array<String> TextIndex::get_trigrams(const String &text)
+{
+	auto lower = text.to_lower();
+	Array<intptr_t> offsets;
+
+	// Offsets of all code points, plus the end of the string.
+	for (intptr_t i = 0; i < lower.size(); i++)
+	{
+		if ((lower.data()[i] & 0xC0) != 0x80) {
+			offsets.append(i);
+		}
+	}
+	offsets.append(lower.size());
+
+	std::set<String> grams;
+
+	for (intptr_t i = 1; i + NGRAM_SIZE <= offsets.size(); i++)
+	{
+		auto from = offsets[i];
+		auto to = offsets[i + NGRAM_SIZE];
+		String gram("#");
+		gram.append(std::string_view(lower.data() + from, size_t(to - from)));
+		grams.insert(std::move(gram));
+	}
+
+	Array<String> result;
+	result.reserve(intptr_t(grams.size()));
+	for (auto &gram : grams) {
+		result.append(gram);
+	}
+
+	return result;
+}
+
+} // namespace phonometrica
@@ -0,0 +1,88 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: persistent inverted index over the text of annotation events. The index maps event labels and              *
+ * character trigrams to the events in which they occur, so that text queries only inspect candidate events and can    *
+ * skip annotations that have no candidate at all. The index is stored next to the metadata database.                  *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_TEXT_INDEX_HPP
+#define PHONOMETRICA_TEXT_INDEX_HPP
+
+#include <map>
+#include <phon/application/database.hpp>
+#include <phon/application/conc/constraint.hpp>
+
+namespace phonometrica {
+
+class Annotation;
+
+
+class TextIndex final : public Database
+{
+public:
+
+	// Candidate events in an annotation: maps a layer index to a sorted list of event indices.
+	using Hits = std::map<intptr_t, Array<intptr_t>>;
+
+	// Candidate events for each annotation, indexed by path.
+	using HitMap = std::map<String, Hits>;
+
+	explicit TextIndex(const String &path);
+
+	~TextIndex() override;
+
+	// Returns true if the annotation has been indexed and neither the file nor the loaded graph has changed since.
+	bool is_current(const Annotation &annot);
+
+	// (Re)index a loaded annotation.
+	void update(const Annotation &annot);
+
+	void remove(const String &path);
+
+	// Find candidate events for the constraint. Returns false if the constraint can't be resolved with the index, in
+	// which case all events must be scanned. Candidates are a superset of the actual matches: they only cover indexed
+	// annotations and must be checked against the constraint.
+	bool lookup(const Constraint &constraint, HitMap &hits);
+
+	static bool can_lookup(const Constraint &constraint);
+
+private:
+
+	void create_tables();
+
+	static Array<String> get_trigrams(const String &text);
+
+	static String get_label_term(const String &text);
+
+	sqlite3_stmt *select_stamp = nullptr;
+
+	sqlite3_stmt *select_document = nullptr;
+
+	sqlite3_stmt *insert_document = nullptr;
+
+	sqlite3_stmt *update_document = nullptr;
+
+	sqlite3_stmt *delete_postings = nullptr;
+
+	sqlite3_stmt *insert_posting = nullptr;
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_TEXT_INDEX_HPP
@@ -21,6 +21,8 @@
 
 #include <phon/application/vfs.hpp>
 #include <phon/application/project.hpp>
+#include <phon/application/document_cache.hpp>
+#include <phon/application/settings.hpp>
 #include <phon/runtime.hpp>
 #include <phon/utils/file_system.hpp>
 
@@ -310,6 +312,20 @@ Document::Document(Class *klass, Directory *parent, String path) :
 
 }
 
+Document::Document(Class *klass, const Snapshot &snapshot) :
+		Element(klass, nullptr), m_path(snapshot.path), m_properties(snapshot.properties),
+		m_description(snapshot.description), m_detached(true)
+{
+
+}
+
+Document::~Document()
+{
+	if (!m_detached) {
+		DocumentCache::remove(this);
+	}
+}
+
 String Document::label() const
 {
 	return m_path.empty() ? "Untitled" : filesystem::base_name(m_path);
@@ -339,11 +355,44 @@ void Document::open()
 		{
 			throw error("Cannot open file \"%\": %", this->path(), e.what());
 		}
+		// Detached documents are used by other threads and are not managed by the cache.
+		if (m_detached) return;
+		// Refresh the budget so that changes in the settings are taken into account.
+		DocumentCache::set_budget(intptr_t(Settings::get_int("memory", "document_cache")) << 20);
+	}
+
+	if (!m_detached) {
+		DocumentCache::touch(this);
 	}
 }
 
+bool Document::unload()
+{
+	if (!m_loaded || pinned() || modified() || !release_content()) {
+		return false;
+	}
+	m_loaded = false;
+	if (!m_detached) {
+		DocumentCache::remove(this);
+	}
+
+	return true;
+}
+
+intptr_t Document::memory_size() const
+{
+	return 0;
+}
+
+bool Document::release_content()
+{
+	return false;
+}
+
 void Document::save()
 {
+	check_writable();
+
 	try
 	{
 		if (!modified()) return;
@@ -608,6 +657,30 @@ void Document::reload()
 {
 	discard_changes();
 	load();
+
+	// The size of the content may have changed.
+	if (m_detached) return;
+	DocumentCache::remove(this);
+	if (m_loaded) {
+		DocumentCache::touch(this);
+	}
+}
+
+void Document::check_writable() const
+{
+	if (m_detached) {
+		throw error("File \"%\" is read-only in parallel tasks", m_path);
+	}
+}
+
+Document::Snapshot Document::snapshot() const
+{
+	Snapshot s;
+	s.path = m_path;
+	s.description = m_description;
+	s.properties = m_properties;
+
+	return s;
 }
 
 bool Document::quick_search(const String &text) const
@@ -632,6 +705,7 @@ void Document::initialize(Runtime &rt)
 	auto add_property = [](Runtime &, std::span<Variant> args) -> Variant  {
 		auto &doc = cast<Document>(args[0]);
 		auto &category = cast<String>(args[1]);
+		doc.check_writable();
 		std::any value;
 
 		if (check_type<String>(args[2])) {
@@ -654,6 +728,7 @@ void Document::initialize(Runtime &rt)
 	auto remove_property = [](Runtime &, std::span<Variant> args) -> Variant  {
 		auto &doc = cast<Document>(args[0]);
 		auto &category = cast<String>(args[1]);
+		doc.check_writable();
 		doc.remove_property(category);
 		return Variant();
 	};
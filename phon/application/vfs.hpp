@@ -26,6 +26,7 @@
 #ifndef PHONOMETRICA_VFS_HPP
 #define PHONOMETRICA_VFS_HPP
 
+#include <atomic>
 #include <vector>
 #include <phon/runtime/typed_object.hpp>
 #include <phon/runtime/class.hpp>
@@ -186,8 +187,21 @@ class Document : public Element
 {
 public:
 
+	// Data needed to copy a document to another thread (see TaskPool). The copy is detached: it doesn't belong to the
+	// project, it is not managed by the document cache and it is read-only.
+	struct Snapshot
+	{
+		String path;
+
+		String description;
+
+		std::set<Property> properties;
+	};
+
 	Document(Class *klass, Directory *parent, String path);
 
+	~Document() override;
+
 	String label() const override;
 
 	bool has_path() const;
@@ -204,6 +218,29 @@ public:
 
 	bool loaded() const;
 
+	// Release the document's content if it is loaded and not in use, so that it will be read again the next time the
+	// document is opened. Returns true if the content was released.
+	bool unload();
+
+	// Approximate number of bytes used by the document's content when it is loaded. Documents which report 0 are not
+	// managed by the document cache.
+	virtual intptr_t memory_size() const;
+
+	// Pinned documents are never unloaded. Pins are counted and can be released from any thread.
+	void pin() { ++m_pin_count; }
+
+	void unpin() { --m_pin_count; }
+
+	bool pinned() const { return m_pin_count > 0; }
+
+	bool detached() const { return m_detached; }
+
+	// Throw an error if the document is detached.
+	void check_writable() const;
+
+	// Must be called in the thread which owns the document.
+	Snapshot snapshot() const;
+
 	bool modified() const override;
 
 	void add_property(Property p, bool mutate = true);
@@ -230,6 +267,9 @@ public:
 
 	bool has_properties() const;
 
+	// True if the metadata are stored in the project's database and have not been modified since they were saved.
+	bool metadata_in_database() const { return uses_external_metadata() && !m_metadata_modified; }
+
 	Array<String> property_list() const;
 
 	bool quick_search(const String &text) const override;
@@ -243,10 +283,15 @@ public:
 
 protected:
 
+	Document(Class *klass, const Snapshot &snapshot);
+
 	virtual void load() = 0;
 
 	virtual void write() = 0;
 
+	// Free the content read by load(). Returns false if the content is still referenced and can't be released.
+	virtual bool release_content();
+
 	virtual void save_metadata();
 
 	virtual bool uses_external_metadata() const;
@@ -268,6 +313,10 @@ protected:
 	bool m_loaded = false;
 
 	bool m_metadata_modified = false;
+
+	bool m_detached = false;
+
+	std::atomic<int> m_pin_count = 0;
 };
 
 
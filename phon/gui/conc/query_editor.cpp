@@ -24,6 +24,7 @@
 #include <wx/scrolwin.h>
 #include <wx/stattext.h>
 #include <wx/button.h>
+#include <wx/progdlg.h>
 #include <phon/gui/conc/query_editor.hpp>
 #include <phon/gui/dialog.hpp>
 #include <phon/include/icons.hpp>
@@ -152,7 +153,21 @@ Handle<Concordance> QueryEditor::ExecuteQuery()
 		Project::updated();
 	}
 
-	return query->execute();
+	return query->execute(CreateProgress(nullptr));
+}
+
+Query::Progress QueryEditor::CreateProgress(wxWindow *parent)
+{
+	// The number of annotations is only known once the query has filtered them, so the dialog is created on the first
+	// update. It is destroyed along with the callback.
+	auto dialog = std::make_shared<std::unique_ptr<wxProgressDialog>>();
+
+	return [dialog, parent](int value, int count) -> bool {
+		if (!*dialog) {
+			*dialog = std::make_unique<wxProgressDialog>(_("Executing query"), _("Processing annotations..."), count, parent, wxPD_AUTO_HIDE|wxPD_APP_MODAL|wxPD_CAN_ABORT);
+		}
+		return (*dialog)->Update(value);
+	};
 }
 
 void QueryEditor::OnOpenHelp(wxCommandEvent &)
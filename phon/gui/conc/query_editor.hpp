@@ -43,6 +43,9 @@ public:
 
 	Handle<Concordance> ExecuteQuery();
 
+	// Progress callback which shows a modal progress dialog while a query is running.
+	static Query::Progress CreateProgress(wxWindow *parent);
+
 	virtual Handle<Query> GetQuery() const = 0;
 
 	virtual void LoadQuery() = 0;
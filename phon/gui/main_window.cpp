@@ -353,8 +353,6 @@ void MainWindow::SetBindings()
 	project->metadata_updated.connect(&ProjectManager::UpdateLabel, project_manager);
 	project->notify_error.connect(&MainWindow::OnError, this);
 	viewer->wake_up.connect(&MainWindow::OnWakeUp, this);
-	Sound::start_loading.connect(&MainWindow::OnRequestProgress, this);
-	Sound::update_loading.connect(&MainWindow::OnUpdateProgress, this);
 //	project->start_activity.connect(&ProjectManager::StartActivity, project_manager);
 //	project->stop_activity.connect(&ProjectManager::StopActivity, project_manager);
 
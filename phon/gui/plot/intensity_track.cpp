@@ -93,11 +93,20 @@ void IntensityTrack::DrawYAxis(PaintDC &dc, const wxRect &rect)
 
 void IntensityTrack::UpdateCache()
 {
-	DrawBitmap();
 	m_cached_size = GetSize();
+	auto win = m_window;
+	int width = GetWidth();
+
+	RunAnalysis<Analysis>([=](const Cancelled &) { return CalculateIntensity(win, width); },
+			[this](Analysis &result, const String &error) {
+		m_intensity = std::move(result.intensity);
+		m_start_at_zero = result.start_at_zero;
+		DrawBitmap(error);
+		Refresh();
+	});
 }
 
-void IntensityTrack::DrawBitmap()
+void IntensityTrack::DrawBitmap(const String &error)
 {
 	wxMemoryDC dc;
 	wxBitmap bmp(GetSize());
@@ -109,11 +118,8 @@ void IntensityTrack::DrawBitmap()
 	gc->SetPen(wxPen(*wxGREEN, 2));
 	wxGraphicsPath path = gc->CreatePath();
 
-	try
+	if (error.empty())
 	{
-		m_intensity.clear(); // in case CalculateIntensity() throws
-		m_intensity = CalculateIntensity();
-
 		double t = m_start_at_zero ? m_window.first : (m_window.first + time_step / 2);
 //		PHON_LOG("-------------------------------------\n");
 
@@ -131,9 +137,9 @@ void IntensityTrack::DrawBitmap()
 
 		gc->StrokePath(path);
 	}
-	catch (std::exception &e)
+	else
 	{
-		wxString msg = e.what();
+		wxString msg = error;
 		auto sz = dc.GetTextExtent(msg);
 		auto x = double(GetWidth()) / 2 - double(sz.x) / 2;
 		auto y = double(GetHeight()) / 2 - double(sz.y) / 2;
@@ -145,17 +151,22 @@ void IntensityTrack::DrawBitmap()
 	m_cached_bmp = bmp;
 }
 
-Array<double> IntensityTrack::CalculateIntensity()
+IntensityTrack::Analysis IntensityTrack::CalculateIntensity(TimeWindow win, int width) const
 {
+	auto window_duration = win.second - win.first;
+
 	// At least 2 measurements per window
-	if (GetWindowDuration() <= 2 * time_step) {
+	if (window_duration <= 2 * time_step) {
 		throw error("Zoom out to see intensity");
 	}
 	// At most 2 measurements per pixel
-	if (GetWindowDuration() / time_step > GetWidth() * 2) {
+	if (window_duration / time_step > width * 2) {
 		throw error("Zoom in to see intensity");
 	}
 
-    return m_sound->get_intensity(m_channel, m_window.first, m_window.second, time_step, m_start_at_zero);
+	Analysis result;
+	result.intensity = m_sound->get_intensity(m_channel, win.first, win.second, time_step, result.start_at_zero);
+
+	return result;
 }
 } // namespace phonometrica
@@ -42,9 +42,17 @@ private:
 
 	void OnMotion(wxMouseEvent &e) override;
 
-	void DrawBitmap();
+	// Intensity computed in the background for the current window.
+	struct Analysis
+	{
+		Array<double> intensity;
 
-	Array<double> CalculateIntensity();
+		bool start_at_zero = true;
+	};
+
+	void DrawBitmap(const String &error);
+
+	Analysis CalculateIntensity(TimeWindow win, int width) const;
 
     double IntensityToYPos(double dB) const;
 
@@ -64,8 +64,16 @@ void PitchTrack::DrawYAxis(PaintDC &dc, const wxRect &rect)
 
 void PitchTrack::UpdateCache()
 {
-	DrawBitmap();
 	m_cached_size = GetSize();
+	auto win = m_window;
+	int width = GetWidth();
+
+	RunAnalysis<std::vector<double>>([=](const Cancelled &) { return CalculatePitch(win, width); },
+			[this](std::vector<double> &pitch, const String &error) {
+		m_pitch = std::move(pitch);
+		DrawBitmap(error);
+		Refresh();
+	});
 }
 
 void PitchTrack::ReadSettings()
@@ -77,7 +85,7 @@ void PitchTrack::ReadSettings()
     voicing_threshold = Settings::get_number(category, "voicing_threshold");
 }
 
-void PitchTrack::DrawBitmap()
+void PitchTrack::DrawBitmap(const String &error)
 {
 	wxMemoryDC dc;
 	wxBitmap bmp(GetSize());
@@ -89,10 +97,8 @@ void PitchTrack::DrawBitmap()
 	gc->SetPen(wxPen(*wxBLUE, 2));
 	wxGraphicsPath path = gc->CreatePath();
 
-	try
+	if (error.empty())
 	{
-		m_pitch.clear(); // in case CalculatePitch() throws
-		m_pitch = CalculatePitch();
 		double t = m_window.first;
 		bool previous = false;
 
@@ -123,9 +129,9 @@ void PitchTrack::DrawBitmap()
 
 		gc->StrokePath(path);
 	}
-	catch (std::exception &e)
+	else
 	{
-		wxString msg = e.what();
+		wxString msg = error;
 		auto sz = dc.GetTextExtent(msg);
 		auto x = double(GetWidth()) / 2 - double(sz.x) / 2;
 		auto y = double(GetHeight()) / 2 - double(sz.y) / 2;
@@ -137,16 +143,18 @@ void PitchTrack::DrawBitmap()
 	m_cached_bmp = bmp;
 }
 
-std::vector<double> PitchTrack::CalculatePitch()
+std::vector<double> PitchTrack::CalculatePitch(TimeWindow win, int width) const
 {
-	if (GetWindowDuration() <= time_step * 2) {
+	auto window_duration = win.second - win.first;
+
+	if (window_duration <= time_step * 2) {
 		throw error("Zoom out to see pitch");
 	}
-	if (GetWindowDuration() / time_step > GetWidth() * 2) {
+	if (window_duration / time_step > width * 2) {
 		throw error("Zoom in to see pitch");
 	}
-	auto first_sample = m_sound->time_to_frame(m_window.first);
-	auto last_sample = m_sound->time_to_frame(m_window.second);
+	auto first_sample = m_sound->time_to_frame(win.first);
+	auto last_sample = m_sound->time_to_frame(win.second);
 	auto input = m_sound->get_channel(m_channel, first_sample, last_sample);
 	auto sample_rate = m_sound->sample_rate();
 
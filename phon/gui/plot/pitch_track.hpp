@@ -41,9 +41,9 @@ private:
 
 	void ReadSettings() override;
 
-	void DrawBitmap();
+	void DrawBitmap(const String &error);
 
-	std::vector<double> CalculatePitch();
+	std::vector<double> CalculatePitch(TimeWindow win, int width) const;
 
 	double YPosToHertz(int y) const;
 
@@ -19,6 +19,9 @@
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
+#include <algorithm>
+#include <thread>
+#include <wx/dcmemory.h>
 #include <phon/gui/plot/sound_plot.hpp>
 #include <phon/application/settings.hpp>
 
@@ -29,8 +32,9 @@
 namespace phonometrica {
 
 SoundPlot::SoundPlot(wxWindow *parent, const Handle <Sound> &snd, int channel) :
-		SpeechWidget(parent), m_sound(snd), m_channel(channel)
+		SpeechWidget(parent), m_sound(snd), m_channel(channel), m_analysis(std::make_shared<AnalysisState>())
 {
+	m_analysis->owner = this;
 	Bind(wxEVT_RIGHT_DOWN, &SoundPlot::OnContextMenu, this);
 	Bind(wxEVT_LEFT_DOWN, &SoundPlot::OnStartSelection, this);
 	Bind(wxEVT_LEFT_UP, &SoundPlot::OnEndSelection, this);
@@ -42,6 +46,51 @@ SoundPlot::SoundPlot(wxWindow *parent, const Handle <Sound> &snd, int channel) :
 	Bind(wxEVT_PAINT, &SoundPlot::OnPaint, this);
 }
 
+SoundPlot::~SoundPlot()
+{
+	// Workers may still be using the sound and the plot's settings.
+	{
+		std::lock_guard<std::mutex> lock(m_analysis->mutex);
+		m_analysis->owner = nullptr;
+	}
+	CancelAnalysis();
+}
+
+ThreadPool &SoundPlot::GetAnalysisPool()
+{
+	// Leave one core to the GUI thread.
+	static ThreadPool pool((std::max)(1, int(std::thread::hardware_concurrency()) - 1));
+	return pool;
+}
+
+void SoundPlot::InitializeCache()
+{
+	if (m_cached_bmp.IsOk()) {
+		return;
+	}
+	wxBitmap bmp(GetSize());
+	wxMemoryDC dc;
+	dc.SelectObject(bmp);
+	dc.SetBackground(*wxWHITE);
+	dc.Clear();
+	dc.SelectObject(wxNullBitmap);
+	m_cached_bmp = bmp;
+}
+
+void SoundPlot::CancelAnalysis()
+{
+	++m_analysis->generation;
+	std::unique_lock<std::mutex> lock(m_analysis->mutex);
+	m_analysis->finished.wait(lock, [this]() { return m_analysis->running == 0; });
+}
+
+void SoundPlot::InvalidateCache()
+{
+	SpeechWidget::InvalidateCache();
+	// Results for the previous window or size are not needed anymore.
+	++m_analysis->generation;
+}
+
 void SoundPlot::OnEraseBackground(wxEraseEvent &)
 {
 
@@ -298,6 +347,8 @@ void SoundPlot::DrawTimeTick(wxGraphicsContext &gc)
 
 void SoundPlot::UpdateSettings()
 {
+	// Analyses read the settings from the worker threads.
+	CancelAnalysis();
 	ReadSettings();
 	InvalidateCache();
 	Refresh();
@@ -22,11 +22,17 @@
 #ifndef PHONOMETRICA_SOUND_PLOT_HPP
 #define PHONOMETRICA_SOUND_PLOT_HPP
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <wx/dcclient.h>
 #include <wx/dcbuffer.h>
 #include <wx/graphics.h>
 #include <phon/gui/plot/speech_widget.hpp>
 #include <phon/application/sound.hpp>
+#include <phon/utils/thread_pool.hpp>
 
 namespace phonometrica {
 
@@ -43,6 +49,8 @@ public:
 
 	SoundPlot(wxWindow *parent, const Handle <Sound> &snd, int channel);
 
+	~SoundPlot() override;
+
 	bool HasSelection() const { return m_sel.t1 >= 0; }
 
 	const TimeSelection & GetSelection() const;
@@ -99,6 +107,25 @@ public:
 
 protected:
 
+	// Returns true when the result of a background analysis is no longer needed.
+	using Cancelled = std::function<bool()>;
+
+	// Run `compute` on a worker thread and pass its result to `finish` on the main thread. `error` is empty if
+	// the computation succeeded. Results that are superseded by a newer analysis (or by a cache invalidation) are
+	// dropped, as are results computed for another plot size, and the previous bitmap is displayed until the new one
+	// is ready. `compute` must not call wx functions or copy handles; it may only read members that are stable while
+	// an analysis is running (see CancelAnalysis()).
+	template<class T>
+	void RunAnalysis(std::function<T(const Cancelled &)> compute, std::function<void(T &, const String &)> finish);
+
+	// Discard pending results and wait for running analyses to complete.
+	void CancelAnalysis();
+
+	// Make sure there is something to display while the first analysis is running.
+	void InitializeCache();
+
+	void InvalidateCache() override;
+
 	void OnPaint(wxPaintEvent &);
 
 	void OnEraseBackground(wxEraseEvent &);
@@ -161,8 +188,79 @@ protected:
 
 	// Channel associated with this plot (0 is the the average of all channels)
 	int m_channel;
+
+private:
+
+	// State shared between the plot and its background analyses, which may outlive the plot's event loop.
+	struct AnalysisState
+	{
+		std::mutex mutex;
+
+		std::condition_variable finished;
+
+		// Set to null when the plot is destroyed.
+		wxEvtHandler *owner = nullptr;
+
+		// Incremented whenever the current analysis becomes obsolete.
+		std::atomic<int> generation{0};
+
+		// Number of analyses which have been submitted and haven't completed yet.
+		int running = 0;
+	};
+
+	static ThreadPool &GetAnalysisPool();
+
+	std::shared_ptr<AnalysisState> m_analysis;
 };
 
+template<class T>
+void SoundPlot::RunAnalysis(std::function<T(const Cancelled &)> compute, std::function<void(T &, const String &)> finish)
+{
+	InitializeCache();
+	auto state = m_analysis;
+	auto size = GetSize();
+	int generation = ++state->generation;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->running++;
+	}
+
+	GetAnalysisPool().submit([this, state, size, generation, compute = std::move(compute), finish = std::move(finish)]() {
+		Cancelled cancelled = [state, generation]() { return state->generation != generation; };
+
+		if (!cancelled())
+		{
+			auto result = std::make_shared<T>();
+			String error;
+
+			try
+			{
+				*result = compute(cancelled);
+			}
+			catch (std::exception &e)
+			{
+				error = e.what();
+			}
+
+			std::lock_guard<std::mutex> lock(state->mutex);
+
+			if (state->owner && !cancelled())
+			{
+				// The plot is alive when the callback is run: pending calls are discarded when it is destroyed.
+				state->owner->CallAfter([this, state, size, generation, result, error, finish]() {
+					if (state->generation == generation && GetSize() == size) {
+						finish(*result, error);
+					}
+				});
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->running--;
+		state->finished.notify_all();
+	});
+}
+
 } // namespace phonometrica
 
 
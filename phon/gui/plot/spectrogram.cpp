@@ -19,7 +19,6 @@
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
-#include <fftw3.h>
 #include <wx/dcmemory.h>
 #include <wx/rawbmp.h>
 #include <wx/msgdlg.h>
@@ -47,12 +46,68 @@ Spectrogram::Spectrogram(wxWindow *parent, const Handle <Sound> &snd, int channe
 }
 
 void Spectrogram::UpdateCache()
+{
+	m_cached_size = GetSize();
+	auto win = m_window;
+	int w = GetWidth();
+	int h = GetHeight();
+	bool with_formants = show_formants && !formant_error;
+
+	auto compute = [=](const Cancelled &cancelled) {
+		Analysis result;
+		result.raster = ComputeSpectrogram(win, w, h, cancelled);
+
+		if (with_formants && !cancelled())
+		{
+			try
+			{
+				result.formants = EstimateFormants(win, w);
+			}
+			catch (std::exception &e)
+			{
+				result.formant_message = e.what();
+			}
+		}
+
+		return result;
+	};
+
+	auto finish = [=](Analysis &result, const String &error) {
+		if (!error.empty())
+		{
+			m_cached_bmp = wxBitmap();
+			InitializeCache();
+			DrawMessage(error);
+			Refresh();
+			return;
+		}
+		DrawSpectrogram(result.raster);
+
+		if (with_formants)
+		{
+			if (result.formant_message.empty())
+			{
+				formants = std::move(result.formants);
+				DrawFormants();
+			}
+			else
+			{
+				DrawMessage(result.formant_message);
+				timer.StartOnce(2000);
+			}
+		}
+		Refresh();
+	};
+
+	RunAnalysis<Analysis>(compute, finish);
+}
+
+void Spectrogram::DrawSpectrogram(const Matrix<double> &raster)
 {
     // FIXME: On Windows, we must open a new scope to make sure that the cached bitmap is not shared; otherwise we will
     //  get an assertion failure "can't copy bitmap locked for raw access!" in wxMemoryDC::SelectObject().
+	wxBitmap bmp(GetSize());
 	{
-		auto raster = ComputeSpectrogram();
-		wxBitmap bmp(GetSize());
 		wxNativePixelData data(bmp);
 		// We can't use Eigen's maxCoeff()/minCoeff() because we have nan's in the matrix.
 		double max_dB = -100000;
@@ -97,39 +152,26 @@ void Spectrogram::UpdateCache()
 				px.OffsetY(data, 1);
 			}
 		}
-		m_cached_bmp = bmp;
-		assert(m_cached_bmp.IsOk());
 	}
+	m_cached_bmp = bmp;
+	assert(m_cached_bmp.IsOk());
+}
 
-	if (show_formants && !formant_error)
-	{
-		try
-		{
-			EstimateFormants();
-			assert(m_cached_bmp.IsOk());
-			DrawFormants();
-			assert(m_cached_bmp.IsOk());
-		}
-		catch (std::exception &e)
-		{
-			wxMemoryDC dc;
-			dc.SelectObject(m_cached_bmp);
-			auto gc = std::unique_ptr<wxGraphicsContext>(wxGraphicsContext::Create(dc));
-			if (!gc) return;
-			wxString formant_message = e.what();
-			dc.SetTextForeground(*wxRED);
-			auto font = dc.GetFont();
-			font.MakeLarger();
-			dc.SetFont(font);
-			auto sz = dc.GetTextExtent(formant_message);
-			auto x = (GetWidth() - sz.x) / 2;
-			auto y = (GetHeight() - sz.y) / 2;
-			wxPoint origin(x, y);
-			dc.DrawText(formant_message, origin);
-			timer.StartOnce(2000);
-			dc.SelectObject(wxNullBitmap);
-		}
-	}
+void Spectrogram::DrawMessage(const String &msg)
+{
+	wxMemoryDC dc;
+	dc.SelectObject(m_cached_bmp);
+	wxString message = msg;
+	dc.SetTextForeground(*wxRED);
+	auto font = dc.GetFont();
+	font.MakeLarger();
+	dc.SetFont(font);
+	auto sz = dc.GetTextExtent(message);
+	auto x = (GetWidth() - sz.x) / 2;
+	auto y = (GetHeight() - sz.y) / 2;
+	wxPoint origin(x, y);
+	dc.DrawText(message, origin);
+	dc.SelectObject(wxNullBitmap);
 }
 
 void Spectrogram::DrawYAxis(PaintDC &dc, const wxRect &rect)
@@ -197,7 +239,7 @@ void Spectrogram::ReadFormantSettings()
 	time_step = Settings::get_number(category, "time_step");
 }
 
-Matrix<double> Spectrogram::ComputeSpectrogram()
+Matrix<double> Spectrogram::ComputeSpectrogram(TimeWindow win, int w, int h, const Cancelled &cancelled) const
 {
 	using namespace speech;
 
@@ -216,55 +258,35 @@ Matrix<double> Spectrogram::ComputeSpectrogram()
 	while (nfft < nframe) nfft *= 2;
 	auto half_nfft = nfft / 2;
 
-	std::vector<double>amplitude(half_nfft, 0.0);
-	intptr_t w = GetWidth();
-	intptr_t h = GetHeight();
-
-	// Get audio data. We will try to get a bit more data before and after the window so that we can calculate
-	// frames at the edge.
-	auto slice_duration = GetWindowDuration() / w;
+	// Each horizontal pixel represents the center of an analysis window.
+	auto slice_duration = (win.second - win.first) / w;
 	auto offset = (slice_duration - analysis_window_duration) / 2;
-	auto first_sample = m_sound->time_to_frame(m_window.first + offset);
-	auto last_sample = m_sound->time_to_frame(m_window.first + (w-1) * slice_duration + offset) + nframe + 1;
-	if (first_sample < 1)
-	{
-		first_sample = 1;
-	}
-	auto total_sample_count = m_sound->channel_size();
-	if (last_sample > total_sample_count)
-	{
-		last_sample = total_sample_count;
-	}
+
+	// Spectra are computed on a grid whose hop size is the largest power of 2 that doesn't exceed the number of samples
+	// per pixel, and each pixel uses the closest frame. This is at most half a pixel away from the exact position, and
+	// the same frames are reused when the view is scrolled or zoomed by less than a factor of 2.
+	intptr_t hop = 1;
+	while (hop * 2 <= slice_duration * sample_rate) hop *= 2;
+	SpectrumCache::Parameters params{m_channel, nframe, nfft, window_type, preemph_threshold, hop};
+	auto &cache = m_sound->spectra();
+	auto frame_count = cache.frame_count(params);
+	std::shared_ptr<const SpectrumCache::Tile> tile;
 
 	// An m x n matrix, where m represents the number of horizontal pixels and n represents the number of vertical pixels.
-	// Each horizontal pixel/point represents the center of an analysis window.
 	Matrix<double> raster(w, h);
 	raster.setZero(w, h);
 
-	auto win = create_window(nframe, nfft, window_type);
-
-	// Weight power.
-	double weight = 0;
-	for (double x : win) weight += x * x;
-	double k1 = 1 / (sample_rate * weight); // at DC and Nyquist frequencies.
-	double k2 = 2 / (sample_rate * weight); // at other frequencies
-
-	std::vector<double> input(nfft, 0.0);
-	std::vector<std::complex<double>> output(nfft, std::complex<double>(0, 0));
-	fftw_plan plan = fftw_plan_dft_r2c_1d(nfft, input.data(), (fftw_complex*)output.data(), FFTW_ESTIMATE);
-
-	auto data = m_sound->get_channel(m_channel, first_sample, last_sample);
-	pre_emphasis(data, sample_rate, preemph_threshold);
-
-
 	for (intptr_t x = 0; x < w; x++)
 	{
-		auto t = m_window.first + x * slice_duration + offset;
-		auto from_sample = m_sound->time_to_frame(t) - first_sample;
-		auto to_sample = from_sample + nframe;
-		auto it = data.begin() + from_sample;
+		// The result will be discarded: stop as soon as possible.
+		if (cancelled()) {
+			break;
+		}
+		auto t = win.first + x * slice_duration + offset;
+		auto start = m_sound->time_to_frame(t) - 1;
+		auto k = intptr_t(round(double(start) / hop));
 
-		if (from_sample < 0 || to_sample >= data.size())
+		if (t < 0 || k >= frame_count)
 		{
 			// Can't calculate FFT because we would get outside of the bounds.
 			// Display a white vertical column and move to the next time point.
@@ -272,38 +294,12 @@ Matrix<double> Spectrogram::ComputeSpectrogram()
 			{
 				raster(x, j) = std::nan(""); // it will be converted to the minimum intensity when it is displayed.
 			}
-//			PHON_LOG("pixel %d, from = %d, to = %d [SKIPPED]\n", int(x), int(from_sample), int(to_sample));
 			continue;
 		}
-		else
-		{
-//			PHON_LOG("pixel %d, from = %d, to = %d\n", int(x), int(from_sample), int(to_sample));
-		}
-
-		// Calculate fft
-		for (intptr_t j = 0; j < nframe; j++)
-		{
-			auto sample = float((*it++) * win[j + 1]);
-			input[j] = sample;
-		}
-		for (intptr_t j = nframe; j < nfft; j++)
-		{
-			input[j] = 0;
-		}
-
-		fftw_execute(plan);
-
-		for (size_t y = 0; y < (size_t)half_nfft; y++)
-		{
-			double a = output[y].real() * output[y].real() + output[y].imag() * output[y].imag();
-			assert(std::isfinite(a));
-			double k = (y == 0 || y == (size_t)half_nfft - 1) ? k1 : k2;
-			a = k * a / nfft;
-			constexpr double Iref = 4.0e-10;
-			// Intensity is undefined if the raw amplitude is equal to 0.
-			double dB = 10 * log10(a / Iref);
-			amplitude[y] = dB;
+		if (!tile || k < tile->first_frame || k >= tile->first_frame + tile->nframe) {
+			tile = cache.get_tile(params, k);
 		}
+		auto amplitude = tile->frame(k);
 
 		// Create raster: frequencies on the y axis are mapped to the closest frequency bin.
 		double ceiling_bin = max_freq * half_nfft / nyquist_frequency;
@@ -312,9 +308,9 @@ Matrix<double> Spectrogram::ComputeSpectrogram()
 			double freq = double(y * ceiling_bin) / (h-1.0);
 			int bin = int(freq);
 
-			if (bin == half_nfft)
+			if (bin >= half_nfft - 1)
 			{
-				raster(x, y - 1) = amplitude[bin];
+				raster(x, y - 1) = amplitude[half_nfft - 1];
 			}
 			else
 			{
@@ -330,45 +326,33 @@ Matrix<double> Spectrogram::ComputeSpectrogram()
 		}
 	}
 
-//	PHON_LOG("------------------------------- SPECTROGRAM\n");
-//	PHON_LOG("window: %f, start: %f, end: %f\n", GetWindowDuration(), m_window.first, m_window.second);
-//	PHON_LOG("slice duration: %f\n", slice_duration);
-//	PHON_LOG("offset: %f\n", offset);
-//	PHON_LOG("first sample: %d\n", (int)first_sample);
-//	PHON_LOG("last sample: %d\n", (int)last_sample);
-//	PHON_LOG("data size: %d\n", (int)data.size());
-//	PHON_LOG("width: %d\n", int(w));
-//	PHON_LOG("nframe: %d, nfft: %d\n", nframe, nfft);
-
-	fftw_free(plan);
-	m_cached_size = GetSize();
-
 	return raster;
 }
 
-void Spectrogram::EstimateFormants()
+Matrix<double> Spectrogram::EstimateFormants(TimeWindow win, int width) const
 {
 	using namespace speech;
+	auto window_duration = win.second - win.first;
 
 	// At least 2 measurements per window
-	if (GetWindowDuration() <= 2 * time_step) {
+	if (window_duration <= 2 * time_step) {
 		throw error("Zoom out to see formants");
 	}
 	// At most 2 measurements per pixel
-	if (GetWindowDuration() / time_step > GetWidth() * 2) {
+	if (window_duration / time_step > width * 2) {
 		throw error("Zoom in to see formants");
 	}
 
-	auto npoint = int(ceil((GetWindowDuration() - time_step) / time_step));
-	formants = Matrix<double>(npoint, nformant);
+	auto npoint = int(ceil((window_duration - time_step) / time_step));
+	Matrix<double> formants(npoint, nformant);
 	Matrix<double> bandwidths(npoint, nformant);
 	formants.setZero(npoint, nformant);
 	bandwidths.setZero(npoint, nformant);
 
 	// Window length will be multiplied by 2 because of the Gaussian window,
 	// so 'formant_window_length' is effectively half a window.
-	auto start_time = m_window.first + time_step - formant_window_length;
-	auto end_time = m_window.first + time_step * (npoint + 1) + formant_window_length;
+	auto start_time = win.first + time_step - formant_window_length;
+	auto end_time = win.first + time_step * (npoint + 1) + formant_window_length;
 	if (start_time < 0.0) start_time = 0.0;
 	if (end_time > GetSoundDuration()) end_time = GetSoundDuration();
 	auto start_frame = m_sound->time_to_frame(start_time);
@@ -383,10 +367,10 @@ void Spectrogram::EstimateFormants()
 	pre_emphasis(data, Fs, 50);
 
 	auto nframe = int(ceil(formant_window_length * Fs)) * 2; // x 2 for Gaussian window
-	auto win = create_window(nframe, nframe, WindowType::Gaussian);
+	auto window = create_window(nframe, nframe, WindowType::Gaussian);
 	Array<double> buffer(nframe, 0.0);
 	auto len = data.size();
-	auto t = m_window.first;
+	auto t = win.first;
 
 //	PHON_LOG("-------------------------------\n");
 //	PHON_LOG("first sample: %d\n", (int)start_frame);
@@ -415,7 +399,7 @@ void Spectrogram::EstimateFormants()
 		auto it = data.begin() + from_sample;
 		for (int j = 1; j <= nframe; j++)
 		{
-			buffer[j] = *it++ * win[j];
+			buffer[j] = *it++ * window[j];
 		}
 
 		auto coeffs = get_lpc_coefficients(buffer, lpc_order);
@@ -488,6 +472,8 @@ void Spectrogram::EstimateFormants()
 		auto end_frame = start_frame + nframe;
 
 #endif
+
+	return formants;
 }
 
 bool Spectrogram::HasFormants() const
@@ -561,7 +547,7 @@ void Spectrogram::OnTimer(wxTimerEvent &event)
 
 void Spectrogram::InvalidateCache()
 {
-	SpeechWidget::InvalidateCache();
+	SoundPlot::InvalidateCache();
 	formant_error = false;
 	// Stop the timer to make sure we don't erase formants during fast scrolling.
 	timer.Stop();
@@ -48,13 +48,28 @@ private:
 
 	void ReadFormantSettings();
 
+	// Data computed in the background for the current window.
+	struct Analysis
+	{
+		Matrix<double> raster;
+
+		Matrix<double> formants;
+
+		// Non-empty if formants could not be estimated.
+		String formant_message;
+	};
+
 	void UpdateCache() override;
 
+	void DrawSpectrogram(const Matrix<double> &raster);
+
 	void DrawFormants();
 
-	Matrix<double> ComputeSpectrogram();
+	void DrawMessage(const String &msg);
+
+	Matrix<double> ComputeSpectrogram(TimeWindow win, int w, int h, const Cancelled &cancelled) const;
 
-	void EstimateFormants();
+	Matrix<double> EstimateFormants(TimeWindow win, int width) const;
 
 	int FormantToYPos(double hz);
 
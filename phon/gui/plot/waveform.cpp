@@ -198,71 +198,50 @@ std::vector<double> Waveform::ComputeWaveform()
 	if ((last_sample - first_sample) < 1) {
 		throw error("zoom out to see waveform");
 	}
-	auto data = m_sound->get_channel(m_channel, first_sample, last_sample);
-	auto sample_count = data.size();
-
-	if (scaling == Scaling::Global)
-	{
-		SetMagnitude(global_magnitude);
-	}
-	else if (scaling == Scaling::Local)
-	{
-		SetLocalMagnitude(data);
-	}
+	auto sample_count = last_sample - first_sample + 1;
 	auto width = GetWidth();
 	assert(m_window.second <= m_sound->duration());
 
-//	PHON_LOG("-----------------------------------\n");
-//	PHON_LOG("window: %f to %f\n", m_window.first, m_window.second);
-//	PHON_LOG("width: %d\n", width);
-//	PHON_LOG("first sample: %ld\n", first_sample);
-//	PHON_LOG("last sample: %ld\n", last_sample);
-//	PHON_LOG("sample count: %ld\n", sample_count);
-
 	if (sample_count >= width * 2)
 	{
 		// If the number of samples to display is greater than twice the number of pixels,
 		// map several frames to one pixel. We find the maximum and minimum amplitudes and draw
 		// a vertical line for this pixel. We allow one overlapping frame for each pixel to spread
-		// frames uniformly across pixels.
-		std::vector<double> wave(GetWidth() * 2, 0.0);
-		auto current_point = wave.begin();
+		// frames uniformly across pixels. Extrema are read from the sound's peaks, so the cost
+		// doesn't depend on the number of frames.
+		std::vector<std::pair<double,double>> peaks(width);
 
 		// Frames per pixel
 		auto offset = double(sample_count) / width;
-//		PHON_LOG("frames per pixel: %f\n", offset);
+		double local_magnitude = 0;
 
 		for (int i = 0; i < width; i++)
 		{
-			auto x1 = intptr_t(floor(i * offset));
-			auto x2 = intptr_t(ceil((i+1) * offset));
-			if (x2 > sample_count) {
-				x2 = sample_count;
+			auto x1 = first_sample + intptr_t(floor(i * offset));
+			auto x2 = first_sample + intptr_t(ceil((i+1) * offset)) - 1;
+			if (x2 > last_sample) {
+				x2 = last_sample;
 			}
+			peaks[i] = m_sound->get_peaks(m_channel, x1, x2);
+			local_magnitude = (std::max)(local_magnitude, (std::max)(std::abs(peaks[i].first), std::abs(peaks[i].second)));
+		}
 
-			auto it = data.begin() + x1;
-			auto limit = data.begin() + x2;
-
-			// Read first sample.
-			auto maximum = *it++;
-			auto minimum = maximum;
-
-			while (it != limit)
-			{
-				auto sample = *it++;
+		if (scaling == Scaling::Global)
+		{
+			SetMagnitude(global_magnitude);
+		}
+		else if (scaling == Scaling::Local)
+		{
+			SetMagnitude(local_magnitude);
+		}
 
-				if (sample < minimum) {
-					minimum = sample;
-				}
-				else if (sample > maximum) {
-					maximum = sample;
-				}
-			}
+		std::vector<double> wave(GetWidth() * 2, 0.0);
+		auto current_point = wave.begin();
 
-			double y1 = SampleToHeight(maximum);
-			double y2 = SampleToHeight(minimum);
-			*current_point++ = y1;
-			*current_point++ = y2;
+		for (auto &peak : peaks)
+		{
+			*current_point++ = SampleToHeight(peak.second);
+			*current_point++ = SampleToHeight(peak.first);
 		}
 		assert(current_point == wave.end());
 
@@ -271,6 +250,17 @@ std::vector<double> Waveform::ComputeWaveform()
 	else
 	{
 		// Draw all the points
+		auto data = m_sound->get_channel(m_channel, first_sample, last_sample);
+
+		if (scaling == Scaling::Global)
+		{
+			SetMagnitude(global_magnitude);
+		}
+		else if (scaling == Scaling::Local)
+		{
+			SetLocalMagnitude(data);
+		}
+
 		std::vector<double> wave(data.size(), 0.0);
 		auto it = wave.begin();
 
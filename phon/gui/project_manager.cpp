@@ -29,6 +29,7 @@
 #include <phon/gui/dialog.hpp>
 #include <phon/gui/project_manager.hpp>
 #include <phon/gui/text_viewer.hpp>
+#include <phon/gui/conc/query_editor.hpp>
 #include <phon/include/icons.hpp>
 #include <phon/application/macros.hpp>
 #include <phon/application/settings.hpp>
@@ -481,7 +482,7 @@ void ProjectManager::OnRightClick(wxTreeEvent &)
 
 				auto exe_id = wxNewId();
 				menu->Append(exe_id, _("Execute"));
-				Bind(wxEVT_COMMAND_MENU_SELECTED, [this,query](wxCommandEvent &) { view_file(query->execute()); Project::updated(); }, exe_id);
+				Bind(wxEVT_COMMAND_MENU_SELECTED, [this,query](wxCommandEvent &) { view_file(query->execute(QueryEditor::CreateProgress(nullptr))); Project::updated(); }, exe_id);
 				menu->AppendSeparator();
 			}
 			else
@@ -500,6 +501,9 @@ void ProjectManager::OnRightClick(wxTreeEvent &)
 					menu->AppendSeparator();
 					menu->Append(convert_id, _("Save as Praat TextGrid..."));
 					Bind(wxEVT_COMMAND_MENU_SELECTED, [this,annot](wxCommandEvent &) { ConvertAnnotationToTextGrid(annot); }, convert_id);
+					auto format_id = wxNewId();
+					menu->Append(format_id, annot->is_binary() ? _("Convert to XML format") : _("Convert to binary format"));
+					Bind(wxEVT_COMMAND_MENU_SELECTED, [this,annot](wxCommandEvent &) { ConvertAnnotationFormat(annot); }, format_id);
 				}
 				else if (annot->is_textgrid())
 				{
@@ -1017,6 +1021,22 @@ void ProjectManager::ConvertTextGridToAnnotation(const Handle<Annotation> &annot
 	AskImportFile(path);
 }
 
+void ProjectManager::ConvertAnnotationFormat(const Handle<Annotation> &annot)
+{
+	try
+	{
+		annot->open();
+		annot->set_binary(!annot->is_binary());
+		annot->save();
+	}
+	catch (std::exception &e)
+	{
+		wxString msg = _("Cannot convert annotation: ");
+		msg.Append(wxString::FromUTF8(e.what()));
+		wxMessageBox(msg, _("Conversion error"), wxICON_ERROR);
+	}
+}
+
 void ProjectManager::OpenAnnotationInPraat(const Handle<Annotation> &annot)
 {
 	try
@@ -137,6 +137,8 @@ private:
 
 	void ConvertTextGridToAnnotation(const Handle<Annotation> &annot);
 
+	void ConvertAnnotationFormat(const Handle<Annotation> &annot);
+
 	void OpenAnnotationInPraat(const Handle<Annotation> &annot);
 
 	void AskImportFile(const String &path);
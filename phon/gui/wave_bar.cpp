@@ -29,17 +29,9 @@ WaveBar::WaveBar(wxWindow *parent, const Handle <Sound> &snd) : wxWindow(parent,
 	SetMinSize(wxSize(-1, 50));
 	SetMaxSize(wxSize(-1, 50));
 
-    auto raw_data = m_sound->data().data();
-    auto sample_count = m_sound->size();
-
-    for (intptr_t i = 0; i < sample_count; i++)
-    {
-        double m = std::abs(raw_data[i]);
-
-        if (m > raw_magnitude) {
-	        raw_magnitude = m;
-        }
-    }
+    double min_value, max_value;
+    m_sound->get_extrema(min_value, max_value);
+    raw_magnitude = (std::max)(std::abs(min_value), std::abs(max_value));
 
     Bind(wxEVT_ERASE_BACKGROUND, &WaveBar::OnEraseBackground, this);
 	Bind(wxEVT_PAINT, &WaveBar::OnPaint, this);
@@ -129,8 +121,6 @@ void WaveBar::UpdateCache()
 	}
 
 	auto sample_count = m_sound->channel_size();
-	auto &data = m_sound->data();
-	int nchannel = m_sound->nchannel();
 
 	// Same algorithm as for Waveform.
 	if (sample_count >= width * 2)
@@ -148,33 +138,8 @@ void WaveBar::UpdateCache()
 				x2 = sample_count;
 			}
 
-			// Get average value for each sample
-			double sample = 0;
-			for (intptr_t j = 1; j <= nchannel; j++) {
-				sample += data(x1,j);
-			}
-			sample /= nchannel;
-
-			// Read first sample.
-			auto maximum = sample;
-			auto minimum = maximum;
-
-			for (intptr_t x = x1+1; x <= x2; x++)
-			{
-				// Get average value for each sample
-				double sample = 0;
-				for (intptr_t j = 1; j <= nchannel; j++) {
-					sample += data(x,j);
-				}
-				sample /= nchannel;
-
-				if (sample < minimum) {
-					minimum = sample;
-				}
-				else if (sample > maximum) {
-					maximum = sample;
-				}
-			}
+			// Get extrema of the average of all channels.
+			auto [minimum, maximum] = m_sound->get_peaks(0, x1, x2);
 
 			double y1 = SampleToYPos(maximum);
 			double y2 = SampleToYPos(minimum);
@@ -187,6 +152,7 @@ void WaveBar::UpdateCache()
 	else
 	{
 		// Draw all the points
+		auto data = m_sound->get_channel(0, 1, sample_count);
 		std::vector<double> wave(data.size(), 0.0);
 		auto it = wave.begin();
 
@@ -0,0 +1,244 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <phon/runtime/array_math.hpp>
+#include <phon/runtime/string.hpp>
+#include <phon/third_party/Eigen/Dense>
+
+namespace phonometrica {
+
+using ArrayMap = Eigen::Map<Eigen::ArrayXd>;
+using ConstArrayMap = Eigen::Map<const Eigen::ArrayXd>;
+
+template<class X, class Y>
+static void evaluate(ArrayOp op, const X &x, const Y &y, ArrayMap &z)
+{
+	switch (op)
+	{
+		case ArrayOp::Add:
+			z = x + y;
+			break;
+		case ArrayOp::Subtract:
+			z = x - y;
+			break;
+		case ArrayOp::Multiply:
+			z = x * y;
+			break;
+		case ArrayOp::Divide:
+			z = x / y;
+			break;
+		case ArrayOp::Power:
+			z = x.pow(y);
+			break;
+		case ArrayOp::Less:
+			z = (x < y).template cast<double>();
+			break;
+		case ArrayOp::LessEqual:
+			z = (x <= y).template cast<double>();
+			break;
+		case ArrayOp::Greater:
+			z = (x > y).template cast<double>();
+			break;
+		case ArrayOp::GreaterEqual:
+			z = (x >= y).template cast<double>();
+	}
+}
+
+void apply_array_op(ArrayOp op, const double *x, double xs, const double *y, double ys, double *z, intptr_t n)
+{
+	ArrayMap Z(z, n);
+
+	// Scalars are turned into constant expressions, which Eigen evaluates without allocating a temporary.
+	if (x && y) {
+		evaluate(op, ConstArrayMap(x, n), ConstArrayMap(y, n), Z);
+	}
+	else if (x) {
+		evaluate(op, ConstArrayMap(x, n), Eigen::ArrayXd::Constant(n, ys), Z);
+	}
+	else {
+		evaluate(op, Eigen::ArrayXd::Constant(n, xs), ConstArrayMap(y, n), Z);
+	}
+}
+
+// Create an array of 0s with the same shape as x.
+static Array<double> new_array(const Array<double> &x)
+{
+	switch (x.ndim())
+	{
+		case 1:
+			return Array<double>::from_memory(utils::allocate<double>(x.size()), x.size());
+		case 2:
+			return Array<double>(x.nrow(), x.ncol());
+		default:
+			return Array<double>(x);
+	}
+}
+
+static bool same_shape(const Array<double> &x, const Array<double> &y)
+{
+	if (x.ndim() != y.ndim() || x.size() != y.size()) {
+		return false;
+	}
+	if (x.ndim() == 2) {
+		return x.nrow() == y.nrow() && x.ncol() == y.ncol();
+	}
+	if (x.ndim() > 2)
+	{
+		try
+		{
+			x.check_dim(y);
+		}
+		catch (std::exception &)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static String get_shape(const Array<double> &x)
+{
+	if (x.ndim() == 1) {
+		return String::format("%d", (int) x.size());
+	}
+	if (x.ndim() == 2) {
+		return String::format("%dx%d", (int) x.nrow(), (int) x.ncol());
+	}
+
+	return String::format("%d-dimensional", (int) x.ndim());
+}
+
+// Combine matrix m with vector v. If swap is true, the vector is the left operand.
+static bool broadcast(ArrayOp op, const Array<double> &m, const Array<double> &v, bool swap, Array<double> &result)
+{
+	if (m.ndim() != 2 || v.ndim() > 2) {
+		return false;
+	}
+	auto nrow = m.nrow();
+	auto ncol = m.ncol();
+	bool by_column = (v.nrow() == nrow && v.ncol() == 1);
+	bool by_row = (v.nrow() == 1 && v.ncol() == ncol);
+
+	if (!by_column && !by_row) {
+		return false;
+	}
+	result = new_array(m);
+
+	for (intptr_t j = 0; j < ncol; j++)
+	{
+		auto col = m.data() + j * nrow;
+		auto out = result.data() + j * nrow;
+
+		if (by_column)
+		{
+			if (swap) apply_array_op(op, v.data(), 0, col, 0, out, nrow);
+			else apply_array_op(op, col, 0, v.data(), 0, out, nrow);
+		}
+		else
+		{
+			auto value = v.data()[j];
+			if (swap) apply_array_op(op, nullptr, value, col, 0, out, nrow);
+			else apply_array_op(op, col, 0, nullptr, value, out, nrow);
+		}
+	}
+
+	return true;
+}
+
+Array<double> array_op(ArrayOp op, const Array<double> &x, const Array<double> &y)
+{
+	if (same_shape(x, y))
+	{
+		auto z = new_array(x);
+		apply_array_op(op, x.data(), 0, y.data(), 0, z.data(), z.size());
+
+		return z;
+	}
+
+	Array<double> z;
+
+	if (broadcast(op, x, y, false, z) || broadcast(op, y, x, true, z)) {
+		return z;
+	}
+
+	throw error("[Index error] Cannot combine arrays of shape % and %", get_shape(x), get_shape(y));
+}
+
+Array<double> array_op(ArrayOp op, const Array<double> &x, double y)
+{
+	auto z = new_array(x);
+	apply_array_op(op, x.data(), 0, nullptr, y, z.data(), z.size());
+
+	return z;
+}
+
+Array<double> array_op(ArrayOp op, double x, const Array<double> &y)
+{
+	auto z = new_array(y);
+	apply_array_op(op, nullptr, x, y.data(), 0, z.data(), z.size());
+
+	return z;
+}
+
+double sum(const Array<double> &x)
+{
+	return ConstArrayMap(x.data(), x.size()).sum();
+}
+
+double mean(const Array<double> &x)
+{
+	if (x.empty()) {
+		return std::nan("");
+	}
+
+	return ConstArrayMap(x.data(), x.size()).mean();
+}
+
+double minimum(const Array<double> &x)
+{
+	if (x.empty()) {
+		return (std::numeric_limits<double>::max)();
+	}
+
+	return ConstArrayMap(x.data(), x.size()).minCoeff();
+}
+
+double maximum(const Array<double> &x)
+{
+	if (x.empty()) {
+		return std::numeric_limits<double>::lowest();
+	}
+
+	return ConstArrayMap(x.data(), x.size()).maxCoeff();
+}
+
+bool all_true(const Array<double> &x)
+{
+	return (ConstArrayMap(x.data(), x.size()) != 0.0).all();
+}
+
+bool any_true(const Array<double> &x)
+{
+	return (ConstArrayMap(x.data(), x.size()) != 0.0).any();
+}
+
+} // namespace phonometrica
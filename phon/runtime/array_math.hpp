@@ -0,0 +1,76 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: element-wise arithmetic, comparisons and reductions on numeric arrays.                                     *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_ARRAY_MATH_HPP
+#define PHONOMETRICA_ARRAY_MATH_HPP
+
+#include <phon/runtime/array.hpp>
+
+namespace phonometrica {
+
+enum class ArrayOp
+{
+	Add,
+	Subtract,
+	Multiply,
+	Divide,
+	Power,
+	Less,
+	LessEqual,
+	Greater,
+	GreaterEqual
+};
+
+// Compute z[i] = x[i] op y[i] for n elements. If x (resp. y) is null, the scalar xs (resp. ys) is used for every element.
+// Comparisons yield 1 or 0. The kernels are vectorized with the SIMD instructions available on the target. As in most
+// array languages, floating-point errors are not reported: they produce infinities or NaNs.
+void apply_array_op(ArrayOp op, const double *x, double xs, const double *y, double ys, double *z, intptr_t n);
+
+// Element-wise operation between two arrays. Arrays must have the same shape, except that a matrix can be combined with a
+// column vector that has as many rows (including a 1-dimensional array), or with a row vector that has as many columns:
+// the vector is then applied to each column (resp. row) of the matrix.
+Array<double> array_op(ArrayOp op, const Array<double> &x, const Array<double> &y);
+
+// Element-wise operation between an array and a scalar.
+Array<double> array_op(ArrayOp op, const Array<double> &x, double y);
+
+Array<double> array_op(ArrayOp op, double x, const Array<double> &y);
+
+double sum(const Array<double> &x);
+
+// The mean of an empty array is undefined (NaN).
+double mean(const Array<double> &x);
+
+// Smallest element, or the largest double if the array is empty.
+double minimum(const Array<double> &x);
+
+// Largest element, or the lowest double if the array is empty.
+double maximum(const Array<double> &x);
+
+// True if all the elements are non-zero (including when the array is empty).
+bool all_true(const Array<double> &x);
+
+// True if at least one element is non-zero.
+bool any_true(const Array<double> &x);
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_ARRAY_MATH_HPP
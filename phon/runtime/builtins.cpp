@@ -192,6 +192,8 @@ void Runtime::set_global_namespace()
 	add_global("remove_at", list_remove_at, { CLS(List), CLS(intptr_t) }, REF("01"));
 	add_global("shuffle", list_shuffle, { CLS(List) }, REF("1"));
 	add_global("sample", list_sample, { CLS(List), CLS(intptr_t) });
+	add_global("parallel_map", list_parallel_map1, { CLS(List), CLS(Function) });
+	add_global("parallel_map", list_parallel_map2, { CLS(List), CLS(Function), CLS(intptr_t) });
 	add_global("insert", list_insert, { CLS(List), CLS(intptr_t), CLS(Object) }, REF("001"));
 	add_global("intersect", list_intersect, { CLS(List), CLS(List) });
 	add_global("unite", list_unite, { CLS(List), CLS(List) });
@@ -242,6 +244,10 @@ void Runtime::set_global_namespace()
 	add_global("ones", array_ones2, { CLS(intptr_t), CLS(intptr_t) });
 	add_global("min", array_min, { CLS(Array<double>) });
 	add_global("max", array_max, { CLS(Array<double>) });
+	add_global("sum", array_sum, { CLS(Array<double>) });
+	add_global("mean", array_mean, { CLS(Array<double>) });
+	add_global("all", array_all, { CLS(Array<double>) });
+	add_global("any", array_any, { CLS(Array<double>) });
 	add_global("clear", array_clear, { CLS(Array<double>) }, REF("1"));
 	auto array_class = Class::get<Array<double>>();
 	auto &zeros = (*globals)["zeros"];
@@ -308,6 +314,7 @@ void Runtime::set_global_namespace()
 	add_global("strip_extension", system_strip_extension,  {CLS(String) });
 	add_global("genericize", system_genericize,  {CLS(String) });
 	add_global("nativize", system_nativize,  {CLS(String) });
+	add_global("get_gc_stats", system_gc_stats, {});
 }
 
 
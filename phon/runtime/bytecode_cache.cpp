@@ -0,0 +1,462 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <cassert>
+#include <cstring>
+#include <phon/runtime/bytecode_cache.hpp>
+#include <phon/utils/file_system.hpp>
+#include <phon/utils/helpers.hpp>
+
+namespace phonometrica {
+
+static const char bytecode_magic[4] = { 'P', 'H', 'B', 'C' };
+
+// This must be incremented whenever the layout of cache files or the meaning of an instruction changes.
+static const int32_t bytecode_version = 1;
+
+static uint64_t fnv1a(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= uint8_t(data[i]);
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+struct BytecodeCache::Writer
+{
+	explicit Writer(FILE *file) : file(file) { }
+
+	template<class T>
+	void write(const T &value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		ok = ok && fwrite(&value, sizeof(T), 1, file) == 1;
+	}
+
+	template<class T>
+	void write_array(const std::vector<T> &values)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		write(int64_t(values.size()));
+		ok = ok && fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+	}
+
+	void write_string(const String &s)
+	{
+		write(int64_t(s.size()));
+		ok = ok && fwrite(s.data(), 1, size_t(s.size()), file) == size_t(s.size());
+	}
+
+	FILE *file;
+	bool ok = true;
+};
+
+struct BytecodeCache::Reader
+{
+	explicit Reader(FILE *file) : file(file)
+	{
+		// Sizes read from the file are checked against the number of bytes left, so that a corrupted file can't
+		// trigger huge allocations.
+		ok = fseek(file, 0, SEEK_END) == 0 && (remaining = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0;
+	}
+
+	template<class T>
+	bool read(T &value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		return read_bytes(&value, sizeof(T));
+	}
+
+	bool read_count(int64_t &count, int64_t element_size)
+	{
+		return read(count) && count >= 0 && count <= remaining / element_size;
+	}
+
+	template<class T>
+	bool read_array(std::vector<T> &values)
+	{
+		int64_t count;
+		if (!read_count(count, sizeof(T))) return false;
+		values.resize(size_t(count));
+
+		return read_bytes(values.data(), values.size() * sizeof(T));
+	}
+
+	bool read_string(String &s)
+	{
+		int64_t size;
+		if (!read_count(size, 1)) return false;
+		std::string buffer(size_t(size), '\0');
+		if (!read_bytes(buffer.data(), buffer.size())) return false;
+		s = String(buffer.data(), intptr_t(size));
+
+		return true;
+	}
+
+	bool read_bytes(void *data, size_t size)
+	{
+		ok = ok && int64_t(size) <= remaining && fread(data, 1, size, file) == size;
+		if (ok) remaining -= int64_t(size);
+
+		return ok;
+	}
+
+	FILE *file;
+	int64_t remaining = 0;
+	bool ok;
+};
+
+
+BytecodeCache::BytecodeCache(String directory) : m_directory(std::move(directory))
+{
+
+}
+
+String BytecodeCache::cache_path(const String &path) const
+{
+	// The path of the script is stored in the file to detect collisions.
+	auto hash = fnv1a(path.data(), size_t(path.size()));
+
+	return filesystem::join(m_directory, String::format("%016llx.phc", (unsigned long long) hash));
+}
+
+bool BytecodeCache::hash_file(const String &path, uint64_t &hash)
+{
+	FILE *file = utils::open_file(path, "rb");
+	if (!file) return false;
+
+	char buffer[65536];
+	size_t count;
+	hash = 14695981039346656037ULL;
+
+	while ((count = fread(buffer, 1, sizeof buffer, file)) > 0) {
+		hash = fnv1a(buffer, count, hash);
+	}
+	bool ok = !ferror(file);
+	fclose(file);
+
+	return ok;
+}
+
+uint64_t BytecodeCache::hash_string(const String &code)
+{
+	return fnv1a(code.data(), size_t(code.size()));
+}
+
+std::shared_ptr<Routine> BytecodeCache::load(const String &path, uint64_t source_hash) const
+{
+	FILE *file = utils::open_file(cache_path(path), "rb");
+	if (!file) return nullptr;
+
+	Reader in(file);
+	char magic[4];
+	int32_t version, opcode_count;
+	uint64_t hash;
+	String runtime_version, file_path;
+	bool ok = in.read(magic) && memcmp(magic, bytecode_magic, 4) == 0 &&
+			in.read(version) && version == bytecode_version &&
+			in.read(opcode_count) && opcode_count == OPCODE_COUNT &&
+			in.read_string(runtime_version) && runtime_version == utils::get_version().c_str() &&
+			in.read(hash) && hash == source_hash &&
+			in.read_string(file_path) && file_path == path;
+
+	std::shared_ptr<Routine> routine;
+	if (ok) routine = read_routine(in, nullptr);
+	fclose(file);
+
+	return routine;
+}
+
+void BytecodeCache::save(const String &path, uint64_t source_hash, const Routine &routine) const
+{
+	if (!filesystem::exists(m_directory)) {
+		filesystem::create_directory(m_directory);
+	}
+	// Write to a temporary file first, so that an interrupted write or another instance of the program writing the same
+	// script never leaves a truncated file behind.
+	auto cache_file = cache_path(path);
+	auto temp_file = String::format("%s.%s.tmp", cache_file.data(), utils::new_uuid(8).data());
+	FILE *file = utils::open_file(temp_file, "wb");
+	if (!file) {
+		throw error("Cannot write bytecode file '%'", cache_file);
+	}
+
+	Writer out(file);
+	out.write(bytecode_magic);
+	out.write(bytecode_version);
+	out.write(int32_t(OPCODE_COUNT));
+	out.write_string(utils::get_version().c_str());
+	out.write(source_hash);
+	out.write_string(path);
+	write_routine(out, routine);
+
+	if (fclose(file) != 0 || !out.ok)
+	{
+		filesystem::remove_file(temp_file);
+		throw error("Cannot write bytecode file '%'", cache_file);
+	}
+	// Renaming fails on Windows if the destination exists.
+	if (filesystem::exists(cache_file)) {
+		filesystem::remove_file(cache_file);
+	}
+	filesystem::rename(temp_file, cache_file);
+}
+
+void BytecodeCache::write_routine(Writer &out, const Routine &r)
+{
+	// Parameter types are set when the routine is first executed, so they can't be stored.
+	assert(!r.sealed());
+	out.write_string(r.name());
+	out.write(uint64_t(r.ref_flags.to_ullong()));
+
+	auto &code = r.code;
+	out.write_array(code.code);
+	out.write(int64_t(code.lines.size()));
+	for (auto &ln : code.lines)
+	{
+		out.write(ln.first);
+		out.write(ln.second);
+	}
+	// Inline caches are created empty.
+	out.write(int64_t(code.call_sites.size()));
+
+	out.write_array(r.float_pool);
+	out.write_array(r.integer_pool);
+	out.write(int64_t(r.string_pool.size()));
+	for (auto &s : r.string_pool) {
+		out.write_string(s);
+	}
+
+	out.write(int64_t(r.locals.size()));
+	for (auto &local : r.locals)
+	{
+		out.write_string(local.name);
+		out.write(int32_t(local.scope));
+		out.write(int32_t(local.depth));
+	}
+
+	out.write(int64_t(r.upvalues.size()));
+	for (auto &upvalue : r.upvalues)
+	{
+		out.write(upvalue.index);
+		out.write(uint8_t(upvalue.is_local));
+	}
+
+	out.write(int64_t(r.routine_pool.size()));
+	for (auto &nested : r.routine_pool) {
+		write_routine(out, *nested);
+	}
+}
+
+std::shared_ptr<Routine> BytecodeCache::read_routine(Reader &in, Routine *parent)
+{
+	String name;
+	uint64_t ref_flags;
+	if (!in.read_string(name) || !in.read(ref_flags)) return nullptr;
+
+	auto r = std::make_shared<Routine>(parent, name);
+	r->ref_flags = ParamBitset(ref_flags);
+
+	auto &code = r->code;
+	int64_t count;
+	if (!in.read_array(code.code) || !in.read_count(count, 2 * sizeof(Instruction))) return nullptr;
+	code.lines.resize(size_t(count));
+	for (auto &ln : code.lines)
+	{
+		if (!in.read(ln.first) || !in.read(ln.second)) return nullptr;
+	}
+	if (!in.read(count) || count < 0 || count > (std::numeric_limits<Instruction>::max)()) return nullptr;
+	code.call_sites.resize(size_t(count));
+
+	if (!in.read_array(r->float_pool) || !in.read_array(r->integer_pool) || !in.read_count(count, sizeof(int64_t))) return nullptr;
+	r->string_pool.resize(size_t(count));
+	for (auto &s : r->string_pool)
+	{
+		if (!in.read_string(s)) return nullptr;
+	}
+	r->global_slots.resize(r->string_pool.size(), -1);
+
+	if (!in.read_count(count, sizeof(int64_t) + 2 * sizeof(int32_t))) return nullptr;
+	r->locals.resize(size_t(count));
+	for (auto &local : r->locals)
+	{
+		int32_t scope, depth;
+		if (!in.read_string(local.name) || !in.read(scope) || !in.read(depth)) return nullptr;
+		local.scope = scope;
+		local.depth = depth;
+	}
+
+	if (!in.read_count(count, sizeof(Instruction) + 1)) return nullptr;
+	r->upvalues.resize(size_t(count));
+	for (auto &upvalue : r->upvalues)
+	{
+		uint8_t is_local;
+		if (!in.read(upvalue.index) || !in.read(is_local)) return nullptr;
+		upvalue.is_local = bool(is_local);
+	}
+
+	if (!in.read_count(count, 1)) return nullptr;
+	for (int64_t i = 0; i < count; i++)
+	{
+		auto nested = read_routine(in, r.get());
+		if (!nested) return nullptr;
+		r->routine_pool.push_back(std::move(nested));
+	}
+
+	return check_routine(*r) ? r : nullptr;
+}
+
+bool BytecodeCache::check_routine(const Routine &r)
+{
+	auto &code = r.code.code;
+	auto size = code.size();
+	auto nlocal = r.locals.size();
+	std::vector<bool> starts(size, false);
+	std::vector<size_t> targets;
+	Opcode last = Opcode::Return;
+
+	for (size_t offset = 0; offset < size; )
+	{
+		if (code[offset] >= OPCODE_COUNT) {
+			return false;
+		}
+		auto op = static_cast<Opcode>(code[offset]);
+		auto next = offset + size_t(Code::get_instruction_size(op));
+		if (next > size) {
+			return false;
+		}
+		starts[offset] = true;
+		last = op;
+		auto operand = [&](size_t i) { return size_t(code[offset + i]); };
+		auto jump_target = [&](size_t i) {
+			const Instruction *ip = code.data() + offset + i;
+			return size_t(unsigned(Code::read_integer(ip)));
+		};
+		bool ok = true;
+
+		switch (op)
+		{
+			case Opcode::ClearLocal:
+			case Opcode::DecrementLocal:
+			case Opcode::DefineLocal:
+			case Opcode::GetLocal:
+			case Opcode::GetLocalRef:
+			case Opcode::GetUniqueLocal:
+			case Opcode::IncrementLocal:
+			case Opcode::SetLocal:
+			case Opcode::AddLocalSmallInt:
+				ok = operand(1) < nlocal;
+				break;
+			case Opcode::GetLocalArg:
+				ok = operand(1) < nlocal && operand(2) < PARAM_BITSET_SIZE;
+				break;
+			case Opcode::NewFrame:
+				ok = operand(1) == nlocal;
+				break;
+			case Opcode::GetUpvalue:
+			case Opcode::GetUpvalueRef:
+			case Opcode::GetUniqueUpvalue:
+			case Opcode::SetUpvalue:
+				ok = operand(1) < r.upvalues.size();
+				break;
+			case Opcode::GetUpvalueArg:
+				ok = operand(1) < r.upvalues.size() && operand(2) < PARAM_BITSET_SIZE;
+				break;
+			case Opcode::GetGlobal:
+			case Opcode::GetGlobalRef:
+			case Opcode::GetUniqueGlobal:
+			case Opcode::SetGlobal:
+			case Opcode::PushString:
+				ok = operand(1) < r.string_pool.size();
+				break;
+			case Opcode::GetGlobalArg:
+				ok = operand(1) < r.string_pool.size() && operand(2) < PARAM_BITSET_SIZE;
+				break;
+			case Opcode::GetFieldArg:
+				ok = operand(1) < PARAM_BITSET_SIZE;
+				break;
+			case Opcode::GetIndexArg:
+				ok = operand(2) < PARAM_BITSET_SIZE;
+				break;
+			case Opcode::PushFloat:
+				ok = operand(1) < r.float_pool.size();
+				break;
+			case Opcode::PushInteger:
+				ok = operand(1) < r.integer_pool.size();
+				break;
+			case Opcode::NewClosure:
+				ok = operand(1) < r.routine_pool.size();
+				break;
+			case Opcode::Call:
+				ok = operand(2) < r.code.call_sites.size();
+				break;
+			case Opcode::Jump:
+			case Opcode::JumpFalse:
+			case Opcode::JumpFalseAnd:
+			case Opcode::JumpTrue:
+			case Opcode::JumpTrueOr:
+				targets.push_back(jump_target(1));
+				break;
+			case Opcode::CompareJump:
+			{
+				auto cmp = static_cast<Opcode>(operand(1));
+				ok = cmp == Opcode::Equal || cmp == Opcode::NotEqual || cmp == Opcode::Less ||
+				     cmp == Opcode::LessEqual || cmp == Opcode::Greater || cmp == Opcode::GreaterEqual;
+				targets.push_back(jump_target(3));
+				break;
+			}
+			default:
+				break;
+		}
+		if (!ok) {
+			return false;
+		}
+		offset = next;
+	}
+
+	// Execution must not run past the end of the code.
+	if (size == 0 || (last != Opcode::Return && last != Opcode::Jump && last != Opcode::Throw)) {
+		return false;
+	}
+	for (auto target : targets)
+	{
+		if (target >= size || !starts[target]) {
+			return false;
+		}
+	}
+	// Upvalues are captured from the enclosing routine when a closure is created.
+	for (auto &nested : r.routine_pool)
+	{
+		for (auto &upvalue : nested->upvalues)
+		{
+			if (upvalue.index >= (upvalue.is_local ? nlocal : r.upvalues.size())) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+} // namespace phonometrica
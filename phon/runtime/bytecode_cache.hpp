@@ -0,0 +1,79 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: on-disk cache for compiled scripts. Each script is stored in a binary file, keyed by a hash of             *
+ * its source code and the version of the bytecode format.                                                             *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_BYTECODE_CACHE_HPP
+#define PHONOMETRICA_BYTECODE_CACHE_HPP
+
+#include <memory>
+#include <phon/runtime/class.hpp>
+#include <phon/runtime/function.hpp>
+
+namespace phonometrica {
+
+// Compiling a script is much more expensive than reading its bytecode back, so scripts that are executed repeatedly
+// (plugins, standard scripts, modules) are cached on disk after they have been compiled. A routine is stored with its
+// constant pools, line table and nested routines, before it is executed: parameter types are only known at runtime,
+// so routines are always stored unsealed. A cached routine is only used if the hash of the source code matches and if
+// it was written by a runtime that uses the same bytecode format, and if its bytecode passes a consistency check (a
+// corrupted file would otherwise crash the interpreter).
+class BytecodeCache final
+{
+public:
+
+	explicit BytecodeCache(String directory);
+
+	// Get the routine compiled from the file at the given path, or null if there is no up-to-date routine in the cache.
+	std::shared_ptr<Routine> load(const String &path, uint64_t source_hash) const;
+
+	// Store the routine compiled from the file at the given path.
+	void save(const String &path, uint64_t source_hash, const Routine &routine) const;
+
+	// Hash the content of a source file. Returns false if the file can't be read.
+	static bool hash_file(const String &path, uint64_t &hash);
+
+	// Hash source code held in memory, such as scripts embedded in the program.
+	static uint64_t hash_string(const String &code);
+
+	const String &directory() const { return m_directory; }
+
+private:
+
+	struct Writer;
+
+	struct Reader;
+
+	String cache_path(const String &path) const;
+
+	static void write_routine(Writer &out, const Routine &r);
+
+	static std::shared_ptr<Routine> read_routine(Reader &in, Routine *parent);
+
+	// Check that the bytecode of a routine read from the cache can be executed safely: opcodes must be valid, jumps must
+	// land on an instruction and operands must refer to existing constants, locals, upvalues and call sites.
+	static bool check_routine(const Routine &r);
+
+	String m_directory;
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_BYTECODE_CACHE_HPP
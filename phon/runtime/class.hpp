@@ -65,6 +65,7 @@ public:
 		StringIterator,
 		FileIterator,
 		RegexIterator,
+		ArrayIterator,
 		Foreign
 	};
 
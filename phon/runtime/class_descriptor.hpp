@@ -33,7 +33,8 @@ namespace phonometrica::detail {
 
 
 // A template to keep track of classes known at compile time. This should not be accessed directly: use
-// Class::get<T>() instead.
+// Class::get<T>() instead. Classes belong to a runtime, and each thread can run its own runtime, so descriptors are
+// thread-local.
 template<typename T>
 struct ClassDescriptor
 {
@@ -50,13 +51,19 @@ struct ClassDescriptor
 		isa = cls;
 	}
 
+	// Called when the runtime that owns the class is destroyed, so that another runtime can be created on this thread.
+	static void reset()
+	{
+		isa = nullptr;
+	}
+
 private:
 
-	static Class *isa;
+	static thread_local Class *isa;
 };
 
 template<class T>
-Class *ClassDescriptor<T>::isa = nullptr;
+thread_local Class *ClassDescriptor<T>::isa = nullptr;
 
 } // namespace phonometrica::detail
 
@@ -100,7 +100,9 @@ const char *opcode_names[] = {
 	"SetUpvalue",
 	"Subtract",
 	"TestIterator",
-	"Throw"
+	"Throw",
+	"AddLocalSmallInt",
+	"CompareJump"
 };
 
 void Code::add_line(intptr_t line_no)
@@ -192,4 +194,70 @@ const char *Code::get_opcode_name(Instruction op)
 	return opcode_names[op];
 }
 
+int Code::get_instruction_size(Opcode op)
+{
+	switch (op)
+	{
+		case Opcode::Add:
+		case Opcode::Compare:
+		case Opcode::Divide:
+		case Opcode::Equal:
+		case Opcode::GetField:
+		case Opcode::GetFieldRef:
+		case Opcode::Greater:
+		case Opcode::GreaterEqual:
+		case Opcode::Less:
+		case Opcode::LessEqual:
+		case Opcode::Modulus:
+		case Opcode::Multiply:
+		case Opcode::Negate:
+		case Opcode::NextKey:
+		case Opcode::NextValue:
+		case Opcode::Not:
+		case Opcode::NotEqual:
+		case Opcode::Pop:
+		case Opcode::Power:
+		case Opcode::Precall:
+		case Opcode::PushFalse:
+		case Opcode::PushNan:
+		case Opcode::PushNull:
+		case Opcode::PushTrue:
+		case Opcode::Return:
+		case Opcode::SetField:
+		case Opcode::Subtract:
+		case Opcode::TestIterator:
+		case Opcode::Throw:
+			return 1;
+		case Opcode::Call:
+		case Opcode::GetGlobalArg:
+		case Opcode::GetIndexArg:
+		case Opcode::GetLocalArg:
+		case Opcode::GetUpvalueArg:
+		case Opcode::NewArray:
+		case Opcode::NewClosure:
+		case Opcode::AddLocalSmallInt:
+			return 3;
+		case Opcode::Jump:
+		case Opcode::JumpFalse:
+		case Opcode::JumpFalseAnd:
+		case Opcode::JumpTrue:
+		case Opcode::JumpTrueOr:
+			return 1 + IntSerializer::IntSize;
+		case Opcode::CompareJump:
+			return 3 + IntSerializer::IntSize;
+		default:
+			return 2;
+	}
+}
+
+Instruction Code::add_call_site()
+{
+	if (unlikely(call_sites.size() == (std::numeric_limits<Instruction>::max)())) {
+		throw error("[Compiler error] Maximum number of function calls exceeded in the current function");
+	}
+	call_sites.emplace_back();
+
+	return Instruction(call_sites.size() - 1);
+}
+
 } // namespace phonometrica
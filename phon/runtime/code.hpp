@@ -29,10 +29,15 @@
 
 namespace phonometrica {
 
+class Class;
+class Object;
+
 using Instruction = uint16_t;
 
 
 
+// Compiled scripts are cached on disk: bytecode_version (see bytecode_cache.cpp) must be incremented whenever opcodes are
+// added, removed or reordered, or when their operands change.
 enum class Opcode : Instruction
 {
 	Assert,
@@ -109,10 +114,50 @@ enum class Opcode : Instruction
 	SetUpvalue,
 	Subtract,
 	TestIterator,
-	Throw
+	Throw,
+
+	// Superinstructions, which are only generated by the optimizer.
+	AddLocalSmallInt,	// GetLocal i, PushSmallInt n, Add, SetLocal i
+	CompareJump			// Comparison followed by JumpFalse or JumpTrue
+};
+
+constexpr int OPCODE_COUNT = int(Opcode::CompareJump) + 1;
+
+
+// Inline cache attached to a call site. It remembers which closure was selected for the last few combinations of
+// argument types, so that overload resolution can be skipped when a function is repeatedly called with the same types.
+// Entries are tagged with the version of the function they were resolved against: a function gets a new version whenever
+// one of its overloads is added or replaced, which invalidates all the entries that refer to it.
+struct CallCache
+{
+	// Maximum number of type combinations remembered per call site.
+	static constexpr int MaxEntries = 4;
+
+	// Calls with more arguments than this are not cached.
+	static constexpr int MaxArgs = 6;
+
+	struct Entry
+	{
+		// Version 0 is never assigned to a function, so it denotes an empty entry.
+		uint64_t version = 0;
+
+		// Closure selected for this entry. It is not retained: the function holds a reference to it for as long as its
+		// version doesn't change.
+		Object *closure = nullptr;
+
+		// Class of each argument, or null if the argument was a null value.
+		Class *classes[MaxArgs];
+	};
+
+	Entry entries[MaxEntries];
+
+	// Entry to overwrite on the next miss.
+	int next = 0;
 };
 
 
+//----------------------------------------------------------------------------------------------------------------------
+
 class Code final
 {
 	using Storage = std::vector<Instruction>;
@@ -140,6 +185,8 @@ public:
 
 	~Code() = default;
 
+	Code &operator=(Code &&) = default;
+
 	void append(intptr_t line_no, Instruction i) { add_line(line_no); code.push_back(i); }
 
 	void append(intptr_t line_no, Opcode op) { append(line_no, static_cast<Instruction>(op)); }
@@ -176,8 +223,19 @@ public:
 
 	static const char *get_opcode_name(Instruction op);
 
+	// Size of an instruction, including its operands.
+	static int get_instruction_size(Opcode op);
+
+	Instruction add_call_site();
+
+	CallCache &get_call_site(Instruction i) { return call_sites[i]; }
+
 private:
 
+	friend class Optimizer;
+	friend class BytecodeCache;
+	friend class TaskPool;
+
 	void add_line(intptr_t line_no);
 
 	// Byte codes.
@@ -186,6 +244,9 @@ private:
 	// Line numbers on which byte codes are found, for error reporting.
 	// first = line number; second = number of instructions on that line
 	std::vector<std::pair<LineNo,LineNo>> lines;
+
+	// Inline caches for the call sites in this chunk.
+	std::vector<CallCache> call_sites;
 };
 
 } // namespace phonometrica
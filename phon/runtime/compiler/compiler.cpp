@@ -20,9 +20,11 @@
  ***********************************************************************************************************************/
 
 #include <cfenv>
+#include <cmath>
 #include <phon/runtime/class.hpp>
 #include <phon/runtime.hpp>
 #include <phon/runtime/compiler/compiler.hpp>
+#include <phon/runtime/compiler/optimizer.hpp>
 #include <phon/runtime/compiler/token.hpp>
 
 #define VISIT() PHON_UNUSED(node); throw error("Cannot compile %", __FUNCTION__);
@@ -39,8 +41,9 @@ Compiler::Compiler(Runtime *rt) : runtime(rt)
 
 }
 
-Handle<Closure> Compiler::compile(AutoAst ast)
+Handle<Closure> Compiler::compile(AutoAst ast, bool optimize)
 {
+	this->optimize = optimize;
 	initialize();
 	// dummy value to fill the slot occupied by the function. This slot is popped on return.
 	code->append(ast->line_no, Opcode::PushNull);
@@ -66,9 +69,17 @@ void Compiler::initialize()
 void Compiler::finalize()
 {
 	code->append_return();
+	optimize_routine();
 	code = nullptr;
 }
 
+void Compiler::optimize_routine()
+{
+	if (optimize) {
+		Optimizer(*code).run();
+	}
+}
+
 int Compiler::open_scope()
 {
 	int previous = current_scope;
@@ -110,19 +121,165 @@ void Compiler::visit_constant(ConstantLiteral *node)
 
 void Compiler::visit_integer(IntegerLiteral *node)
 {
-	intptr_t value = node->value;
+	emit_integer(node->line_no, node->value);
+}
 
+void Compiler::emit_integer(int line_no, intptr_t value)
+{
 	// optimize small integers that can fit in an opcode.
 	if (value >= (std::numeric_limits<int16_t>::min)() && value <= (std::numeric_limits<int16_t>::max)())
 	{
 		auto small_int = (int16_t) value;
-		EMIT(Opcode::PushSmallInt, (Instruction) small_int);
+		code->append(line_no, Opcode::PushSmallInt, (Instruction) small_int);
 	}
 	else
 	{
 		auto index = routine->add_integer_constant(value);
-		EMIT(Opcode::PushInteger, index);
+		code->append(line_no, Opcode::PushInteger, index);
+	}
+}
+
+void Compiler::emit_constant(int line_no, const Constant &value)
+{
+	if (std::holds_alternative<intptr_t>(value))
+	{
+		emit_integer(line_no, std::get<intptr_t>(value));
+	}
+	else if (std::holds_alternative<double>(value))
+	{
+		auto index = routine->add_float_constant(std::get<double>(value));
+		code->append(line_no, Opcode::PushFloat, index);
+	}
+	else
+	{
+		auto index = routine->add_string_constant(std::get<String>(value));
+		code->append(line_no, Opcode::PushString, index);
+	}
+}
+
+Compiler::Constant Compiler::evaluate_constant(Ast *node) const
+{
+	// Only fold expressions whose evaluation cannot fail: anything that would raise an error is left to the runtime
+	// so that the error is reported when (and if) the expression is evaluated.
+	if (auto e = dynamic_cast<IntegerLiteral*>(node)) {
+		return e->value;
+	}
+	if (auto e = dynamic_cast<FloatLiteral*>(node)) {
+		return e->value;
+	}
+	if (auto e = dynamic_cast<StringLiteral*>(node)) {
+		return e->value;
+	}
+	if (auto e = dynamic_cast<ConcatExpression*>(node))
+	{
+		String result;
+		for (auto &item : e->list)
+		{
+			auto value = evaluate_constant(item.get());
+			if (!std::holds_alternative<String>(value)) {
+				return Constant();
+			}
+			result.append(std::get<String>(value));
+		}
+		return result;
+	}
+	if (auto e = dynamic_cast<UnaryExpression*>(node))
+	{
+		if (e->op != Lexeme::OpMinus) {
+			return Constant();
+		}
+		auto value = evaluate_constant(e->expr.get());
+		if (std::holds_alternative<intptr_t>(value))
+		{
+			auto x = std::get<intptr_t>(value);
+			if (x == (std::numeric_limits<intptr_t>::min)()) return Constant();
+			return -x;
+		}
+		if (std::holds_alternative<double>(value)) {
+			return -std::get<double>(value);
+		}
+		return Constant();
+	}
+
+	auto e = dynamic_cast<BinaryExpression*>(node);
+	if (!e) return Constant();
+
+	switch (e->op)
+	{
+		case Lexeme::OpPlus:
+		case Lexeme::OpMinus:
+		case Lexeme::OpStar:
+		case Lexeme::OpSlash:
+		case Lexeme::OpPower:
+		case Lexeme::OpMod:
+			break;
+		default:
+			return Constant();
+	}
+
+	auto v1 = evaluate_constant(e->lhs.get());
+	if (!(std::holds_alternative<intptr_t>(v1) || std::holds_alternative<double>(v1))) return Constant();
+	auto v2 = evaluate_constant(e->rhs.get());
+	if (!(std::holds_alternative<intptr_t>(v2) || std::holds_alternative<double>(v2))) return Constant();
+
+	if (std::holds_alternative<intptr_t>(v1) && std::holds_alternative<intptr_t>(v2) && e->op != Lexeme::OpSlash && e->op != Lexeme::OpPower)
+	{
+		constexpr auto max = (std::numeric_limits<intptr_t>::max)();
+		constexpr auto min = (std::numeric_limits<intptr_t>::min)();
+		auto x = std::get<intptr_t>(v1);
+		auto y = std::get<intptr_t>(v2);
+
+		switch (e->op)
+		{
+			case Lexeme::OpPlus:
+				// Same check as in the runtime.
+				if (x == min || y == min || ((x < 0) == (y < 0) && std::abs(y) > max - std::abs(x))) return Constant();
+				return x + y;
+			case Lexeme::OpMinus:
+				if ((y < 0 && x > max + y) || (y > 0 && x < min + y)) return Constant();
+				return x - y;
+			case Lexeme::OpStar:
+				if (x != 0 && y != 0 && (x > 0 ? (y > 0 ? x > max / y : y < min / x) : (y > 0 ? x < min / y : y < max / x))) {
+					return Constant();
+				}
+				return x * y;
+			default:
+				if (y == 0 || (y == -1 && x == min)) return Constant();
+				return x % y;
+		}
 	}
+
+	auto x = std::holds_alternative<intptr_t>(v1) ? double(std::get<intptr_t>(v1)) : std::get<double>(v1);
+	auto y = std::holds_alternative<intptr_t>(v2) ? double(std::get<intptr_t>(v2)) : std::get<double>(v2);
+	double result;
+	std::feclearexcept(FE_ALL_EXCEPT);
+
+	switch (e->op)
+	{
+		case Lexeme::OpPlus:
+			result = x + y;
+			break;
+		case Lexeme::OpMinus:
+			result = x - y;
+			break;
+		case Lexeme::OpStar:
+			result = x * y;
+			break;
+		case Lexeme::OpSlash:
+			result = x / y;
+			break;
+		case Lexeme::OpPower:
+			result = pow(x, y);
+			break;
+		default:
+			return std::fmod(x, y);
+	}
+
+	if (std::fetestexcept(FE_OVERFLOW | FE_UNDERFLOW | FE_DIVBYZERO | FE_INVALID)) {
+		return Constant();
+	}
+
+	return result;
 }
 
 void Compiler::visit_float(FloatLiteral *node)
@@ -142,6 +299,16 @@ void Compiler::visit_unary(UnaryExpression *node)
 {
 	bool noop = false;
 
+	if (optimize && node->op == Lexeme::OpMinus && !node->expr->is_literal())
+	{
+		auto value = evaluate_constant(node);
+		if (!std::holds_alternative<std::monostate>(value))
+		{
+			emit_constant(node->line_no, value);
+			return;
+		}
+	}
+
 	// Convert negative numeric literals in place.
 	if (node->op == Lexeme::OpMinus)
 	{
@@ -232,6 +399,15 @@ void Compiler::visit_binary(BinaryExpression *node)
 	}
 
 	// Handle other operators.
+	if (optimize)
+	{
+		auto value = evaluate_constant(node);
+		if (!std::holds_alternative<std::monostate>(value))
+		{
+			emit_constant(node->line_no, value);
+			return;
+		}
+	}
 	node->lhs->visit(*this);
 	node->rhs->visit(*this);
 
@@ -355,8 +531,8 @@ void Compiler::visit_call(CallExpression *node)
 	Instruction flag = node->return_reference ? (1 << 9) : 0;
 	auto narg = Instruction(node->args.size());
 
-	// Finally, make the call.
-	EMIT(Opcode::Call, narg|flag);
+	// Finally, make the call. The last operand identifies the call site's inline cache.
+	EMIT(Opcode::Call, narg|flag, code->add_call_site());
 
 	// Discard result if it's not used.
 	if (node->discard_result) {
@@ -563,10 +739,50 @@ void Compiler::visit_assert_statement(AssertStatement *node)
 
 void Compiler::visit_concat_expression(ConcatExpression *node)
 {
-	for (auto &e : node->list) {
+	if (!optimize)
+	{
+		for (auto &e : node->list) {
+			e->visit(*this);
+		}
+		EMIT(Opcode::Concat, Instruction(node->list.size()));
+		return;
+	}
+
+	// Merge adjacent constant strings.
+	Instruction count = 0;
+	Constant value;
+
+	for (auto &e : node->list)
+	{
+		auto item = evaluate_constant(e.get());
+
+		if (std::holds_alternative<String>(item))
+		{
+			if (std::holds_alternative<String>(value)) {
+				std::get<String>(value).append(std::get<String>(item));
+			}
+			else {
+				value = std::move(item);
+			}
+			continue;
+		}
+		if (std::holds_alternative<String>(value))
+		{
+			emit_constant(node->line_no, value);
+			value = Constant();
+			count++;
+		}
 		e->visit(*this);
+		count++;
+	}
+
+	if (std::holds_alternative<String>(value))
+	{
+		emit_constant(node->line_no, value);
+		if (count == 0) return; // the whole expression is a constant string
+		count++;
 	}
-	EMIT(Opcode::Concat, Instruction(node->list.size()));
+	EMIT(Opcode::Concat, count);
 }
 
 void Compiler::visit_if_condition(IfCondition *node)
@@ -893,6 +1109,7 @@ void Compiler::visit_routine(RoutineDefinition *node)
 	EMIT(Opcode::Return);
 	// Fix number of locals.
 	code->backpatch_instruction(frame_offset, (Instruction)routine->local_count());
+	optimize_routine();
 	close_scope(previous_scope);
 
 	auto routine_index = outer_routine->add_routine(routine);
@@ -23,6 +23,7 @@
 #define PHONOMETRICA_COMPILER_HPP
 
 #include <memory>
+#include <variant>
 #include <vector>
 #include <phon/runtime/compiler/ast.hpp>
 
@@ -34,7 +35,8 @@ public:
 
 	explicit Compiler(Runtime *rt);
 
-	Handle<Closure> compile(AutoAst ast);
+	// If optimize is true, constant expressions are folded and the bytecode is passed to the optimizer.
+	Handle<Closure> compile(AutoAst ast, bool optimize = true);
 
 	void visit_constant(ConstantLiteral *node) override;
 	void visit_integer(IntegerLiteral *node) override;
@@ -71,9 +73,20 @@ public:
 
 private:
 
+	// Value of an expression that can be computed at compile time. std::monostate means that the expression is not constant.
+	using Constant = std::variant<std::monostate, intptr_t, double, String>;
+
 	// Routine being compiled.
 	std::shared_ptr<Routine> routine;
 
+	Constant evaluate_constant(Ast *node) const;
+
+	void emit_constant(int line_no, const Constant &value);
+
+	void emit_integer(int line_no, intptr_t value);
+
+	void optimize_routine();
+
 	void initialize();
 
 	void finalize();
@@ -129,6 +142,9 @@ private:
 	bool visiting_indexed_lhs = false;
 
 	bool visiting_assigned_lhs = false;
+
+	// Whether optimizations are enabled for the current compilation.
+	bool optimize = true;
 };
 
 } // namespace phonometrica
@@ -0,0 +1,356 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <cassert>
+#include <phon/error.hpp>
+#include <phon/runtime/compiler/optimizer.hpp>
+
+namespace phonometrica {
+
+void Optimizer::run()
+{
+	decode();
+	bool changed = true;
+
+	while (changed)
+	{
+		changed = thread_jumps();
+		changed |= fuse_instructions();
+		changed |= remove_unreachable_code();
+		changed |= remove_useless_jumps();
+	}
+
+	encode();
+}
+
+bool Optimizer::is_jump(Opcode op)
+{
+	switch (op)
+	{
+		case Opcode::Jump:
+		case Opcode::JumpFalse:
+		case Opcode::JumpFalseAnd:
+		case Opcode::JumpTrue:
+		case Opcode::JumpTrueOr:
+		case Opcode::CompareJump:
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool Optimizer::is_comparison(Opcode op)
+{
+	switch (op)
+	{
+		case Opcode::Equal:
+		case Opcode::NotEqual:
+		case Opcode::Less:
+		case Opcode::LessEqual:
+		case Opcode::Greater:
+		case Opcode::GreaterEqual:
+			return true;
+		default:
+			return false;
+	}
+}
+
+void Optimizer::decode()
+{
+	auto size = code.code.size();
+	std::vector<int> line_numbers;
+	line_numbers.reserve(size);
+	for (auto &ln : code.lines) {
+		line_numbers.insert(line_numbers.end(), ln.second, ln.first);
+	}
+	assert(line_numbers.size() == size);
+
+	// Map offsets to instruction indexes. A jump may target the end of the code.
+	std::vector<int> indexes(size + 1, -1);
+	std::vector<int> addresses;
+
+	for (size_t offset = 0; offset < size; )
+	{
+		Op op;
+		op.opcode = static_cast<Opcode>(code.code[offset]);
+		op.line = line_numbers[offset];
+		auto ptr = code.data() + offset + 1;
+		int count = Code::get_instruction_size(op.opcode) - 1;
+		int address = -1;
+
+		if (is_jump(op.opcode))
+		{
+			count -= Code::IntSerializer::IntSize;
+			for (int i = 0; i < count; i++) {
+				op.operands[i] = *ptr++;
+			}
+			address = Code::read_integer(ptr);
+		}
+		else
+		{
+			assert(count <= 3);
+			for (int i = 0; i < count; i++) {
+				op.operands[i] = *ptr++;
+			}
+		}
+		indexes[offset] = int(ops.size());
+		addresses.push_back(address);
+		ops.push_back(op);
+		offset += Code::get_instruction_size(op.opcode);
+	}
+	indexes[size] = int(ops.size());
+
+	for (size_t i = 0; i < ops.size(); i++)
+	{
+		if (addresses[i] >= 0)
+		{
+			ops[i].target = indexes[addresses[i]];
+			if (ops[i].target < 0) {
+				throw error("[Internal error] Invalid jump address %", addresses[i]);
+			}
+		}
+	}
+}
+
+void Optimizer::encode()
+{
+	// Compute the offset of each instruction. Dead instructions get the offset of the next live instruction.
+	std::vector<int> offsets(ops.size() + 1);
+	int offset = 0;
+
+	for (size_t i = 0; i < ops.size(); i++)
+	{
+		offsets[i] = offset;
+		if (ops[i].live) offset += Code::get_instruction_size(ops[i].opcode);
+	}
+	offsets[ops.size()] = offset;
+
+	Code result;
+
+	for (auto &op : ops)
+	{
+		if (!op.live) continue;
+		result.append(op.line, op.opcode);
+		int count = Code::get_instruction_size(op.opcode) - 1;
+		if (is_jump(op.opcode)) count -= Code::IntSerializer::IntSize;
+
+		for (int i = 0; i < count; i++) {
+			result.append(op.line, op.operands[i]);
+		}
+		if (is_jump(op.opcode))
+		{
+			Code::IntSerializer s(offsets[op.target]);
+			for (auto ins : s.ins) {
+				result.append(op.line, ins);
+			}
+		}
+	}
+
+	result.call_sites = std::move(code.call_sites);
+	code = std::move(result);
+}
+
+int Optimizer::next(int i) const
+{
+	return resolve(i + 1);
+}
+
+int Optimizer::resolve(int i) const
+{
+	while (i < int(ops.size()) && !ops[i].live) i++;
+	return i;
+}
+
+void Optimizer::find_targets()
+{
+	targets.assign(ops.size() + 1, 0);
+
+	for (auto &op : ops)
+	{
+		if (op.live && op.target >= 0) {
+			targets[resolve(op.target)]++;
+		}
+	}
+}
+
+bool Optimizer::thread_jumps()
+{
+	bool changed = false;
+	int n = int(ops.size());
+
+	for (auto &op : ops)
+	{
+		if (!op.live || op.target < 0) continue;
+
+		// Follow chains of unconditional jumps. The counter guards against infinite loops.
+		int t = resolve(op.target);
+		for (int hops = 0; t < n && ops[t].opcode == Opcode::Jump && hops < n; hops++)
+		{
+			t = resolve(ops[t].target);
+		}
+		if (t != op.target)
+		{
+			op.target = t;
+			changed = true;
+		}
+
+		// Jumping to a return is the same as returning.
+		if (op.opcode == Opcode::Jump && t < n && ops[t].opcode == Opcode::Return)
+		{
+			op.opcode = Opcode::Return;
+			op.target = -1;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+bool Optimizer::fuse_instructions()
+{
+	bool changed = false;
+	int n = int(ops.size());
+	find_targets();
+
+	for (int i = 0; i < n; i = next(i))
+	{
+		auto &op = ops[i];
+		int j = next(i);
+		// We can only fuse the instruction with the next one if the latter is not the target of a jump.
+		if (j == n || targets[j] > 0) continue;
+		auto &op2 = ops[j];
+		bool conditional = (op2.opcode == Opcode::JumpFalse || op2.opcode == Opcode::JumpTrue);
+
+		if (conditional && is_comparison(op.opcode))
+		{
+			op.operands[0] = Instruction(op.opcode);
+			op.operands[1] = (op2.opcode == Opcode::JumpTrue);
+			op.opcode = Opcode::CompareJump;
+			op.target = op2.target;
+			op2.live = false;
+			changed = true;
+		}
+		else if (conditional && op.opcode == Opcode::Not)
+		{
+			op.opcode = (op2.opcode == Opcode::JumpTrue) ? Opcode::JumpFalse : Opcode::JumpTrue;
+			op.target = op2.target;
+			op2.live = false;
+			changed = true;
+		}
+		else if (conditional && (op.opcode == Opcode::PushBoolean || op.opcode == Opcode::PushTrue || op.opcode == Opcode::PushFalse))
+		{
+			// The condition is known at compile time (e.g. "while true").
+			bool value = (op.opcode == Opcode::PushBoolean) ? bool(op.operands[0]) : (op.opcode == Opcode::PushTrue);
+			if (value == (op2.opcode == Opcode::JumpTrue))
+			{
+				op.opcode = Opcode::Jump;
+				op.target = op2.target;
+			}
+			else
+			{
+				op.live = false;
+			}
+			op2.live = false;
+			changed = true;
+		}
+		else if (op.opcode == Opcode::GetLocal && op2.opcode == Opcode::PushSmallInt)
+		{
+			// GetLocal i, PushSmallInt n, Add, SetLocal i -> AddLocalSmallInt i n
+			int k = next(j);
+			int l = (k < n) ? next(k) : n;
+			if (l < n && targets[k] == 0 && targets[l] == 0 && ops[k].opcode == Opcode::Add &&
+				ops[l].opcode == Opcode::SetLocal && ops[l].operands[0] == op.operands[0])
+			{
+				op.opcode = Opcode::AddLocalSmallInt;
+				op.operands[1] = op2.operands[0];
+				op2.live = ops[k].live = ops[l].live = false;
+				changed = true;
+			}
+		}
+	}
+
+	return changed;
+}
+
+bool Optimizer::remove_unreachable_code()
+{
+	int n = int(ops.size());
+	std::vector<bool> reachable(n, false);
+	std::vector<int> stack;
+	if (n > 0) stack.push_back(resolve(0));
+
+	while (!stack.empty())
+	{
+		int i = stack.back();
+		stack.pop_back();
+
+		while (i < n && !reachable[i])
+		{
+			reachable[i] = true;
+			auto &op = ops[i];
+			if (op.target >= 0) stack.push_back(resolve(op.target));
+			if (op.opcode == Opcode::Jump || op.opcode == Opcode::Return || op.opcode == Opcode::Throw) break;
+			i = next(i);
+		}
+	}
+
+	bool changed = false;
+
+	for (int i = 0; i < n; i++)
+	{
+		if (ops[i].live && !reachable[i])
+		{
+			ops[i].live = false;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+bool Optimizer::remove_useless_jumps()
+{
+	bool changed = false;
+	int n = int(ops.size());
+
+	for (int i = resolve(0); i < n; i = next(i))
+	{
+		auto &op = ops[i];
+		if (op.target < 0 || resolve(op.target) != next(i)) continue;
+
+		if (op.opcode == Opcode::Jump)
+		{
+			op.live = false;
+			changed = true;
+		}
+		else if (op.opcode == Opcode::JumpFalse || op.opcode == Opcode::JumpTrue)
+		{
+			// The condition must still be popped.
+			op.opcode = Opcode::Pop;
+			op.target = -1;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+} // namespace phonometrica
@@ -0,0 +1,90 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: peephole optimizer for bytecode. It removes dead code and useless jumps, and fuses common                  *
+ * instruction sequences into superinstructions.                                                                       *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_OPTIMIZER_HPP
+#define PHONOMETRICA_OPTIMIZER_HPP
+
+#include <phon/runtime/code.hpp>
+
+namespace phonometrica {
+
+// The optimizer rewrites the bytecode of a routine once it has been fully compiled. Instructions are decoded into a list
+// in which jump addresses are replaced by the index of their target, transformed until no more changes can be made,
+// and encoded back. All transformations preserve the semantics of the original code, including error reporting.
+class Optimizer final
+{
+public:
+
+	explicit Optimizer(Code &code) : code(code) { }
+
+	void run();
+
+private:
+
+	struct Op
+	{
+		Opcode opcode;
+
+		// Operands, except for jump addresses.
+		Instruction operands[3];
+
+		int line;
+
+		// For jumps, index of the target instruction.
+		int target = -1;
+
+		bool live = true;
+	};
+
+	void decode();
+
+	void encode();
+
+	int next(int i) const;
+
+	int resolve(int i) const;
+
+	void find_targets();
+
+	bool fuse_instructions();
+
+	bool thread_jumps();
+
+	bool remove_unreachable_code();
+
+	bool remove_useless_jumps();
+
+	static bool is_jump(Opcode op);
+
+	static bool is_comparison(Opcode op);
+
+	Code &code;
+
+	std::vector<Op> ops;
+
+	// Number of jumps to each instruction.
+	std::vector<int> targets;
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_OPTIMIZER_HPP
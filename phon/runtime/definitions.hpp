@@ -47,7 +47,7 @@
 
 
 #ifdef PHON_EMBED_SCRIPTS
-#define run_script(runtime, name) runtime.do_string(name##_script)
+#define run_script(runtime, name) runtime.do_script(#name, name##_script)
 #define get_script_content(runtime, name) name##_script
 #else
 #define run_script(rt, name) rt.do_file(Settings::get_std_script(rt, #name))
@@ -138,28 +138,32 @@ static Variant array_set_item2(Runtime &rt, std::span<Variant> args)
 
 static Variant array_min(Runtime &, std::span<Variant> args)
 {
-	auto minimum = (std::numeric_limits<double>::max)();
-	auto &array = cast<Array<double>>(args[0]);
-	for (intptr_t i = 1; i <= array.size(); i++)
-	{
-		auto value = array[i];
-		if (value < minimum) minimum = value;
-	}
-
-	return minimum;
+	return minimum(cast<Array<double>>(args[0]));
 }
 
 static Variant array_max(Runtime &, std::span<Variant> args)
 {
-	auto maximum = (std::numeric_limits<double>::min)();
-	auto &array = cast<Array<double>>(args[0]);
-	for (intptr_t i = 1; i <= array.size(); i++)
-	{
-		auto value = array[i];
-		if (value > maximum) maximum = value;
-	}
+	return maximum(cast<Array<double>>(args[0]));
+}
+
+static Variant array_sum(Runtime &, std::span<Variant> args)
+{
+	return sum(cast<Array<double>>(args[0]));
+}
+
+static Variant array_mean(Runtime &, std::span<Variant> args)
+{
+	return mean(cast<Array<double>>(args[0]));
+}
 
-	return maximum;
+static Variant array_all(Runtime &, std::span<Variant> args)
+{
+	return all_true(cast<Array<double>>(args[0]));
+}
+
+static Variant array_any(Runtime &, std::span<Variant> args)
+{
+	return any_true(cast<Array<double>>(args[0]));
 }
 
 static Variant array_clear(Runtime &, std::span<Variant> args)
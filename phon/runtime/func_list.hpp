@@ -25,6 +25,7 @@
 #include <algorithm>
 #include <random>
 #include <phon/runtime.hpp>
+#include <phon/runtime/task_pool.hpp>
 
 namespace phonometrica {
 
@@ -373,6 +374,28 @@ static Variant list_sorted_insert(Runtime &, std::span<Variant> args)
 	return Variant();
 }
 
+static Variant list_parallel_map1(Runtime &rt, std::span<Variant> args)
+{
+	auto &lst = cast<List>(args[0]);
+	auto &func = cast<Function>(args[1]);
+	TaskPool pool(rt);
+
+	return pool.map(func, lst);
+}
+
+static Variant list_parallel_map2(Runtime &rt, std::span<Variant> args)
+{
+	auto &lst = cast<List>(args[0]);
+	auto &func = cast<Function>(args[1]);
+	auto nthread = cast<intptr_t>(args[2]);
+	if (nthread <= 0) {
+		throw error("[Index error] Number of threads must be positive, got %", nthread);
+	}
+	TaskPool pool(rt, int(nthread));
+
+	return pool.map(func, lst);
+}
+
 } // namespace phonometrica
 
 #endif // PHONOMETRICA_FUNC_LIST_HPP
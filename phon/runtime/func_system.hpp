@@ -265,6 +265,20 @@ static Variant system_nativize(Runtime &, std::span<Variant> args)
 	return fs::nativize(path);
 }
 
+static Variant system_gc_stats(Runtime &rt, std::span<Variant>)
+{
+	auto &stats = rt.gc_stats();
+	Table::Storage tab;
+	tab.insert({ String("collections"), stats.collections });
+	tab.insert({ String("examined"), stats.examined });
+	tab.insert({ String("freed"), stats.freed });
+	tab.insert({ String("time"), stats.time });
+	tab.insert({ String("pending"), rt.gc_pending() });
+	tab.insert({ String("threshold"), rt.gc_limit() });
+
+	return make_handle<Table>(&rt, std::move(tab));
+}
+
 } // namespace phonometrica
 
 
@@ -19,6 +19,7 @@
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
+#include <atomic>
 #include <phon/runtime/function.hpp>
 #include <phon/runtime.hpp>
 
@@ -112,7 +113,10 @@ Instruction Routine::add_float_constant(double n)
 
 Instruction Routine::add_string_constant(String s)
 {
-	return add_constant(string_pool, std::move(s));
+	auto i = add_constant(string_pool, std::move(s));
+	global_slots.resize(string_pool.size(), -1);
+
+	return i;
 }
 
 Instruction Routine::add_local(const String &name, int scope, int depth)
@@ -243,6 +247,7 @@ void Function::add_closure(Handle<Closure> c)
 			{
 				// Overwrite the current closure with the new one.
 				cand = std::move(c);
+				version = new_version();
 				return;
 			}
 		}
@@ -255,6 +260,8 @@ void Function::add_closure(Handle<Closure> c)
 			max_argc = r->arg_count();
 		}
 
+		version = new_version();
+
 		// Sort routines by number of parameters
 		argc = c->routine->arg_count();
 		for (auto it = closures.begin(); it != closures.end(); it++)
@@ -320,6 +327,47 @@ Handle<Closure> Function::find_closure(std::span<Variant> args)
 	return candidate;
 }
 
+Handle<Closure> Function::find_closure(std::span<Variant> args, CallCache &cache)
+{
+	if (args.size() > CallCache::MaxArgs) {
+		return find_closure(args);
+	}
+
+	// Overload resolution only depends on the arguments' classes, except for null values which match any type.
+	Class *classes[CallCache::MaxArgs];
+	for (intptr_t i = 0; i < args.size(); i++) {
+		classes[i] = args[i].is_null() ? nullptr : args[i].get_class();
+	}
+
+	for (auto &entry : cache.entries)
+	{
+		if (entry.version == version && std::equal(classes, classes + args.size(), entry.classes)) {
+			return Handle<Closure>(static_cast<TObject<Closure>*>(entry.closure));
+		}
+	}
+
+	auto c = find_closure(args);
+
+	if (c)
+	{
+		auto &entry = cache.entries[cache.next];
+		cache.next = (cache.next + 1) % CallCache::MaxEntries;
+		entry.version = version;
+		entry.closure = c.object();
+		std::copy(classes, classes + args.size(), entry.classes);
+	}
+
+	return c;
+}
+
+uint64_t Function::new_version()
+{
+	// Versions are shared by all functions and never reused, so that an entry resolved against one function can never
+	// match another one.
+	static std::atomic<uint64_t> counter(0);
+	return ++counter;
+}
+
 Function::Function(Runtime *rt, const String &name, NativeCallback cb, std::initializer_list<Handle<Class>> sig, ParamBitset ref_flags) :
 	Function(name)
 {
@@ -70,6 +70,8 @@ protected:
 
 	friend class Function;
 	friend class Closure;
+	friend class BytecodeCache;
+	friend class TaskPool;
 
 	// Type of positional arguments.
 	std::vector<Handle<Class>> signature;
@@ -165,6 +167,8 @@ private:
 	friend class Runtime;
 	friend class Compiler;
 	friend class Closure;
+	friend class BytecodeCache;
+	friend class TaskPool;
 
 	// Bytecode.
 	Code code;
@@ -196,6 +200,9 @@ private:
 	std::vector<String> string_pool;
 	std::vector<std::shared_ptr<Routine>> routine_pool;
 
+	// Slot of the global variable named by each string constant, or -1 if it hasn't been resolved yet.
+	std::vector<intptr_t> global_slots;
+
 	// Local variables.
 	std::vector<Local> locals;
 
@@ -223,6 +230,7 @@ private:
 
 	friend class Runtime;
 	friend class Function;
+	friend class TaskPool;
 
 	static void traverse(Routine &r, const GCCallback &callback);
 
@@ -259,6 +267,9 @@ public:
 
 	Handle<Closure> find_closure(std::span<Variant> args);
 
+	// Same as above, but try the call site's inline cache first and update it on a miss.
+	Handle<Closure> find_closure(std::span<Variant> args, CallCache &cache);
+
 	ParamBitset reference_flags() const { return ref_flags; }
 
 	void traverse(const GCCallback &callback);
@@ -267,6 +278,7 @@ private:
 
 	friend class Variant;
 	friend class Runtime;
+	friend class TaskPool;
 
 	// Name provided when the function was declared. Anonymous functions don't have a name.
 	String _name;
@@ -278,6 +290,11 @@ private:
 
 	// Maximum number of arguments that this function allows.
 	int max_argc = 0;
+
+	// Unique tag which changes whenever an overload is added or replaced. This is used to invalidate inline caches.
+	uint64_t version = new_version();
+
+	static uint64_t new_version();
 };
 
 
@@ -166,4 +166,31 @@ bool FileIterator::at_end() const
 {
 	return file->at_end();
 }
+
+
+//---------------------------------------------------------------------------------------------------------------------
+
+ArrayIterator::ArrayIterator(Variant v, bool ref_val) : Iterator(std::move(v), ref_val)
+{
+	if (ref_val) {
+		throw error("[Reference error] Cannot take a reference to an element in an array.\nHint: take the second loop variable by value, not by reference");
+	}
+	array = &raw_cast<Array<double>>(object.resolve());
+}
+
+Variant ArrayIterator::get_key()
+{
+	return pos;
+}
+
+Variant ArrayIterator::get_value()
+{
+	return next_value();
+}
+
+bool ArrayIterator::at_end() const
+{
+	return pos > array->size();
+}
+
 } // namespace phonometrica
\ No newline at end of file
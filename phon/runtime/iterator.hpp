@@ -151,6 +151,30 @@ private:
 	intptr_t pos = 1;
 };
 
+
+//---------------------------------------------------------------------------------------------------------------------
+
+// Iterates over the elements of a numeric array, in storage order.
+class ArrayIterator : public Iterator
+{
+public:
+
+	ArrayIterator(Variant v, bool ref_val);
+
+	Variant get_key() override;
+
+	Variant get_value() override;
+
+	bool at_end() const override;
+
+	double next_value() { return (*array)[pos++]; }
+
+private:
+
+	Array<double> *array;
+	intptr_t pos = 1;
+};
+
 } // namespace phonometrica
 
 #endif // PHONOMETRICA_ITERATOR_HPP
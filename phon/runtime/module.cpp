@@ -27,35 +27,55 @@ namespace phonometrica {
 
 Variant &Module::get(const String &key)
 {
-	auto it = members.find(key);
+	auto i = find_slot(key);
 
-	if (it == members.end()) {
+	if (i < 0) {
 		throw error("[Index error] Missing key in module \"%\": \"%\"", _name, key);
 	}
 
-	return it->second;
+	return members[i];
 }
 
 bool Module::contains(const String &key) const
 {
-	return members.contains(key);
+	return slots.contains(key);
 }
 
 void Module::define(const String &name, Variant value)
 {
-	members[name] = std::move(value);
+	(*this)[name] = std::move(value);
+}
+
+intptr_t Module::find_slot(const String &key) const
+{
+	auto it = slots.find(key);
+	return (it == slots.end()) ? -1 : it->second;
+}
+
+intptr_t Module::add_slot(const String &key)
+{
+	auto i = find_slot(key);
+
+	if (i < 0)
+	{
+		i = intptr_t(members.size());
+		members.emplace_back();
+		slots.insert({key, i});
+	}
+
+	return i;
 }
 
 void Module::traverse(const GCCallback &callback)
 {
-	for (auto &pair : members) {
-		pair.second.traverse(callback);
+	for (auto &v : members) {
+		v.traverse(callback);
 	}
 }
 
 void Module::define(Runtime *rt, const String &name, NativeCallback cb, std::initializer_list<Handle<Class>> sig, ParamBitset ref)
 {
-	members[name] = make_handle<Function>(rt, rt, name, std::move(cb), sig, ref);
+	(*this)[name] = make_handle<Function>(rt, rt, name, std::move(cb), sig, ref);
 }
 
 } // namespace phonometrica
\ No newline at end of file
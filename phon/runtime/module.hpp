@@ -31,10 +31,6 @@ class Module final
 {
 public:
 
-	using Storage = Dictionary<Variant>;
-	using iterator = Storage::iterator;
-	using value_type = Storage::value_type;
-
 	explicit Module(const String &name) : _name(name) { }
 
 	Module(const Module &) = delete;
@@ -42,15 +38,7 @@ public:
 
 	String name() const { return _name; }
 
-	Variant &operator[](const String &key) { return members[key]; }
-
-	iterator find(const String &key) { return members.find(key); }
-
-	iterator begin() { return members.begin(); }
-
-	iterator end() { return members.end(); }
-
-	void insert(value_type v) { members.insert(std::move(v)); }
+	Variant &operator[](const String &key) { return members[add_slot(key)]; }
 
 	Variant &get(const String &key);
 
@@ -62,13 +50,24 @@ public:
 
 	void traverse(const GCCallback &callback);
 
+	// Members are stored in slots, which are numbered in order of definition and are never removed. This lets the
+	// runtime resolve a name once and then access the member directly.
+	intptr_t find_slot(const String &key) const;
+
+	intptr_t add_slot(const String &key);
+
+	Variant &get_slot(intptr_t i) { return members[i]; }
+
 private:
 
 	friend class Runtime;
 
 	String _name;
 
-	Storage members;
+	// Map names to slots.
+	Dictionary<intptr_t> slots;
+
+	std::vector<Variant> members;
 };
 
 namespace meta {
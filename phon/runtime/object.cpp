@@ -193,6 +193,12 @@ Collectable::Collectable(Class *klass, Runtime *runtime) :
 
 }
 
+bool Collectable::is_candidate() const
+{
+	// A lone candidate has no neighbour but is the root of the list.
+	return next != nullptr || previous != nullptr || (runtime && runtime->gc_root == this);
+}
+
 Collectable::~Collectable()
 {
 	if (is_candidate() && runtime)
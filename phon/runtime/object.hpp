@@ -225,7 +225,7 @@ public:
 
 	~Collectable();
 
-	bool is_candidate() const { return next != nullptr || previous != nullptr; }
+	bool is_candidate() const;
 
 private:
 
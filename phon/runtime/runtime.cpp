@@ -20,10 +20,12 @@
  ***********************************************************************************************************************/
 
 #include <cfenv>
+#include <chrono>
 #include <cstdio>
 #include <ctime>
 #include <iomanip>
 #include <phon/runtime/runtime.hpp>
+#include <phon/runtime/bytecode_cache.hpp>
 #include <phon/regex.hpp>
 #include <phon/file.hpp>
 #include <phon/utils/helpers.hpp>
@@ -39,6 +41,23 @@
 #	define trace_op()
 #endif
 
+// With threaded dispatch, each handler jumps directly to the handler of the next instruction through a table of label
+// addresses, so that every opcode gets its own indirect branch instead of sharing the switch's. This relies on the
+// "labels as values" extension, so we fall back to the switch with other compilers.
+#if PHON_THREADED_DISPATCH && (defined(__GNUC__) || defined(__clang__))
+#	define PHON_COMPUTED_GOTO 1
+#	define SWITCH() DISPATCH();
+#	define CASE(op) op_##op
+#	define DEFAULT op_invalid
+#	define DISPATCH() do { assert(*ip < OPCODE_COUNT); goto *dispatch_table[*ip++]; } while (false)
+#else
+#	define PHON_COMPUTED_GOTO 0
+#	define SWITCH() switch (static_cast<Opcode>(*ip++))
+#	define CASE(op) case Opcode::op
+#	define DEFAULT default
+#	define DISPATCH() break
+#endif
+
 
 namespace phonometrica {
 
@@ -78,7 +97,7 @@ phonometrica::Runtime::~Runtime()
 	for (auto &cls : classes) {
 		cls->finalize();
 	}
-	collect();
+	full_collect();
 
 	for (size_t i = classes.size(); i-- > 2; )
 	{
@@ -87,11 +106,19 @@ phonometrica::Runtime::~Runtime()
 	}
 	classes[0].drop()->release();
 	classes[1].drop()->release();
+
+	for (auto reset : descriptor_resets) {
+		reset();
+	}
 }
 
 void Runtime::add_candidate(Collectable *obj)
 {
-	if (is_full()) {
+	// The object may already be buffered if a collection cycle found it alive but didn't reach it in the list.
+	if (obj->is_candidate()) {
+		return;
+	}
+	if (is_full() && !gc_running) {
 		collect();
 	}
 	assert(obj->previous == nullptr);
@@ -103,12 +130,18 @@ void Runtime::add_candidate(Collectable *obj)
 	if (old_root != nullptr) {
 		old_root->previous = obj;
 	}
+	else {
+		gc_tail = obj;
+	}
 	gc_root = obj;
 	gc_count++;
 }
 
 void Runtime::remove_candidate(Collectable *obj)
 {
+	if (obj == gc_tail) {
+		gc_tail = obj->previous;
+	}
 	if (obj == gc_root)
 	{
 		assert(obj->previous == nullptr);
@@ -175,6 +208,7 @@ void Runtime::create_builtins()
 	create_type<StringIterator>("Iterator", raw_object_class, Class::Index::StringIterator);
 	create_type<FileIterator>("Iterator", raw_object_class, Class::Index::FileIterator);
 	create_type<RegexIterator>("Iterator", raw_object_class, Class::Index::RegexIterator);
+	create_type<ArrayIterator>("Iterator", raw_object_class, Class::Index::ArrayIterator);
 
 	// Sanity checks
 	assert(object_class.object()->get_class() != nullptr);
@@ -317,11 +351,27 @@ void Runtime::negate()
 	}
 }
 
+static ArrayOp get_array_op(char op)
+{
+	switch (op)
+	{
+		case '+':
+			return ArrayOp::Add;
+		case '-':
+			return ArrayOp::Subtract;
+		case '*':
+			return ArrayOp::Multiply;
+		case '/':
+			return ArrayOp::Divide;
+		default:
+			return ArrayOp::Power;
+	}
+}
+
 void Runtime::math_op(char op)
 {
 	auto &v1 = peek(-2).resolve();
 	auto &v2 = peek(-1).resolve();
-	std::feclearexcept(FE_ALL_EXCEPT);
 
 	if (v1.is_number() && v2.is_number())
 	{
@@ -344,8 +394,7 @@ void Runtime::math_op(char op)
 					auto x = v1.get_number();
 					auto y = v2.get_number();
 					pop(2);
-					auto result = x + y;
-					check_float_error();
+					auto result = float_op('+', x, y);
 					push(result);
 				}
 				return;
@@ -364,8 +413,7 @@ void Runtime::math_op(char op)
 					auto x = v1.get_number();
 					auto y = v2.get_number();
 					pop(2);
-					auto result = x - y;
-					check_float_error();
+					auto result = float_op('-', x, y);
 					push(result);
 				}
 				return;
@@ -384,8 +432,7 @@ void Runtime::math_op(char op)
 					auto x = v1.get_number();
 					auto y = v2.get_number();
 					pop(2);
-					auto result = x * y;
-					check_float_error();
+					auto result = float_op('*', x, y);
 					push(result);
 				}
 				return;
@@ -395,8 +442,7 @@ void Runtime::math_op(char op)
 				auto x = v1.get_number();
 				auto y = v2.get_number();
 				pop(2);
-				auto result = x / y;
-				check_float_error();
+				auto result = float_op('/', x, y);
 				push(result);
 				return;
 			}
@@ -405,8 +451,7 @@ void Runtime::math_op(char op)
 				auto x = v1.get_number();
 				auto y = v2.get_number();
 				pop(2);
-				auto result = pow(x, y);
-				check_float_error();
+				auto result = float_op('^', x, y);
 				push(result);
 				return;
 			}
@@ -432,6 +477,10 @@ void Runtime::math_op(char op)
 				break;
 		}
 	}
+	else if (op != '%' && array_math_op(get_array_op(op)))
+	{
+		return;
+	}
 
 	pop(2);
 	char opstring[2] = { op, '\0' };
@@ -457,6 +506,187 @@ void Runtime::check_float_error()
 	}
 }
 
+static double compute_float(char op, double x, double y)
+{
+	switch (op)
+	{
+		case '+':
+			return x + y;
+		case '-':
+			return x - y;
+		case '*':
+			return x * y;
+		case '/':
+			return x / y;
+		default:
+			return pow(x, y);
+	}
+}
+
+double Runtime::float_op(char op, double x, double y)
+{
+	// Polling the floating-point environment after each operation is expensive, so we first inspect the result: a
+	// normal number cannot signal an error, and neither can a zero which is the exact result of the operation. In the
+	// (rare) remaining cases, the operation is performed again to check the exception flags.
+	auto result = compute_float(op, x, y);
+
+	if (likely(std::isnormal(result)) || (result == 0 && (op == '+' || op == '-' || x == 0 || y == 0))) {
+		return result;
+	}
+	// Prevent the compiler from reusing the result computed above.
+	volatile double vx = x;
+	std::feclearexcept(FE_ALL_EXCEPT);
+	result = compute_float(op, vx, y);
+	check_float_error();
+
+	return result;
+}
+
+bool Runtime::fast_math_op(char op)
+{
+	// Fast path for operations on two integers or two floats: the result is written in place of the first operand.
+	auto &v1 = peek(-2);
+	auto &v2 = peek(-1);
+
+	if (v1.is_integer() && v2.is_integer())
+	{
+		auto &x = raw_cast<intptr_t>(v1);
+		auto y = raw_cast<intptr_t>(v2);
+
+		switch (op)
+		{
+			case '+':
+			{
+				intptr_t sum;
+				if (__builtin_add_overflow(x, y, &sum)) {
+					return false;
+				}
+				x = sum;
+				break;
+			}
+			case '-':
+				x -= y;
+				break;
+			case '*':
+				x *= y;
+				break;
+			default:
+				return false;
+		}
+		pop();
+		return true;
+	}
+	if (v1.is_float() && v2.is_float())
+	{
+		auto &x = raw_cast<double>(v1);
+		x = float_op(op, x, raw_cast<double>(v2));
+		pop();
+		return true;
+	}
+
+	return false;
+}
+
+bool Runtime::array_math_op(ArrayOp op)
+{
+	// Element-wise operation involving an array and an array or a number.
+	auto &v1 = peek(-2).resolve();
+	auto &v2 = peek(-1).resolve();
+	bool x_array = check_type<Array<double>>(v1);
+	bool y_array = check_type<Array<double>>(v2);
+	Array<double> result;
+
+	try
+	{
+		if (x_array && y_array) {
+			result = array_op(op, cast<Array<double>>(v1), cast<Array<double>>(v2));
+		}
+		else if (x_array && v2.is_number()) {
+			result = array_op(op, cast<Array<double>>(v1), v2.get_number());
+		}
+		else if (y_array && v1.is_number()) {
+			result = array_op(op, v1.get_number(), cast<Array<double>>(v2));
+		}
+		else {
+			return false;
+		}
+	}
+	CATCH_ERROR
+	pop(2);
+	push(make_handle<Array<double>>(std::move(result)));
+
+	return true;
+}
+
+static inline bool has_array_operand(const Variant &v1, const Variant &v2)
+{
+	return check_type<Array<double>>(v1) || check_type<Array<double>>(v2);
+}
+
+static ArrayOp get_array_comparison(Opcode op)
+{
+	switch (op)
+	{
+		case Opcode::Less:
+			return ArrayOp::Less;
+		case Opcode::LessEqual:
+			return ArrayOp::LessEqual;
+		case Opcode::Greater:
+			return ArrayOp::Greater;
+		default:
+			return ArrayOp::GreaterEqual;
+	}
+}
+
+bool Runtime::to_condition(const Variant &v)
+{
+	// Arrays can't be used as conditions.
+	try
+	{
+		return v.to_boolean();
+	}
+	CATCH_ERROR
+}
+
+static inline bool compare_numbers(const Variant &v1, const Variant &v2, int &result)
+{
+	if (v1.is_integer() && v2.is_integer())
+	{
+		result = meta::compare(raw_cast<intptr_t>(v1), raw_cast<intptr_t>(v2));
+		return true;
+	}
+	if (v1.is_float() && v2.is_float())
+	{
+		result = meta::compare(raw_cast<double>(v1), raw_cast<double>(v2));
+		return true;
+	}
+
+	return false;
+}
+
+static inline bool equal_values(const Variant &v1, const Variant &v2)
+{
+	if (v1.is_integer() && v2.is_integer()) {
+		return raw_cast<intptr_t>(v1) == raw_cast<intptr_t>(v2);
+	}
+	if (v1.is_float() && v2.is_float()) {
+		return meta::equal(raw_cast<double>(v1), raw_cast<double>(v2));
+	}
+
+	return v1 == v2;
+}
+
+static inline int compare_values(const Variant &v1, const Variant &v2)
+{
+	int result;
+
+	if (compare_numbers(v1, v2, result)) {
+		return result;
+	}
+
+	return v1.compare(v2);
+}
+
 Variant Runtime::interpret(Handle <Closure> &closure)
 {
 	if (current_frame) {
@@ -469,23 +699,106 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 	auto old_ip = ip;
 	ip = routine.code.data();
 
+#if PHON_COMPUTED_GOTO
+	// Handlers must be listed in the same order as in the Opcode enum. The last entry is never reached by valid code.
+	static const void *dispatch_table[] = {
+		&&op_Assert,
+		&&op_Add,
+		&&op_Call,
+		&&op_ClearLocal,
+		&&op_Compare,
+		&&op_Concat,
+		&&op_DecrementLocal,
+		&&op_DefineLocal,
+		&&op_GetField,
+		&&op_GetFieldArg,
+		&&op_GetFieldRef,
+		&&op_GetGlobal,
+		&&op_GetGlobalArg,
+		&&op_GetGlobalRef,
+		&&op_GetIndex,
+		&&op_GetIndexArg,
+		&&op_GetIndexRef,
+		&&op_GetLocal,
+		&&op_GetLocalArg,
+		&&op_GetLocalRef,
+		&&op_GetUniqueGlobal,
+		&&op_GetUniqueLocal,
+		&&op_GetUniqueUpvalue,
+		&&op_GetUpvalue,
+		&&op_GetUpvalueArg,
+		&&op_GetUpvalueRef,
+		&&op_Divide,
+		&&op_Equal,
+		&&op_Greater,
+		&&op_GreaterEqual,
+		&&op_IncrementLocal,
+		&&op_Jump,
+		&&op_JumpFalse,
+		&&op_JumpFalseAnd,
+		&&op_JumpTrue,
+		&&op_JumpTrueOr,
+		&&op_Less,
+		&&op_LessEqual,
+		&&op_Modulus,
+		&&op_Multiply,
+		&&op_Negate,
+		&&op_NewArray,
+		&&op_NewClosure,
+		&&op_NewFrame,
+		&&op_NewIterator,
+		&&op_NewList,
+		&&op_NewSet,
+		&&op_NewTable,
+		&&op_NextKey,
+		&&op_NextValue,
+		&&op_Not,
+		&&op_NotEqual,
+		&&op_Pop,
+		&&op_Power,
+		&&op_Precall,
+		&&op_Print,
+		&&op_PrintLine,
+		&&op_PushBoolean,
+		&&op_PushFalse,
+		&&op_PushFloat,
+		&&op_PushInteger,
+		&&op_PushNan,
+		&&op_PushNull,
+		&&op_PushSmallInt,
+		&&op_PushString,
+		&&op_PushTrue,
+		&&op_Return,
+		&&op_SetField,
+		&&op_SetGlobal,
+		&&op_SetIndex,
+		&&op_SetLocal,
+		&&op_SetUpvalue,
+		&&op_Subtract,
+		&&op_TestIterator,
+		&&op_Throw,
+		&&op_AddLocalSmallInt,
+		&&op_CompareJump,
+		&&op_invalid
+	};
+	static_assert(std::size(dispatch_table) == OPCODE_COUNT + 1);
+#endif
+
 	while (true)
 	{
-		auto op = static_cast<Opcode>(*ip++);
-
-		switch (op)
+		SWITCH()
 		{
-			case Opcode::Add:
+			CASE(Add):
 			{
 				trace_op();
-				math_op('+');
-				break;
+				if (!fast_math_op('+')) math_op('+');
+				DISPATCH();
 			}
-			case Opcode::Assert:
+			CASE(Assert):
 			{
 				trace_op();
 				int narg = *ip++;
-				bool value = peek(-narg).resolve().to_boolean();
+				bool value = to_condition(peek(-narg));
 				if (!value)
 				{
 					auto msg = (narg == 2) ? utils::format("Assertion failed: %", peek(-1).to_string()) : std::string("Assertion failed");
@@ -493,12 +806,13 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 					RUNTIME_ERROR(msg);
 				}
                 pop(narg);
-				break;
+				DISPATCH();
 			}
-			case Opcode::Call:
+			CASE(Call):
 			{
 				trace_op();
 				Instruction flags = *ip++;
+				auto &cache = routine.code.get_call_site(*ip++);
 				// TODO: handle return by reference
 				needs_ref = flags & (1<<9);
 				int narg = flags & 255;
@@ -510,7 +824,7 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 
 				try 
 				{
-					auto c = func.find_closure(args);
+					auto c = func.find_closure(args, cache);
 					if (!c) {
 						report_call_error(func, args);
 					}
@@ -536,26 +850,26 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				CATCH_ERROR
 				needs_ref = false;
-				break;
+				DISPATCH();
 			}
-			case Opcode::ClearLocal:
+			CASE(ClearLocal):
 			{
 				trace_op();
 				auto &v = current_frame->locals[*ip++];
 				v.clear();
-				break;
+				DISPATCH();
 			}
-			case Opcode::Compare:
+			CASE(Compare):
 			{
 				trace_op();
 				auto &v1 = peek(-2);
 				auto &v2 = peek(-1);
-				int result = v1.compare(v2);
+				int result = compare_values(v1, v2);
 				pop(2);
 				push_int(result);
-				break;
+				DISPATCH();
 			}
-			case Opcode::Concat:
+			CASE(Concat):
 			{
 				trace_op();
 				int narg = *ip++;
@@ -565,48 +879,48 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				pop(narg);
 				push(std::move(s));
-				break;
+				DISPATCH();
 			}
-			case Opcode::DecrementLocal:
+			CASE(DecrementLocal):
 			{
 				trace_op();
 				int index = *ip++;
 				auto &v = current_frame->locals[index];
 				assert(v.is_integer());
 				raw_cast<intptr_t>(v)--;
-				break;
+				DISPATCH();
 			}
-			case Opcode::DefineLocal:
+			CASE(DefineLocal):
 			{
 				trace_op();
 				Variant &local = current_frame->locals[*ip++];
 				local = std::move(peek());
 				pop();
-				break;
+				DISPATCH();
 			}
-			case Opcode::Divide:
+			CASE(Divide):
 			{
 				trace_op();
-				math_op('/');
-				break;
+				if (!fast_math_op('/')) math_op('/');
+				DISPATCH();
 			}
-			case Opcode::Equal:
+			CASE(Equal):
 			{
 				trace_op();
 				auto &v2 = peek(-1);
 				auto &v1 = peek(-2);
-				bool value = (v1 == v2);
+				bool value = equal_values(v1, v2);
 				pop(2);
 				push(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetField:
+			CASE(GetField):
 			{
 				trace_op();
 				get_field(false);
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetFieldArg:
+			CASE(GetFieldArg):
 			{
 				trace_op();
 				bool by_ref = current_frame->ref_flags[*ip++];
@@ -614,64 +928,52 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 					RUNTIME_ERROR("Passing dotted expression as an argument by reference is not yet supported");
 				}
 				get_field(by_ref);
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetFieldRef:
+			CASE(GetFieldRef):
 			{
 				trace_op();
 				get_field(true);
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetGlobal:
+			CASE(GetGlobal):
 			{
 				trace_op();
-				auto name = routine.get_string(*ip++);
-				auto it = globals->find(name);
-				if (it == globals->end()) {
-					RUNTIME_ERROR("[Symbol error] Undefined variable \"%\"", name);
-				}
-				push(it->second.resolve());
-				break;
+				auto &v = get_global(routine, *ip++);
+				push(v.resolve());
+				DISPATCH();
 			}
-			case Opcode::GetGlobalArg:
+			CASE(GetGlobalArg):
 			{
 				trace_op();
-				auto name = routine.get_string(*ip++);
+				auto &v = get_global(routine, *ip++);
 				bool by_ref = current_frame->ref_flags[*ip++];
-				auto it = globals->find(name);
-				if (it == globals->end()) {
-					RUNTIME_ERROR("[Symbol error] Undefined variable \"%\"", name);
-				}
 				if (by_ref)
 				{
-					it->second.unshare();
-					push(it->second.make_alias());
+					v.unshare();
+					push(v.make_alias());
 				}
 				else
 				{
-					push(it->second.resolve());
+					push(v.resolve());
 				}
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetGlobalRef:
+			CASE(GetGlobalRef):
 			{
 				trace_op();
-				auto name = routine.get_string(*ip++);
-				auto it = globals->find(name);
-				if (it == globals->end()) {
-					RUNTIME_ERROR("[Symbol error] Undefined variable \"%\"", name);
-				}
-				it->second.unshare();
-				push(it->second.make_alias());
-				break;
+				auto &v = get_global(routine, *ip++);
+				v.unshare();
+				push(v.make_alias());
+				DISPATCH();
 			}
-			case Opcode::GetIndex:
+			CASE(GetIndex):
 			{
 				trace_op();
 				get_index(*ip++, false);
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetIndexArg:
+			CASE(GetIndexArg):
 			{
 				trace_op();
 				int count = *ip++;
@@ -680,22 +982,22 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 					RUNTIME_ERROR("Passing indexed expression as an argument by reference is not yet supported");
 				}
 				get_index(count, by_ref);
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetIndexRef:
+			CASE(GetIndexRef):
 			{
 				trace_op();
 				get_index(*ip++, true);
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetLocal:
+			CASE(GetLocal):
 			{
 				trace_op();
 				auto &v = current_frame->locals[*ip++];
 				push(v.resolve());
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetLocalArg:
+			CASE(GetLocalArg):
 			{
 				trace_op();
 				auto &v = current_frame->locals[*ip++];
@@ -706,46 +1008,42 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				else {
 					push(v.resolve());
 				}
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetLocalRef:
+			CASE(GetLocalRef):
 			{
 				trace_op();
 				Variant &v = current_frame->locals[*ip++];
 				push(v.make_alias());
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetUniqueGlobal:
+			CASE(GetUniqueGlobal):
 			{
 				trace_op();
-				auto name = routine.get_string(*ip++);
-				auto it = globals->find(name);
-				if (it == globals->end()) {
-					RUNTIME_ERROR("[Symbol error] Undefined variable \"%\"", name);
-				}
-				push(it->second.unshare());
-				break;
+				auto &v = get_global(routine, *ip++);
+				push(v.unshare());
+				DISPATCH();
 			}
-			case Opcode::GetUniqueLocal:
+			CASE(GetUniqueLocal):
 			{
 				trace_op();
 				push(current_frame->locals[*ip++].unshare());
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetUniqueUpvalue:
+			CASE(GetUniqueUpvalue):
 			{
 				trace_op();
 				push(closure->upvalues[*ip++].unshare());
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetUpvalue:
+			CASE(GetUpvalue):
 			{
 				trace_op();
 				auto &v = closure->upvalues[*ip++];
 				push(v.resolve());
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetUpvalueArg:
+			CASE(GetUpvalueArg):
 			{
 				trace_op();
 				auto &v = closure->upvalues[*ip++];
@@ -756,126 +1054,138 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				else {
 					push(v.resolve());
 				}
-				break;
+				DISPATCH();
 			}
-			case Opcode::GetUpvalueRef:
+			CASE(GetUpvalueRef):
 			{
 				trace_op();
 				Variant &v = closure->upvalues[*ip++];
 				push(v.make_alias());
-				break;
+				DISPATCH();
 			}
-			case Opcode::Greater:
+			CASE(Greater):
 			{
 				trace_op();
 				auto &v2 = peek(-1);
 				auto &v1 = peek(-2);
-				bool value = (v1.compare(v2) > 0);
+				if (unlikely(has_array_operand(v1, v2) && array_math_op(ArrayOp::Greater))) {
+					DISPATCH();
+				}
+				bool value = (compare_values(v1, v2) > 0);
 				pop(2);
 				push(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::GreaterEqual:
+			CASE(GreaterEqual):
 			{
 				trace_op();
 				auto &v2 = peek(-1);
 				auto &v1 = peek(-2);
-				bool value = (v1.compare(v2) >= 0);
+				if (unlikely(has_array_operand(v1, v2) && array_math_op(ArrayOp::GreaterEqual))) {
+					DISPATCH();
+				}
+				bool value = (compare_values(v1, v2) >= 0);
 				pop(2);
 				push(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::IncrementLocal:
+			CASE(IncrementLocal):
 			{
 				trace_op();
 				int index = *ip++;
 				auto &v = current_frame->locals[index];
 				assert(v.is_integer());
 				raw_cast<intptr_t>(v)++;
-				break;
+				DISPATCH();
 			}
-			case Opcode::Jump:
+			CASE(Jump):
 			{
 				trace_op();
 				int addr = Code::read_integer(ip);
 				ip = code->data() + addr;
-				break;
+				DISPATCH();
 			}
-			case Opcode::JumpFalse:
+			CASE(JumpFalse):
 			{
 				trace_op();
 				int addr = Code::read_integer(ip);
-				bool value = peek().to_boolean();
+				bool value = to_condition(peek());
 				pop();
 				if (!value) ip = code->data() + addr;
-				break;
+				DISPATCH();
 			}
-			case Opcode::JumpFalseAnd:
+			CASE(JumpFalseAnd):
 			{
 				trace_op();
 				int addr = Code::read_integer(ip);
-				bool value = peek().to_boolean();
+				bool value = to_condition(peek());
 				if (!value) ip = code->data() + addr;
 				else pop();
-				break;
+				DISPATCH();
 			}
-			case Opcode::JumpTrue:
+			CASE(JumpTrue):
 			{
 				trace_op();
 				int addr = Code::read_integer(ip);
-				bool value = peek().to_boolean();
+				bool value = to_condition(peek());
 				pop();
 				if (value) ip = code->data() + addr;
-				break;
+				DISPATCH();
 			}
-			case Opcode::JumpTrueOr:
+			CASE(JumpTrueOr):
 			{
 				trace_op();
 				int addr = Code::read_integer(ip);
-				bool value = peek().to_boolean();
+				bool value = to_condition(peek());
 				if (value) ip = code->data() + addr;
 				else pop();
-				break;
+				DISPATCH();
 			}
-			case Opcode::Less:
+			CASE(Less):
 			{
 				trace_op();
 				auto &v2 = peek(-1);
 				auto &v1 = peek(-2);
-				bool value = (v1.compare(v2) < 0);
+				if (unlikely(has_array_operand(v1, v2) && array_math_op(ArrayOp::Less))) {
+					DISPATCH();
+				}
+				bool value = (compare_values(v1, v2) < 0);
 				pop(2);
 				push(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::LessEqual:
+			CASE(LessEqual):
 			{
 				trace_op();
 				auto &v2 = peek(-1);
 				auto &v1 = peek(-2);
-				bool value = (v1.compare(v2) <= 0);
+				if (unlikely(has_array_operand(v1, v2) && array_math_op(ArrayOp::LessEqual))) {
+					DISPATCH();
+				}
+				bool value = (compare_values(v1, v2) <= 0);
 				pop(2);
 				push(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::Modulus:
+			CASE(Modulus):
 			{
 				trace_op();
 				math_op('%');
-				break;
+				DISPATCH();
 			}
-			case Opcode::Multiply:
+			CASE(Multiply):
 			{
 				trace_op();
-				math_op('*');
-				break;
+				if (!fast_math_op('*')) math_op('*');
+				DISPATCH();
 			}
-			case Opcode::Negate:
+			CASE(Negate):
 			{
 				trace_op();
 				negate();
-				break;
+				DISPATCH();
 			}
-			case Opcode::NewArray:
+			CASE(NewArray):
 			{
 				trace_op();
 				int nrow = *ip++;
@@ -906,9 +1216,9 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 					pop(narg);
 					push(make_handle<Array<double>>(std::move(array)));
 				}
-				break;
+				DISPATCH();
 			}
-			case Opcode::NewClosure:
+			CASE(NewClosure):
 			{
 				trace_op();
 				const int index = *ip++;
@@ -942,16 +1252,16 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 					c->upvalues.emplace_back(var->make_alias());
 				}
 				push(make_handle<Function>(this, rout->name(), std::move(c)));
-				break;
+				DISPATCH();
 			}
-			case Opcode::NewFrame:
+			CASE(NewFrame):
 			{
 				trace_op();
 				push_call_frame(closure.object(), *ip++);
 
-				break;
+				DISPATCH();
 			}
-			case Opcode::NewIterator:
+			CASE(NewIterator):
 			{
 				trace_op();
 				bool ref_val = bool(*ip++);
@@ -972,12 +1282,18 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				else if (check_type<String>(v)) {
 					push(make_handle<StringIterator>(std::move(v), ref_val));
 				}
+				else if (check_type<Array<double>>(v)) {
+					try {
+						push(make_handle<ArrayIterator>(std::move(v), ref_val));
+					}
+					CATCH_ERROR
+				}
 				else {
 					RUNTIME_ERROR("Type % is not iterable", v.class_name());
 				}
-				break;
+				DISPATCH();
 			}
-			case Opcode::NewList:
+			CASE(NewList):
 			{
 				trace_op();
 				int narg = *ip++;
@@ -987,9 +1303,9 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				pop(narg);
 				push(make_handle<List>(this, std::move(lst)));
-				break;
+				DISPATCH();
 			}
-			case Opcode::NewTable:
+			CASE(NewTable):
 			{
 				trace_op();
 				int narg = *ip++ * 2;
@@ -1005,9 +1321,9 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				pop(narg);
 				push(make_handle<Table>(this, std::move(tab)));
-				break;
+				DISPATCH();
 			}
-			case Opcode::NewSet:
+			CASE(NewSet):
 			{
 				trace_op();
 				int narg = *ip++;
@@ -1017,9 +1333,9 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				pop(narg);
 				push(make_handle<Set>(this, std::move(set)));
-				break;
+				DISPATCH();
 			}
-			case Opcode::NextKey:
+			CASE(NextKey):
 			{
 				trace_op();
 				try {
@@ -1029,52 +1345,58 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 					push(it.get_key());
 				}
 				CATCH_ERROR
-				break;
+				DISPATCH();
 			}
-			case Opcode::NextValue:
+			CASE(NextValue):
 			{
 				trace_op();
 				try {
 					auto v = std::move(peek());
 					pop();
-					auto &it = raw_cast<Iterator>(v);
-					push(it.get_value());
+					// Numeric arrays are pushed directly, without a virtual call and without boxing the value.
+					if (check_type<ArrayIterator>(v)) {
+						push(raw_cast<ArrayIterator>(v).next_value());
+					}
+					else {
+						auto &it = raw_cast<Iterator>(v);
+						push(it.get_value());
+					}
 				}
 				CATCH_ERROR
 
-				break;
+				DISPATCH();
 			}
-			case Opcode::Not:
+			CASE(Not):
 			{
 				trace_op();
-				bool value = peek().to_boolean();
+				bool value = to_condition(peek());
 				pop();
 				push(!value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::NotEqual:
+			CASE(NotEqual):
 			{
 				trace_op();
 				auto &v2 = peek(-1);
 				auto &v1 = peek(-2);
-				bool value = (v1 != v2);
+				bool value = !equal_values(v1, v2);
 				pop(2);
 				push(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::Pop:
+			CASE(Pop):
 			{
 				trace_op();
 				pop();
-				break;
+				DISPATCH();
 			}
-			case Opcode::Power:
+			CASE(Power):
 			{
 				trace_op();
-				math_op('^');
-				break;
+				if (!fast_math_op('^')) math_op('^');
+				DISPATCH();
 			}
-			case Opcode::Precall:
+			CASE(Precall):
 			{
 				trace_op();
 				auto &v = peek();
@@ -1100,9 +1422,9 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 
 				current_frame->ref_flags = func->ref_flags;
-				break;
+				DISPATCH();
 			}
-			case Opcode::Print:
+			CASE(Print):
 			{
 				trace_op();
 				int narg = *ip++;
@@ -1112,9 +1434,9 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 					this->print(s);
 				}
 				pop(narg);
-				break;
+				DISPATCH();
 			}
-			case Opcode::PrintLine:
+			CASE(PrintLine):
 			{
 				trace_op();
 				int narg = *ip++;
@@ -1126,74 +1448,74 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				static String new_line("\n");
 				this->print(new_line);
 				pop(narg);
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushBoolean:
+			CASE(PushBoolean):
 			{
 				trace_op();
 				bool value = bool(*ip++);
 				push(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushFalse:
+			CASE(PushFalse):
 			{
 				trace_op();
 				push(false);
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushFloat:
+			CASE(PushFloat):
 			{
 				trace_op();
 				double value = routine.get_float(*ip++);
 				push(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushInteger:
+			CASE(PushInteger):
 			{
 				trace_op();
 				intptr_t value = routine.get_integer(*ip++);
 				push_int(value);
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushNan:
+			CASE(PushNan):
 			{
 				trace_op();
 				push(std::nan(""));
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushNull:
+			CASE(PushNull):
 			{
 				trace_op();
 				push_null();
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushSmallInt:
+			CASE(PushSmallInt):
 			{
 				trace_op();
 				push_int((int16_t) *ip++);
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushString:
+			CASE(PushString):
 			{
 				trace_op();
 				String value = routine.get_string(*ip++);
 				push(std::move(value));
-				break;
+				DISPATCH();
 			}
-			case Opcode::PushTrue:
+			CASE(PushTrue):
 			{
 				trace_op();
 				push(true);
-				break;
+				DISPATCH();
 			}
-			case Opcode::Return:
+			CASE(Return):
 			{
 				trace_op();
 				auto result = pop_call_frame();
 				ip = old_ip;
 				return result;
 			}
-			case Opcode::SetField:
+			CASE(SetField):
 			{
 				trace_op();
 				auto &v = peek(-3);
@@ -1212,17 +1534,17 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				CATCH_ERROR
 				pop(3);
-				break;
+				DISPATCH();
 			}
-			case Opcode::SetGlobal:
+			CASE(SetGlobal):
 			{
 				trace_op();
-				auto name = routine.get_string(*ip++);
-				globals->insert({std::move(name), std::move(peek())});
+				auto &v = set_global(routine, *ip++);
+				v = std::move(peek());
 				pop();
-				break;
+				DISPATCH();
 			}
-			case Opcode::SetIndex:
+			CASE(SetIndex):
 			{
 				trace_op();
 				int count = *ip++ + 2; // add indexed expression and value
@@ -1242,9 +1564,9 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				CATCH_ERROR
 				pop(count);
-				break;
+				DISPATCH();
 			}
-			case Opcode::SetLocal:
+			CASE(SetLocal):
 			{
 				trace_op();
 				Variant &v = current_frame->locals[*ip++];
@@ -1253,9 +1575,9 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				CATCH_ERROR
 				pop();
-				break;
+				DISPATCH();
 			}
-			case Opcode::SetUpvalue:
+			CASE(SetUpvalue):
 			{
 				trace_op();
 				Variant &v = closure->upvalues[*ip++];
@@ -1264,24 +1586,24 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				}
 				CATCH_ERROR
 				pop();
-				break;
+				DISPATCH();
 			}
-			case Opcode::Subtract:
+			CASE(Subtract):
 			{
 				trace_op();
-				math_op('-');
-				break;
+				if (!fast_math_op('-')) math_op('-');
+				DISPATCH();
 			}
-			case Opcode::TestIterator:
+			CASE(TestIterator):
 			{
 				trace_op();
 				auto v = std::move(peek());
 				pop();
 				auto &it = raw_cast<Iterator>(v);
 				push(!it.at_end());
-				break;
+				DISPATCH();
 			}
-			case Opcode::Throw:
+			CASE(Throw):
 			{
 				String msg;
 				try {
@@ -1291,8 +1613,76 @@ Variant Runtime::interpret(Handle <Closure> &closure)
 				CATCH_ERROR
 				RUNTIME_ERROR("[Runtime error] %", msg);
 			}
-			default:
-				throw error("[Internal error] Invalid opcode: %", (int)op);
+			CASE(AddLocalSmallInt):
+			{
+				trace_op();
+				Variant &v = current_frame->locals[*ip++];
+				intptr_t y = (int16_t) *ip++;
+				auto &x = v.resolve();
+				if (x.is_integer())
+				{
+					intptr_t n;
+					if (!__builtin_add_overflow(raw_cast<intptr_t>(x), y, &n))
+					{
+						raw_cast<intptr_t>(x) = n;
+						DISPATCH();
+					}
+				}
+				// Slow path: let math_op() handle errors and non-integer values.
+				push(x);
+				push_int(y);
+				math_op('+');
+				try {
+					v = std::move(peek());
+				}
+				CATCH_ERROR
+				pop();
+				DISPATCH();
+			}
+			CASE(CompareJump):
+			{
+				trace_op();
+				auto cmp = static_cast<Opcode>(*ip++);
+				bool jump_if = *ip++;
+				int addr = Code::read_integer(ip);
+				auto &v2 = peek(-1);
+				auto &v1 = peek(-2);
+				bool value;
+				// Ordering comparisons on arrays yield an array, which is tested as in the unfused form (this raises an error).
+				if (unlikely(cmp != Opcode::Equal && cmp != Opcode::NotEqual && has_array_operand(v1, v2)
+					&& array_math_op(get_array_comparison(cmp))))
+				{
+					value = to_condition(peek());
+					pop();
+					if (value == jump_if) ip = code->data() + addr;
+					DISPATCH();
+				}
+				switch (cmp)
+				{
+					case Opcode::Equal:
+						value = equal_values(v1, v2);
+						break;
+					case Opcode::NotEqual:
+						value = !equal_values(v1, v2);
+						break;
+					case Opcode::Less:
+						value = (compare_values(v1, v2) < 0);
+						break;
+					case Opcode::LessEqual:
+						value = (compare_values(v1, v2) <= 0);
+						break;
+					case Opcode::Greater:
+						value = (compare_values(v1, v2) > 0);
+						break;
+					default:
+						value = (compare_values(v1, v2) >= 0);
+				}
+				pop(2);
+				if (value == jump_if) ip = code->data() + addr;
+				DISPATCH();
+			}
+			DEFAULT:
+				throw error("[Internal error] Invalid opcode: %", (int)*(ip-1));
 		}
 	}
 
@@ -1351,9 +1741,10 @@ size_t Runtime::disassemble_instruction(const Routine &routine, size_t offset)
 		}
 		case Opcode::Call:
 		{
-			int narg = routine.code[offset + 1];
-			printf("CALL           %-5d\n", narg);
-			return 2;
+			int narg = routine.code[offset + 1] & 255;
+			int site = routine.code[offset + 2];
+			printf("CALL           %-5d     ; call site %d\n", narg, site);
+			return 3;
 		}
 		case Opcode::ClearLocal:
 		{
@@ -1755,6 +2146,23 @@ size_t Runtime::disassemble_instruction(const Routine &routine, size_t offset)
 		{
 			return print_simple_instruction("THROW");
 		}
+		case Opcode::AddLocalSmallInt:
+		{
+			int index = routine.code[offset + 1];
+			int value = (int16_t) routine.code[offset + 2];
+			String name = routine.get_local_name(index);
+			printf("ADD_LOCAL_INT  %-5d %-5d ; %s\n", index, value, name.data());
+			return 3;
+		}
+		case Opcode::CompareJump:
+		{
+			auto cmp = Code::get_opcode_name(routine.code[offset + 1]);
+			bool jump_if = routine.code[offset + 2];
+			auto ptr = routine.code.data() + offset + 3;
+			int addr = Code::read_integer(ptr);
+			printf("%-15s%-5d     ; %s\n", jump_if ? "CMP_JUMP_TRUE" : "CMP_JUMP_FALSE", addr, cmp);
+			return 3 + Code::IntSerializer::IntSize;
+		}
 		default:
 			printf("Unknown opcode %d", static_cast<int>(op));
 	}
@@ -1762,20 +2170,72 @@ size_t Runtime::disassemble_instruction(const Routine &routine, size_t offset)
 	return 1;
 }
 
-Handle<Closure> Runtime::compile_file(const String &path)
+Handle<Closure> Runtime::compile_file(const String &path, bool optimize)
 {
 	this->clear();
+	// Only optimized code is cached.
+	uint64_t hash;
+	bool cached = bytecode_cache && optimize && BytecodeCache::hash_file(path, hash);
+
+	if (cached)
+	{
+		if (auto routine = bytecode_cache->load(path, hash)) {
+			return make_handle<Closure>(this, std::move(routine));
+		}
+	}
 	auto ast = parser.parse_file(path);
+	auto closure = compiler.compile(std::move(ast), optimize);
 
-	return compiler.compile(std::move(ast));
+	if (cached) {
+		save_bytecode(path, hash, closure);
+	}
+
+	return closure;
 }
 
-Handle<Closure> Runtime::compile_string(const String &code)
+Handle<Closure> Runtime::compile_script(const String &name, const String &code)
 {
+	if (!bytecode_cache) {
+		return compile_string(code);
+	}
 	this->clear();
+	// Embedded scripts don't have a path: they are identified by their name.
+	auto key = String("<script>:").append(name);
+	auto hash = BytecodeCache::hash_string(code);
+
+	if (auto routine = bytecode_cache->load(key, hash)) {
+		return make_handle<Closure>(this, std::move(routine));
+	}
 	auto ast = parser.parse_string(code);
+	auto closure = compiler.compile(std::move(ast), true);
+	save_bytecode(key, hash, closure);
+
+	return closure;
+}
 
-	return compiler.compile(std::move(ast));
+void Runtime::save_bytecode(const String &key, uint64_t hash, const Handle<Closure> &closure)
+{
+	try
+	{
+		bytecode_cache->save(key, hash, static_cast<const Routine&>(*closure->routine));
+	}
+	catch (std::exception &)
+	{
+		// The cache is optional: the script will simply be compiled again next time.
+	}
+}
+
+void Runtime::set_bytecode_cache(const String &directory)
+{
+	bytecode_cache = std::make_unique<BytecodeCache>(directory);
+}
+
+Handle<Closure> Runtime::compile_string(const String &code, bool optimize)
+{
+	this->clear();
+	auto ast = parser.parse_string(code);
+
+	return compiler.compile(std::move(ast), optimize);
 }
 
 Variant Runtime::do_file(const String &path)
@@ -1800,6 +2260,17 @@ Variant Runtime::do_string(const String &code)
 	return result;
 }
 
+Variant Runtime::do_script(const String &name, const String &code)
+{
+	auto old_path = current_path;
+	current_path = String();
+	auto closure = compile_script(name, code);
+	auto result = interpret(closure);
+	current_path = old_path;
+
+	return result;
+}
+
 int Runtime::get_current_line() const
 {
 	auto offset = int(ip - 1 - code->data());
@@ -1869,7 +2340,35 @@ Variant Runtime::pop_call_frame()
 
 void Runtime::add_global(String name, Variant value)
 {
-	globals->insert({ std::move(name), std::move(value) });
+	(*globals)[name] = std::move(value);
+}
+
+Variant &Runtime::get_global(Routine &routine, Instruction name)
+{
+	auto &slot = routine.global_slots[name];
+
+	// Globals may be defined after the code that uses them has been compiled, so they are resolved on first use.
+	if (unlikely(slot < 0))
+	{
+		auto key = routine.get_string(name);
+		slot = globals->find_slot(key);
+		if (slot < 0) {
+			RUNTIME_ERROR("[Symbol error] Undefined variable \"%\"", key);
+		}
+	}
+
+	return globals->get_slot(slot);
+}
+
+Variant &Runtime::set_global(Routine &routine, Instruction name)
+{
+	auto &slot = routine.global_slots[name];
+
+	if (unlikely(slot < 0)) {
+		slot = globals->add_slot(routine.get_string(name));
+	}
+
+	return globals->get_slot(slot);
 }
 
 void Runtime::add_global(const String &name, NativeCallback cb, std::initializer_list<Handle<Class>> sig, ParamBitset ref)
@@ -1970,83 +2469,164 @@ void Runtime::report_call_error(const Function &func, std::span<Variant> args)
 
 void Runtime::collect()
 {
-	if (gc_paused) {
+	// This is a synchronous version of the cycle collector described in Bacon & Rajan (2001), "Concurrent Cycle
+	// Collection in Reference Counted Systems". Each cycle only examines the oldest gc_slice candidates, which bounds
+	// the pause: the remaining candidates stay in the buffer until the next cycle. Since the mutator doesn't run while
+	// a cycle is in progress, white objects are garbage even if they are reachable from candidates that were not
+	// examined. All graph traversals use an explicit work list so that deep structures can't overflow the C++ stack.
+	if (gc_paused || gc_running) {
 		return;
 	}
-	mark_candidates();
-	auto candidate = gc_root;
-	while (candidate != nullptr)
-	{
+	gc_running = true;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Collectable*> roots;
+
+	mark_candidates(roots);
+
+	for (auto candidate : roots) {
 		scan(candidate);
-		candidate = candidate->next;
 	}
-	collect_candidates();
+	collect_white(roots);
+	auto examined = intptr_t(roots.size());
+	auto freed = intptr_t(gc_garbage.size());
+	free_garbage();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	gc_info.collections++;
+	gc_info.examined += examined;
+	gc_info.freed += freed;
+	gc_info.time += elapsed.count();
+	gc_running = false;
+
+	adjust_threshold(examined, freed);
 }
 
-void Runtime::mark_candidates()
+void Runtime::full_collect()
 {
-	auto candidate = gc_root;
+	// Freeing garbage may release objects which become new candidates, so we loop until the buffer is empty. Live
+	// candidates are dropped from the buffer once they have been examined, so this terminates.
+	while (gc_root && !gc_paused) {
+		collect();
+	}
+}
+
+void Runtime::set_gc_slice(intptr_t size)
+{
+	gc_slice = (std::max)(size, intptr_t(1));
+}
+
+void Runtime::adjust_threshold(intptr_t examined, intptr_t freed)
+{
+	constexpr intptr_t min_threshold = 1024;
+	constexpr intptr_t max_threshold = intptr_t(1) << 20;
 
-	while (candidate != nullptr)
+	if (examined == 0) {
+		return;
+	}
+
+	// If most candidates survive, the program is mostly creating long-lived data and collecting often is a waste of
+	// time. If a large fraction of candidates is garbage, we collect more often to keep memory usage low.
+	double survival = double(examined - (std::min)(freed, examined)) / examined;
+
+	if (survival > 0.75) {
+		gc_threshold = (std::min)(gc_threshold * 2, max_threshold);
+	}
+	else if (survival < 0.5) {
+		gc_threshold = (std::max)(gc_threshold / 2, min_threshold);
+	}
+}
+
+void Runtime::mark_candidates(std::vector<Collectable*> &roots)
+{
+	intptr_t count = 0;
+	roots.reserve(size_t((std::min)(gc_count, gc_slice)));
+
+	while (gc_tail != nullptr && count++ < gc_slice)
 	{
+		auto candidate = pop_candidate();
+
 		if (candidate->is_purple())
 		{
 			mark_grey(candidate);
+			roots.push_back(candidate);
 		}
-		else
+		else if (candidate->is_black() && !candidate->is_used())
 		{
-			remove_candidate(candidate);
-
-			if (candidate->is_black() && !candidate->is_used()) {
-				delete candidate;
-			}
+			delete candidate;
 		}
-		candidate = candidate->next;
 	}
 }
 
 void Runtime::mark_grey(Collectable *candidate)
 {
-	if (!candidate->is_grey())
-	{
-		candidate->mark_grey();
-		auto traverse = candidate->get_class()->traverse;
+	if (candidate->is_grey()) {
+		return;
+	}
+	candidate->mark_grey();
+	gc_stack.push_back(candidate);
 
-		if (traverse)
+	// Run trial deletion on each child
+	auto lambda = [this](Collectable *child) {
+		child->remove_reference();
+
+		if (!child->is_grey())
 		{
-			// Run trial deletion on each child
-			auto lambda = [](Collectable *child) {
-				child->remove_reference();
-				mark_grey(child);
-			};
+			child->mark_grey();
+			gc_stack.push_back(child);
+		}
+	};
+
+	while (!gc_stack.empty())
+	{
+		auto ref = gc_stack.back();
+		gc_stack.pop_back();
+		auto traverse = ref->get_class()->traverse;
 
-			traverse(candidate, lambda);
+		if (traverse) {
+			traverse(ref, lambda);
 		}
 	}
 }
 
 void Runtime::scan(Collectable *candidate)
 {
-	if (candidate->is_grey())
+	if (!candidate->is_grey()) {
+		return;
+	}
+	gc_stack.push_back(candidate);
+
+	auto lambda = [this](Collectable *child) {
+		if (child->is_grey()) {
+			gc_stack.push_back(child);
+		}
+	};
+
+	while (!gc_stack.empty())
 	{
-		if (candidate->is_used())
+		auto ref = gc_stack.back();
+		gc_stack.pop_back();
+
+		// The object may have been reached through several paths.
+		if (!ref->is_grey()) {
+			continue;
+		}
+
+		if (ref->is_used())
 		{
-			// There must be an external reference.
-			scan_black(candidate);
+			// There must be an external reference. scan_black() uses the work list, so we save the pending objects.
+			auto pending = std::move(gc_stack);
+			gc_stack.clear();
+			scan_black(ref);
+			gc_stack = std::move(pending);
 		}
 		else
 		{
 			// This looks like garbage
-			candidate->mark_white();
-			auto traverse = candidate->get_class()->traverse;
-
-			if (traverse)
-			{
-				auto lambda = [](Collectable *child) {
-					scan(child);
-				};
+			ref->mark_white();
+			auto traverse = ref->get_class()->traverse;
 
-				traverse(candidate, lambda);
+			if (traverse) {
+				traverse(ref, lambda);
 			}
 		}
 	}
@@ -2056,44 +2636,99 @@ void Runtime::scan_black(Collectable *candidate)
 {
 	// Repair reference count of live data.
 	candidate->mark_black();
-	auto traverse = candidate->get_class()->traverse;
+	gc_stack.push_back(candidate);
 
-	if (traverse)
-	{
-		auto lambda = [](Collectable *child) {
-			// restore trial deletion
-			child->add_reference();
+	auto lambda = [this](Collectable *child) {
+		// restore trial deletion
+		child->add_reference();
 
-			if (!child->is_black()) {
-				scan_black(child);
-			}
-		};
+		if (!child->is_black())
+		{
+			child->mark_black();
+			gc_stack.push_back(child);
+		}
+	};
+
+	while (!gc_stack.empty())
+	{
+		auto ref = gc_stack.back();
+		gc_stack.pop_back();
+		auto traverse = ref->get_class()->traverse;
 
-		traverse(candidate, lambda);
+		if (traverse) {
+			traverse(ref, lambda);
+		}
 	}
 }
 
-void Runtime::collect_candidates()
+void Runtime::collect_white(std::vector<Collectable*> &roots)
 {
-	Collectable *candidate;
+	auto lambda = [this](Collectable *child) {
+		if (child->is_white()) {
+			gc_stack.push_back(child);
+		}
+	};
+
+	for (auto root : roots)
+	{
+		gc_stack.push_back(root);
+
+		while (!gc_stack.empty())
+		{
+			auto ref = gc_stack.back();
+			gc_stack.pop_back();
+
+			if (ref->is_white())
+			{
+				// Free-list objects are black
+				ref->mark_black();
+				gc_garbage.push_back(ref);
+				auto traverse = ref->get_class()->traverse;
 
-	while ((candidate = pop_candidate())) {
-		collect_white(candidate);
+				if (traverse) {
+					traverse(ref, lambda);
+				}
+			}
+		}
 	}
 }
 
-void Runtime::collect_white(Collectable *ref)
+void Runtime::free_garbage()
 {
-	if (ref->is_white() && !ref->is_candidate())
+	// Garbage objects reference each other, so destroying one of them releases others. To avoid touching freed memory,
+	// all the objects are destroyed before any of them is deallocated. Each object is retained so that releasing it
+	// never destroys it a second time, and it is marked purple so that it can't become a candidate again. Destructors
+	// release the children of each object, so the references removed by trial deletion must be restored first.
+	std::vector<void*> blocks;
+	blocks.reserve(gc_garbage.size());
+
+	auto restore = [](Collectable *child) {
+		child->add_reference();
+	};
+
+	for (auto ref : gc_garbage)
 	{
-		// Free-list objects are black
-		ref->mark_black();
+		if (ref->is_candidate()) {
+			remove_candidate(ref);
+		}
+		ref->add_reference();
+		ref->mark_purple();
+		blocks.push_back(dynamic_cast<void*>(ref));
 		auto traverse = ref->get_class()->traverse;
 
 		if (traverse) {
-			traverse(ref, collect_white);
+			traverse(ref, restore);
 		}
-		delete ref;
+	}
+
+	auto garbage = std::move(gc_garbage);
+	gc_garbage.clear();
+
+	for (auto ref : garbage) {
+		ref->~Collectable();
+	}
+	for (auto ptr : blocks) {
+		::operator delete(ptr);
 	}
 }
 
@@ -2128,12 +2763,10 @@ Variant Runtime::call_method(Handle<Closure> &c, std::span<Variant> args)
 
 Collectable *Runtime::pop_candidate()
 {
-	auto cand = gc_root;
-	if (cand)
-	{
-		gc_root = cand->next;
-		cand->next = nullptr;
-		if (gc_root) gc_root->previous = nullptr;
+	// Candidates are removed from the end of the list, so that the oldest ones are examined first.
+	auto cand = gc_tail;
+	if (cand) {
+		remove_candidate(cand);
 	}
 
 	return cand;
@@ -2221,9 +2854,11 @@ void Runtime::call(int narg)
 
 Variant Runtime::import_module(const String &name)
 {
-	auto it = imports.find(name);
+	// Modules are cached under their resolved path, so that different names referring to the same file share the module.
+	auto path = find_import(name);
+	auto it = imports.find(path);
 	if (it == imports.end()) {
-		return reload_module(name);
+		return load_module(path);
 	}
 
 	return it->second;
@@ -2231,9 +2866,13 @@ Variant Runtime::import_module(const String &name)
 
 Variant Runtime::reload_module(const String &name)
 {
-	auto path = find_import(name);
+	return load_module(find_import(name));
+}
+
+Variant Runtime::load_module(const String &path)
+{
 	auto result = do_file(path);
-	imports.insert({ path, result });
+	imports[path] = result;
 
 	return result;
 }
@@ -15,8 +15,8 @@
  *                                                                                                                     *
  * Created: 23/05/2020                                                                                                 *
  *                                                                                                                     *
- * Purpose: a runtime encapsulates a virtual machine that can execute Phonometrica code. There can be several          *
- * runtimes in an OS thread, but runtimes must not be shared across threads.                                           *
+ * Purpose: a runtime encapsulates a virtual machine that can execute Phonometrica code. Each OS thread can host a     *
+ * runtime, but runtimes must not be shared across threads (see TaskPool).                                             *
  *                                                                                                                     *
  ***********************************************************************************************************************/
 
@@ -34,6 +34,7 @@
 #include <phon/runtime/function.hpp>
 #include <phon/runtime/module.hpp>
 #include <phon/runtime/variant.hpp>
+#include <phon/runtime/array_math.hpp>
 #include <phon/runtime/compiler/parser.hpp>
 #include <phon/runtime/compiler/compiler.hpp>
 
@@ -42,6 +43,7 @@ namespace phonometrica {
 class Class;
 class Object;
 class Collectable;
+class BytecodeCache;
 #if PHON_GUI
 class Console;
 #endif
@@ -153,6 +155,7 @@ public:
 
 		// Register statically known type so that we can call Class::get<T>() to retrieve a type's class.
 		detail::ClassDescriptor<T>::set(klass.get());
+		descriptor_resets.push_back(&detail::ClassDescriptor<T>::reset);
 
 		// Object is an abstract type
 		if constexpr (traits::is_boxed<T>::value && !std::is_same<T, Object>::value)
@@ -247,9 +250,18 @@ public:
 
 	Variant do_string(const String &code);
 
-	Handle<Closure> compile_file(const String &path);
+	// Run a script whose source code is embedded in the program. The script is cached under the given name.
+	Variant do_script(const String &name, const String &code);
 
-	Handle<Closure> compile_string(const String &code);
+	Handle<Closure> compile_file(const String &path, bool optimize = true);
+
+	Handle<Closure> compile_string(const String &code, bool optimize = true);
+
+	Handle<Closure> compile_script(const String &name, const String &code);
+
+	// Store compiled files and embedded scripts in the given directory, and reuse them as long as their source code
+	// doesn't change.
+	void set_bytecode_cache(const String &directory);
 
 	String intern_string(const String &s);
 
@@ -269,6 +281,36 @@ public:
 
 	void resume_gc();
 
+	// Statistics for the cycle collector. Objects which are freed by reference counting alone are not counted.
+	struct GCStats
+	{
+		// Number of collection cycles.
+		intptr_t collections = 0;
+
+		// Number of candidates examined.
+		intptr_t examined = 0;
+
+		// Number of objects freed by the collector.
+		intptr_t freed = 0;
+
+		// Total time spent in the collector (in seconds).
+		double time = 0;
+	};
+
+	const GCStats &gc_stats() const { return gc_info; }
+
+	// Number of candidates currently waiting for the next collection.
+	intptr_t gc_pending() const { return gc_count; }
+
+	intptr_t gc_limit() const { return gc_threshold; }
+
+	// Set the maximum number of candidates examined in one collection cycle. Larger slices free more garbage at once,
+	// at the cost of longer pauses.
+	void set_gc_slice(intptr_t size);
+
+	// Run collection cycles until there are no candidates left.
+	void full_collect();
+
 	Class *get_object_class() { return classes[1].get(); }
 
 	std::function<void()> initialize_script;
@@ -324,11 +366,16 @@ private:
 
 	friend class Object;
 	friend class Collectable;
+	friend class TaskPool;
 
 	void clear();
 
 	String find_import(String name);
 
+	Variant load_module(const String &path);
+
+	void save_bytecode(const String &key, uint64_t hash, const Handle<Closure> &closure);
+
 	void add_candidate(Collectable *obj);
 
 	void remove_candidate(Collectable *obj);
@@ -353,6 +400,14 @@ private:
 
 	void math_op(char op);
 
+	bool fast_math_op(char op);
+
+	bool array_math_op(ArrayOp op);
+
+	bool to_condition(const Variant &v);
+
+	static double float_op(char op, double x, double y);
+
 	static void check_float_error();
 
 	int get_current_line() const;
@@ -365,31 +420,40 @@ private:
 
 	void get_field(bool by_ref);
 
+	Variant &get_global(Routine &routine, Instruction name);
+
+	Variant &set_global(Routine &routine, Instruction name);
+
 	void report_call_error(const Function &func, std::span<Variant> args);
 
 	void collect();
 
-	void mark_candidates();
+	void mark_candidates(std::vector<Collectable*> &roots);
+
+	void mark_grey(Collectable *candidate);
 
-	static void mark_grey(Collectable *candidate);
+	void scan(Collectable *candidate);
 
-	static void scan(Collectable *candidate);
+	void scan_black(Collectable *candidate);
 
-	static void scan_black(Collectable *candidate);
+	void collect_white(std::vector<Collectable*> &roots);
 
-	void collect_candidates();
+	void free_garbage();
 
-	static void collect_white(Collectable *ref);
+	void adjust_threshold(intptr_t examined, intptr_t freed);
 
 	Collectable *pop_candidate();
 
-	bool is_full() const { return gc_count == gc_threshold; }
+	bool is_full() const { return gc_count >= gc_threshold; }
 
 	Variant call_method(Handle<Closure> &c, std::span<Variant> args);
 
 	// Builtin classes (known at compile time).
 	std::vector<Handle<Class>> classes;
 
+	// Unregister statically known types when the runtime is destroyed.
+	std::vector<void(*)()> descriptor_resets;
+
 	// imports (path -> return value)
 	Dictionary<Variant> imports;
 
@@ -423,6 +487,9 @@ private:
 	// Compiles source code to byte code for the runtime.
 	Compiler compiler;
 
+	// On-disk cache for compiled files (may be null).
+	std::unique_ptr<BytecodeCache> bytecode_cache;
+
 	// Interned strings.
 	std::unordered_set<String> strings;
 
@@ -435,14 +502,26 @@ private:
 	// Current call frame.
 	CallFrame *current_frame = nullptr;
 
-	// Root for garbage collection
+	// Root for garbage collection (most recent candidate).
 	Collectable *gc_root = nullptr;
 
-	// Number of allocated objects
-	int gc_count = 0;
+	// Oldest candidate. Collection cycles start from the end of the list.
+	Collectable *gc_tail = nullptr;
+
+	// Number of candidates
+	intptr_t gc_count = 0;
+
+	// Maximum number of candidates before the next collection cycle. This grows when most candidates turn out to be
+	// alive, and shrinks back when collections free a lot of garbage.
+	intptr_t gc_threshold = 1024;
 
-	// Maximum number of objects before the next collection cycle
-	int gc_threshold = 1024;
+	// Maximum number of candidates examined in one collection cycle.
+	intptr_t gc_slice = 4096;
+
+	// Work list for the collector's graph traversals, and objects found to be garbage.
+	std::vector<Collectable*> gc_stack, gc_garbage;
+
+	GCStats gc_info;
 
 	// Runtime option
 	bool debugging = true;
@@ -453,6 +532,9 @@ private:
 	// If true, the GC will be suspended until the next call to resume_gc().
 	bool gc_paused = false;
 
+	// True while a collection cycle is running: objects released by the collector must not trigger a new cycle.
+	bool gc_running = false;
+
 	// For methods that are retrieved after the arguments have been pushed, we set this flag to true so that pop_call_frame() doesn't try
 	// to pop the function before the stack frame.
 	bool calling_method = false;
@@ -0,0 +1,607 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: see header.                                                                                                *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <phon/runtime.hpp>
+#include <phon/runtime/task_pool.hpp>
+
+namespace phonometrica {
+
+// A value which doesn't reference any object owned by a runtime, so that it can be passed to another thread.
+struct TaskPool::Value
+{
+	enum class Kind
+	{
+		Null,
+		Boolean,
+		Integer,
+		Float,
+		String,
+		List,
+		Table,
+		Set,
+		Array,
+		Function,
+		Snapshot
+	};
+
+	Kind kind = Kind::Null;
+
+	// Boolean, integer or index of a function in the program.
+	intptr_t integer = 0;
+
+	double number = 0;
+
+	String string;
+
+	// Items of a list or a set, or keys and values of a table (interleaved).
+	std::vector<Value> items;
+
+	Array<double> array;
+
+	std::shared_ptr<TaskPool::Snapshot> snapshot;
+};
+
+struct TaskPool::FunctionImage
+{
+	String name;
+
+	// If true, native overloads are taken from the worker's global function with the same name.
+	bool has_native = false;
+
+	// Copies of the user-defined routines, with the values of their captured variables.
+	std::vector<std::shared_ptr<Routine>> routines;
+
+	std::vector<std::vector<Value>> upvalues;
+};
+
+// Everything a worker needs to rebuild the task in its own runtime. This is created by the calling thread and is
+// read-only while the workers are running.
+struct TaskPool::Program
+{
+	// The function to map is the first one.
+	std::vector<FunctionImage> functions;
+
+	// Functions which have already been copied.
+	std::unordered_map<const Function*, intptr_t> function_indexes;
+
+	// Global values which are referenced by the functions, and global names which must still be checked.
+	std::vector<std::pair<String, Value>> globals;
+	std::vector<String> global_names;
+
+	// Parameter types of sealed routines. Classes belong to a runtime, so they are looked up by name in each worker.
+	std::unordered_map<const Routine*, std::vector<String>> signatures;
+
+	std::vector<Value> items;
+
+	std::vector<String> import_paths;
+
+	String program_path;
+
+	// Set up by the application in each worker runtime.
+	std::shared_ptr<Snapshot> setup;
+
+	std::unordered_set<const void*> visiting;
+};
+
+struct TaskPool::Worker
+{
+	Worker(const Program &prog, std::vector<Value> &results, std::atomic<intptr_t> &next, std::atomic<bool> &failed) :
+		prog(prog), results(results), next(next), failed(failed)
+	{ }
+
+	const Program &prog;
+
+	std::vector<Value> &results;
+
+	// Index of the next item to process (shared by all workers).
+	std::atomic<intptr_t> &next;
+
+	// Set when any worker fails, so that the others stop early.
+	std::atomic<bool> &failed;
+
+	// Runtime owned by the worker thread.
+	Runtime *runtime = nullptr;
+
+	// Functions created in the worker runtime, by index in the program.
+	std::vector<Variant> functions;
+
+	std::unordered_set<const void*> visiting;
+
+	String output;
+
+	String error_message;
+};
+
+static TaskPool::Packer the_packer;
+static TaskPool::Initializer the_initializer;
+
+
+TaskPool::TaskPool(Runtime &rt, int thread_count) :
+	rt(rt), thread_count(thread_count)
+{
+	if (this->thread_count <= 0) {
+		this->thread_count = (std::max)(int(std::thread::hardware_concurrency()), 1);
+	}
+}
+
+void TaskPool::set_packer(Packer packer)
+{
+	the_packer = std::move(packer);
+}
+
+void TaskPool::set_initializer(Initializer init)
+{
+	the_initializer = std::move(init);
+}
+
+Handle<List> TaskPool::map(Function &func, List &items)
+{
+	Program prog;
+	prog.program_path = rt.program_path();
+	prog.import_paths = rt.import_paths;
+	if (the_initializer) {
+		prog.setup = the_initializer(rt);
+	}
+	pack_function(func, prog);
+	pack_globals(prog);
+	prog.items.reserve(size_t(items.size()));
+
+	for (auto &item : items) {
+		prog.items.push_back(pack(item, &prog, prog.visiting));
+	}
+
+	auto count = intptr_t(prog.items.size());
+	std::vector<Value> results(prog.items.size());
+	std::atomic<intptr_t> next(0);
+	std::atomic<bool> failed(false);
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+	auto nthread = (std::min)(intptr_t(thread_count), count);
+
+	for (intptr_t i = 0; i < nthread; i++)
+	{
+		workers.push_back(std::make_unique<Worker>(prog, results, next, failed));
+		threads.emplace_back(run, std::ref(*workers.back()));
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	for (auto &w : workers)
+	{
+		if (!w->output.empty()) {
+			rt.print(w->output);
+		}
+	}
+	for (auto &w : workers)
+	{
+		if (!w->error_message.empty()) {
+			throw error("[Parallel error] %", w->error_message);
+		}
+	}
+
+	Array<Variant> list;
+	list.reserve(count);
+	Worker w(prog, results, next, failed);
+	w.runtime = &rt;
+
+	for (auto &value : results) {
+		list.append(unpack(value, w));
+	}
+
+	return make_handle<List>(&rt, std::move(list));
+}
+
+TaskPool::Value TaskPool::pack(const Variant &var, Program *prog, std::unordered_set<const void*> &visiting)
+{
+	// Values are only read, but the runtime's accessors take non-const references.
+	auto &v = const_cast<Variant&>(var.resolve());
+	Value value;
+
+	if (v.is_null())
+	{
+		return value;
+	}
+	else if (check_type<bool>(v))
+	{
+		value.kind = Value::Kind::Boolean;
+		value.integer = intptr_t(raw_cast<bool>(v));
+	}
+	else if (v.is_integer())
+	{
+		value.kind = Value::Kind::Integer;
+		value.integer = raw_cast<intptr_t>(v);
+	}
+	else if (v.is_float())
+	{
+		value.kind = Value::Kind::Float;
+		value.number = raw_cast<double>(v);
+	}
+	else if (v.is_string())
+	{
+		value.kind = Value::Kind::String;
+		value.string = raw_cast<String>(v);
+	}
+	else if (check_type<Array<double>>(v))
+	{
+		value.kind = Value::Kind::Array;
+		value.array = raw_cast<Array<double>>(v);
+	}
+	else if (check_type<Function>(v))
+	{
+		if (!prog) {
+			throw error("[Type error] A parallel task cannot return a function");
+		}
+		value.kind = Value::Kind::Function;
+		value.integer = pack_function(raw_cast<Function>(v), *prog);
+	}
+	else if (check_type<List>(v) || check_type<Table>(v) || check_type<Set>(v))
+	{
+		// Containers are copied recursively, so a container which (indirectly) contains itself can't be copied.
+		auto enter = [&](const void *key) {
+			if (!visiting.insert(key).second) {
+				throw error("[Type error] Cannot copy a cyclic % to another thread", v.class_name());
+			}
+		};
+
+		if (check_type<List>(v))
+		{
+			auto &lst = raw_cast<List>(v);
+			enter(&lst);
+			value.kind = Value::Kind::List;
+			for (auto &item : lst) {
+				value.items.push_back(pack(item, prog, visiting));
+			}
+			visiting.erase(&lst);
+		}
+		else if (check_type<Table>(v))
+		{
+			auto &tab = raw_cast<Table>(v);
+			enter(&tab);
+			value.kind = Value::Kind::Table;
+			for (auto &it : tab.data())
+			{
+				value.items.push_back(pack(it.first, prog, visiting));
+				value.items.push_back(pack(it.second, prog, visiting));
+			}
+			visiting.erase(&tab);
+		}
+		else
+		{
+			auto &set = raw_cast<Set>(v);
+			enter(&set);
+			value.kind = Value::Kind::Set;
+			for (auto &item : set) {
+				value.items.push_back(pack(item, prog, visiting));
+			}
+			visiting.erase(&set);
+		}
+	}
+	else
+	{
+		// Snapshots are only taken in the calling thread.
+		if (prog && the_packer) {
+			value.snapshot = the_packer(v);
+		}
+		if (!value.snapshot) {
+			throw error("[Type error] Cannot copy a value of type % to another thread", v.class_name());
+		}
+		value.kind = Value::Kind::Snapshot;
+	}
+
+	return value;
+}
+
+intptr_t TaskPool::pack_function(Function &func, Program &prog)
+{
+	auto it = prog.function_indexes.find(&func);
+	if (it != prog.function_indexes.end()) {
+		return it->second;
+	}
+	// Register the function before copying it, since it may refer to itself.
+	auto index = intptr_t(prog.functions.size());
+	prog.functions.emplace_back();
+	prog.function_indexes[&func] = index;
+
+	FunctionImage image;
+	image.name = func._name;
+
+	for (auto &c : func.closures)
+	{
+		if (c->routine->is_native())
+		{
+			image.has_native = true;
+			continue;
+		}
+		auto &r = static_cast<const Routine&>(*c->routine);
+		image.routines.push_back(copy_routine(r, nullptr, prog));
+		std::vector<Value> upvalues;
+
+		for (auto &upvalue : c->upvalues) {
+			upvalues.push_back(pack(upvalue, &prog, prog.visiting));
+		}
+		image.upvalues.push_back(std::move(upvalues));
+	}
+	prog.functions[index] = std::move(image);
+
+	return index;
+}
+
+void TaskPool::pack_globals(Program &prog)
+{
+	std::unordered_set<String> seen;
+
+	// Any string constant might be the name of a global variable. Values which can't be copied are ignored: the task
+	// will fail with an undefined variable error if it does use them.
+	while (!prog.global_names.empty())
+	{
+		auto name = std::move(prog.global_names.back());
+		prog.global_names.pop_back();
+		if (!seen.insert(name).second) continue;
+
+		auto slot = rt.globals->find_slot(name);
+		if (slot < 0) continue;
+		auto &v = rt.globals->get_slot(slot).resolve();
+
+		// Builtin functions exist in every runtime.
+		if (check_type<Function>(v))
+		{
+			auto &func = raw_cast<Function>(v);
+			bool native = std::all_of(func.closures.begin(), func.closures.end(), [](Handle<Closure> &c) {
+				return c->routine->is_native();
+			});
+			if (native) continue;
+		}
+
+		try
+		{
+			auto value = pack(v, &prog, prog.visiting);
+			prog.globals.emplace_back(std::move(name), std::move(value));
+		}
+		catch (std::exception &)
+		{
+			prog.visiting.clear();
+		}
+	}
+}
+
+std::shared_ptr<Routine> TaskPool::clone_routine(const Routine &r, Routine *parent)
+{
+	auto copy = std::make_shared<Routine>(parent, r.name());
+	copy->ref_flags = r.ref_flags;
+	copy->code.code = r.code.code;
+	copy->code.lines = r.code.lines;
+	copy->code.call_sites.resize(r.code.call_sites.size());
+	copy->float_pool = r.float_pool;
+	copy->integer_pool = r.integer_pool;
+	copy->string_pool = r.string_pool;
+	copy->global_slots.resize(r.string_pool.size(), -1);
+	copy->locals = r.locals;
+	copy->upvalues = r.upvalues;
+
+	return copy;
+}
+
+std::shared_ptr<Routine> TaskPool::copy_routine(const Routine &r, Routine *parent, Program &prog)
+{
+	// Parameter types are replaced by their names, and the names used by the routine are recorded so that the globals
+	// it refers to can be copied.
+	auto copy = clone_routine(r, parent);
+	prog.global_names.insert(prog.global_names.end(), r.string_pool.begin(), r.string_pool.end());
+
+	if (r.sealed())
+	{
+		std::vector<String> names;
+		for (auto &cls : r.signature) {
+			names.push_back(cls->name());
+		}
+		prog.signatures[copy.get()] = std::move(names);
+	}
+
+	for (auto &nested : r.routine_pool) {
+		copy->routine_pool.push_back(copy_routine(*nested, copy.get(), prog));
+	}
+
+	return copy;
+}
+
+std::shared_ptr<Routine> TaskPool::copy_routine(const Routine &r, Routine *parent, const Program &prog, Runtime &rt)
+{
+	// Routines cache global slots and call targets, which are specific to a runtime, so each worker needs its own copy.
+	auto copy = clone_routine(r, parent);
+	auto it = prog.signatures.find(&r);
+
+	if (it != prog.signatures.end())
+	{
+		for (auto &name : it->second)
+		{
+			auto slot = rt.globals->find_slot(name);
+			auto cls = (slot < 0) ? nullptr : &rt.globals->get_slot(slot).resolve();
+
+			if (!cls || !check_type<Class>(*cls)) {
+				throw error("[Type error] Type % is not available in parallel tasks", name);
+			}
+			copy->add_parameter_type(cls->handle<Class>());
+		}
+		copy->seal();
+	}
+
+	for (auto &nested : r.routine_pool) {
+		copy->routine_pool.push_back(copy_routine(*nested, copy.get(), prog, rt));
+	}
+
+	return copy;
+}
+
+Variant TaskPool::unpack(const Value &value, Worker &w)
+{
+	auto rt = w.runtime;
+
+	switch (value.kind)
+	{
+		case Value::Kind::Null:
+			return Variant();
+		case Value::Kind::Boolean:
+			return bool(value.integer);
+		case Value::Kind::Integer:
+			return value.integer;
+		case Value::Kind::Float:
+			return value.number;
+		case Value::Kind::String:
+			return value.string;
+		case Value::Kind::Array:
+			return make_handle<Array<double>>(value.array);
+		case Value::Kind::Function:
+			return unpack_function(value.integer, w);
+		case Value::Kind::Snapshot:
+			return value.snapshot->restore(*rt);
+		case Value::Kind::List:
+		{
+			Array<Variant> items;
+			items.reserve(intptr_t(value.items.size()));
+			for (auto &item : value.items) {
+				items.append(unpack(item, w));
+			}
+			return make_handle<List>(rt, std::move(items));
+		}
+		case Value::Kind::Table:
+		{
+			Table::Storage map;
+			for (size_t i = 0; i < value.items.size(); i += 2) {
+				map.insert({ unpack(value.items[i], w), unpack(value.items[i+1], w) });
+			}
+			return make_handle<Table>(rt, std::move(map));
+		}
+		case Value::Kind::Set:
+		{
+			Set::Storage set;
+			for (auto &item : value.items) {
+				set.insert(unpack(item, w));
+			}
+			return make_handle<Set>(rt, std::move(set));
+		}
+	}
+
+	return Variant();
+}
+
+Variant TaskPool::unpack_function(intptr_t index, Worker &w)
+{
+	if (w.functions.empty()) {
+		w.functions.resize(w.prog.functions.size());
+	}
+	if (!w.functions[index].is_null()) {
+		return w.functions[index];
+	}
+
+	auto rt = w.runtime;
+	auto &image = w.prog.functions[index];
+	auto func = make_handle<Function>(rt, image.name);
+	// Register the function first, since its upvalues may refer to it.
+	w.functions[index] = func;
+
+	if (image.has_native)
+	{
+		auto slot = rt->globals->find_slot(image.name);
+		auto builtin = (slot < 0) ? nullptr : &rt->globals->get_slot(slot).resolve();
+
+		if (!builtin || !check_type<Function>(*builtin)) {
+			throw error("[Parallel error] Function \"%\" is not available in parallel tasks", image.name);
+		}
+		for (auto &c : raw_cast<Function>(*builtin).closures)
+		{
+			if (c->routine->is_native()) {
+				func->add_closure(c);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < image.routines.size(); i++)
+	{
+		auto c = make_handle<Closure>(rt, copy_routine(*image.routines[i], nullptr, w.prog, *rt));
+
+		for (auto &value : image.upvalues[i])
+		{
+			auto var = unpack(value, w);
+			c->upvalues.emplace_back(var.make_alias());
+		}
+		func->add_closure(std::move(c));
+	}
+
+	return w.functions[index];
+}
+
+void TaskPool::run(Worker &w)
+{
+	try
+	{
+		Runtime rt(w.prog.program_path);
+		w.runtime = &rt;
+		rt.print = [&w](const String &s) { w.output.append(s); };
+
+		try
+		{
+			for (auto &path : w.prog.import_paths) {
+				rt.add_import_path(path);
+			}
+			if (w.prog.setup) {
+				w.prog.setup->restore(rt);
+			}
+			for (auto &g : w.prog.globals)
+			{
+				// Don't override the worker's builtins.
+				if (rt.globals->find_slot(g.first) < 0) {
+					rt[g.first] = unpack(g.second, w);
+				}
+			}
+			auto func = unpack_function(0, w);
+			intptr_t i;
+
+			while (!w.failed && (i = w.next++) < intptr_t(w.prog.items.size()))
+			{
+				rt.push(func);
+				rt.push(unpack(w.prog.items[i], w));
+				rt.call(1);
+				w.results[i] = pack(rt.peek(), nullptr, w.visiting);
+				rt.pop();
+			}
+		}
+		catch (std::exception &e)
+		{
+			w.error_message = e.what();
+			w.failed = true;
+		}
+		// Objects must be destroyed before their runtime.
+		w.functions.clear();
+		w.runtime = nullptr;
+	}
+	catch (std::exception &e)
+	{
+		w.error_message = e.what();
+		w.failed = true;
+	}
+}
+
+} // namespace phonometrica
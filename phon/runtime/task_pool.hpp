@@ -0,0 +1,109 @@
+/***********************************************************************************************************************
+ *                                                                                                                     *
+ * Copyright (C) 2019-2022 Julien Eychenne                                                                             *
+ *                                                                                                                     *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public   *
+ * License as published by the Free Software Foundation, either version 2 of the License, or (at your option) any      *
+ * later version.                                                                                                      *
+ *                                                                                                                     *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied  *
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more       *
+ * details.                                                                                                            *
+ *                                                                                                                     *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see              *
+ * <http://www.gnu.org/licenses/>.                                                                                     *
+ *                                                                                                                     *
+ * Created: 17/10/2026                                                                                                 *
+ *                                                                                                                     *
+ * Purpose: run script functions over a list of values in parallel. Each worker thread owns a private                  *
+ * runtime, and values are copied between runtimes.                                                                    *
+ *                                                                                                                     *
+ ***********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_TASK_POOL_HPP
+#define PHONOMETRICA_TASK_POOL_HPP
+
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <phon/runtime/list.hpp>
+#include <phon/runtime/function.hpp>
+
+namespace phonometrica {
+
+class Runtime;
+
+// A runtime can only be used by one thread, so a task pool never shares objects between threads. Each worker thread
+// creates its own runtime, into which the function and the items are copied. Results are copied back into the calling
+// runtime once all workers have finished. Scalars, strings, lists, tables, sets and arrays can be copied. A function
+// is copied together with its captured variables and with the user-defined functions and global values that it refers
+// to. Other objects, such as the application's documents, can be passed as snapshots (see below). Output printed by a
+// worker is shown when it finishes.
+class TaskPool final
+{
+public:
+
+	// A copy of an object that the task pool can't copy by itself. Snapshots are taken in the calling thread and must
+	// not refer to any object owned by a runtime. Each worker restores the snapshot as a new object in its own runtime.
+	struct Snapshot
+	{
+		virtual ~Snapshot() = default;
+
+		virtual Variant restore(Runtime &rt) const = 0;
+	};
+
+	// Takes a snapshot of a value, or returns null if the value is not supported.
+	using Packer = std::function<std::shared_ptr<Snapshot>(Variant &value)>;
+
+	// Called in the calling thread before the workers start. The snapshot it returns, if any, is restored in each worker
+	// runtime before anything else is copied into it, so that the application can define its own types and functions.
+	using Initializer = std::function<std::shared_ptr<Snapshot>(Runtime &rt)>;
+
+	// The application sets these once at start-up. The calling thread is blocked while the workers are running, so
+	// workers may read (but never modify) state owned by the application.
+	static void set_packer(Packer packer);
+
+	static void set_initializer(Initializer init);
+
+	// If thread_count is 0, one thread per core is used.
+	explicit TaskPool(Runtime &rt, int thread_count = 0);
+
+	// Call func on each item and return the results in the same order as the items.
+	Handle<List> map(Function &func, List &items);
+
+private:
+
+	struct Value;
+
+	struct FunctionImage;
+
+	struct Program;
+
+	struct Worker;
+
+	static Value pack(const Variant &var, Program *prog, std::unordered_set<const void*> &visiting);
+
+	static intptr_t pack_function(Function &func, Program &prog);
+
+	void pack_globals(Program &prog);
+
+	static std::shared_ptr<Routine> clone_routine(const Routine &r, Routine *parent);
+
+	static std::shared_ptr<Routine> copy_routine(const Routine &r, Routine *parent, Program &prog);
+
+	static std::shared_ptr<Routine> copy_routine(const Routine &r, Routine *parent, const Program &prog, Runtime &rt);
+
+	static Variant unpack(const Value &value, Worker &w);
+
+	static Variant unpack_function(intptr_t index, Worker &w);
+
+	static void run(Worker &w);
+
+	Runtime &rt;
+
+	int thread_count;
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_TASK_POOL_HPP
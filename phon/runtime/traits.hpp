@@ -40,6 +40,7 @@ class TableIterator;
 class StringIterator;
 class FileIterator;
 class RegexIterator;
+class ArrayIterator;
 template<class T> class Array;
 
 // Dummy base class for Float and Integer
@@ -65,6 +66,7 @@ NON_CYCLIC(TableIterator);
 NON_CYCLIC(StringIterator);
 NON_CYCLIC(FileIterator);
 NON_CYCLIC(RegexIterator);
+NON_CYCLIC(ArrayIterator);
 NON_CYCLIC(Array<double>);
 
 #undef NON_CYCLIC
@@ -377,9 +377,15 @@ bool Variant::operator!=(const Variant &other) const
 
 bool Variant::to_boolean() const
 {
-	// There are only 3 values that evaluate to false: null, false and nan. Everything else is true.
+	// There are only 3 values that evaluate to false: null, false and nan. Everything else is true, except arrays: since
+	// comparisons on arrays are element-wise, their truth value would be ambiguous.
 	switch (m_data_type)
 	{
+		case Datatype::Object:
+			if (unlikely(check_type<Array<double>>(*this))) {
+				throw error("[Type error] An array cannot be used as a condition: use all() or any() to test its elements");
+			}
+			return true;
 		case Datatype::Boolean:
 			return raw_cast<bool>(*this);
 		case Datatype::Null:
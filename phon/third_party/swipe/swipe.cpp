@@ -42,6 +42,7 @@
 
 #ifdef PHON_USE_FFTW
 #include <fftw3.h>   // http://www.fftw.org/
+#include <phon/analysis/signal_processing.hpp>
 #else
 
 #include <ffts.h>
@@ -167,7 +168,11 @@ matrix loudness(vector x, vector fERBs, double nyquist, int w, int w2)
 	// testing showed this configuration of fftw to be fastest
 	double *fi = (double*) fftw_malloc(sizeof(double) * w);
 	fftw_complex *fo = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * w);
-	fftw_plan plan = fftw_plan_dft_r2c_1d(w, fi, fo, FFTW_ESTIMATE);
+	fftw_plan plan;
+	{
+		std::lock_guard<std::mutex> lock(phonometrica::speech::fftw_planner_mutex());
+		plan = fftw_plan_dft_r2c_1d(w, fi, fo, FFTW_ESTIMATE);
+	}
 #else
 	std::vector<std::complex<float>> fi(w);
 	std::vector<std::complex<float>> fo(w);
@@ -257,7 +262,10 @@ matrix loudness(vector x, vector fERBs, double nyquist, int w, int w2)
 	}
 
 #ifdef PHON_USE_FFTW
-	fftw_destroy_plan(plan);
+	{
+		std::lock_guard<std::mutex> lock(phonometrica::speech::fftw_planner_mutex());
+		fftw_destroy_plan(plan);
+	}
 	fftw_free(fi);
 	fftw_free(fo);
 #else
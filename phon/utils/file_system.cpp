@@ -24,6 +24,7 @@
 #if PHON_WINDOWS
 	#include <Shlwapi.h>
 	#include <ShlObj.h>
+	#include <sys/stat.h>
 #else
 
 	#include <sys/stat.h>
@@ -533,6 +534,49 @@ bool is_file(const String &path)
 	}
 }
 
+int64_t last_modified(const String &path)
+{
+#if PHON_WINDOWS
+	struct _stat64 st;
+	auto p = path.to_wide();
+	if (_wstat64(p.data(), &st) != 0) {
+		return -1;
+	}
+#else
+	struct stat st;
+	if (stat(path.data(), &st) != 0) {
+		return -1;
+	}
+#endif
+	return int64_t(st.st_mtime);
+}
+
+bool get_file_stamp(const String &path, int64_t &mtime, int64_t &size)
+{
+#if PHON_WINDOWS
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	auto p = path.to_wide();
+	if (!GetFileAttributesExW(p.data(), GetFileExInfoStandard, &data)) {
+		return false;
+	}
+	// FILETIME counts 100-nanosecond intervals since 1601.
+	mtime = (int64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+	size = (int64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+#else
+	struct stat st;
+	if (stat(path.data(), &st) != 0) {
+		return false;
+	}
+#if PHON_MACOS
+	mtime = int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+	size = int64_t(st.st_size);
+#endif
+	return true;
+}
+
 bool clear_directory(const String &path)
 {
 	if (is_directory(path))
@@ -69,6 +69,14 @@ bool is_directory(const String &path);
 
 bool is_file(const String &path);
 
+// Last modification time of a file, in seconds since the epoch, or -1 if the file doesn't exist.
+int64_t last_modified(const String &path);
+
+// Last modification time of a file, with sub-second resolution where the file system provides it, and size in bytes.
+// The unit of the time stamp depends on the platform, so it should only be compared for equality. Returns false if
+// the file doesn't exist.
+bool get_file_stamp(const String &path, int64_t &mtime, int64_t &size);
+
 bool clear_directory(const String &path);
 
 void rename(std::string_view old_name, std::string_view new_name);
@@ -0,0 +1,73 @@
+/**********************************************************************************************************************
+ *                                                                                                                    *
+ * Copyright (C) 2019-2022 Julien Eychenne <jeychenne@gmail.com>                                                      *
+ *                                                                                                                    *
+ * The contents of this file are subject to the Mozilla Public License Version 2.0 (the "License"); you may not use   *
+ * this file except in compliance with the License. You may obtain a copy of the License at                           *
+ * http://www.mozilla.org/MPL/.                                                                                       *
+ *                                                                                                                    *
+ * Created: 17/10/2026                                                                                                *
+ *                                                                                                                    *
+ * Purpose: see header.                                                                                               *
+ *                                                                                                                    *
+ **********************************************************************************************************************/
+
+#include <algorithm>
+#include <phon/utils/thread_pool.hpp>
+
+namespace phonometrica {
+
+ThreadPool::ThreadPool(int thread_count)
+{
+	if (thread_count <= 0) {
+		thread_count = (std::max)(int(std::thread::hardware_concurrency()), 1);
+	}
+
+	m_threads.reserve(size_t(thread_count));
+	for (int i = 0; i < thread_count; i++) {
+		m_threads.emplace_back(&ThreadPool::run, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+	}
+	m_cond.notify_all();
+
+	for (auto &t : m_threads) {
+		t.join();
+	}
+}
+
+void ThreadPool::submit(Task task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_cond.notify_one();
+}
+
+void ThreadPool::run()
+{
+	while (true)
+	{
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cond.wait(lock, [this]() { return m_closed || !m_tasks.empty(); });
+			// Pending tasks are completed before the pool is closed.
+			if (m_tasks.empty()) {
+				return;
+			}
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
+
+} // namespace phonometrica
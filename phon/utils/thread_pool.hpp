@@ -0,0 +1,63 @@
+/**********************************************************************************************************************
+ *                                                                                                                    *
+ * Copyright (C) 2019-2022 Julien Eychenne <jeychenne@gmail.com>                                                      *
+ *                                                                                                                    *
+ * The contents of this file are subject to the Mozilla Public License Version 2.0 (the "License"); you may not use   *
+ * this file except in compliance with the License. You may obtain a copy of the License at                           *
+ * http://www.mozilla.org/MPL/.                                                                                       *
+ *                                                                                                                    *
+ * Created: 17/10/2026                                                                                                *
+ *                                                                                                                    *
+ * Purpose: a fixed-size pool of worker threads which run tasks in submission order.                                  *
+ *                                                                                                                    *
+ **********************************************************************************************************************/
+
+#ifndef PHONOMETRICA_THREAD_POOL_HPP
+#define PHONOMETRICA_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace phonometrica {
+
+class ThreadPool final
+{
+public:
+
+	using Task = std::function<void()>;
+
+	// Create a pool with the given number of threads. If the number is not positive, one thread per core is used.
+	explicit ThreadPool(int thread_count = 0);
+
+	ThreadPool(const ThreadPool &) = delete;
+
+	// Wait for all pending tasks to complete.
+	~ThreadPool();
+
+	// Tasks must not throw.
+	void submit(Task task);
+
+	int thread_count() const { return int(m_threads.size()); }
+
+private:
+
+	void run();
+
+	std::vector<std::thread> m_threads;
+
+	std::deque<Task> m_tasks;
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_cond;
+
+	bool m_closed = false;
+};
+
+} // namespace phonometrica
+
+#endif // PHONOMETRICA_THREAD_POOL_HPP
@@ -3,6 +3,7 @@
 #include <phon/gui/application.hpp>
 #include <phon/application/settings.hpp>
 #include <phon/application/project.hpp>
+#include <phon/utils/file_system.hpp>
 
 #else
 #include <phon/runtime.hpp>
@@ -26,9 +27,43 @@ static void show_usage()
 	std::cout << "Usage: program [option] file" << std::endl;
 	std::cout << "Options: " << std::endl;
 	std::cout << " -l\t(list)\tlist bytecode (disassemble) file" << std::endl;
+	std::cout << " -u\t(unoptimized)\tlist bytecode without optimizations" << std::endl;
 	std::cout << " -r\t(run)\texecute file" << std::endl;
 	std::cout << " -a\t(all)\tdisassemble and execute file" << std::endl;
+	std::cout << " -q\t(query)\trun a query file on a project and write the concordance as CSV: -q project query output" << std::endl;
+}
+
+#ifdef PHON_GUI
+static void run_query(const String &project_path, const String &query_path, const String &output_path)
+{
+	auto project = Project::get();
+	project->open(project_path);
+
+	// Use the query registered in the project if there is one, otherwise read it from disk.
+	auto path = filesystem::full_path(query_path);
+	Handle<Query> query;
+	auto file = project->get(path);
+
+	if (file && file->is<Query>())
+	{
+		query = recast<Query>(file);
+	}
+	else
+	{
+		if (!filesystem::exists(path)) {
+			throw error("Query file \"%\" does not exist", query_path);
+		}
+		query = make_handle<Query>(project->queries().get(), path);
+	}
+
+	if (Project::get_query_type(path) != Query::Type::Text) {
+		throw error("Cannot run query \"%\": only text queries can be run from the command line", query_path);
+	}
+	query->open();
+	auto conc = query->execute();
+	conc->to_csv(output_path, ",");
 }
+#endif
 
 static void initialize(Runtime &rt)
 {
@@ -123,10 +158,32 @@ int main(int argc, char **argv)
 				auto closure = runtime.compile_file(path);
 				runtime.disassemble(*closure, "main");
 			}
+			else if (option == "-u") // unoptimized list
+			{
+				auto closure = runtime.compile_file(path, false);
+				runtime.disassemble(*closure, "main");
+			}
 			else if (option == "-r") // run
 			{
 				runtime.do_file(path);
 			}
+			else if (option == "-q") // query
+			{
+#ifdef PHON_GUI
+				if (argc > 4)
+				{
+					run_query(path, argv[3], argv[4]);
+				}
+				else
+				{
+					show_usage();
+					error_code = 1;
+				}
+#else
+				utils::print(stderr, "Queries are not available in this build\n");
+				error_code = 1;
+#endif
+			}
 			else if (option == "-a") // all
 			{
 				auto closure = runtime.compile_file(path);
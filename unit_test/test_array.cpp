@@ -1,6 +1,8 @@
 #include <phon/third_party/catch.hpp>
 #include <phon/string.hpp>
 #include <phon/array.hpp>
+#include <phon/runtime/array_math.hpp>
+#include <phon/runtime.hpp>
 #include <iostream>
 
 using namespace phonometrica;
@@ -28,3 +30,49 @@ TEST_CASE("Test array", "[Array]")
 	REQUIRE(mat.ndim() == 2);
 }
 
+TEST_CASE("Test element-wise array operations", "[Array]")
+{
+	Array<double> x = { 1, 2, 3, 4 };
+	Array<double> y = { 10, 20, 30, 40 };
+
+	auto z = array_op(ArrayOp::Add, x, y);
+	REQUIRE(z.ndim() == 1);
+	REQUIRE(z[4] == 44);
+	z = array_op(ArrayOp::Subtract, 1.0, x);
+	REQUIRE(z[2] == -1);
+	z = array_op(ArrayOp::Less, x, 3.0);
+	REQUIRE((z[2] == 1 && z[3] == 0));
+	REQUIRE(sum(x) == 10);
+	REQUIRE(mean(y) == 25);
+	REQUIRE((minimum(x) == 1 && maximum(y) == 40));
+
+	// Broadcast a column vector to each column of a matrix.
+	Array<double> m(3, 2, 1.0);
+	Array<double> col = { 1, 2, 3 };
+	z = array_op(ArrayOp::Multiply, m, col);
+	REQUIRE((z.nrow() == 3 && z.ncol() == 2));
+	REQUIRE((z(3, 1) == 3 && z(3, 2) == 3));
+	REQUIRE_THROWS(array_op(ArrayOp::Add, m, x));
+}
+
+TEST_CASE("Test array comparisons in conditions", "[Array]")
+{
+	// The truth value of an array is ambiguous, so arrays can't be used as conditions. The optimizer fuses a comparison
+	// with the following jump: the result must not depend on it.
+	Runtime rt("");
+	rt.do_string("a = ones(3)");
+	REQUIRE_THROWS(rt.do_string("local b = a < 2\nif b then x = 1 end"));
+	REQUIRE_THROWS(rt.do_string("if a < 2 then x = 1 end"));
+	REQUIRE_THROWS(rt.do_string("if a >= 2 then x = 1 end"));
+	REQUIRE_THROWS(rt.do_string("local b = a >= 2\nif b then x = 1 end"));
+	REQUIRE_THROWS(rt.do_string("if a then x = 1 end"));
+
+	auto result = rt.do_string("local x = 0\n"
+							   "if all(a < 2) then x = x + 1 end\n"
+							   "if any(a >= 2) then x = x + 2 end\n"
+							   "if not all(a >= 2) then x = x + 4 end\n"
+							   "local b = a < 2\n"
+							   "if any(b) then x = x + 8 end\n"
+							   "return x");
+	REQUIRE(result.resolve().get_number() == 13);
+}
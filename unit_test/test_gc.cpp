@@ -0,0 +1,38 @@
+#include <phon/third_party/catch.hpp>
+#include <phon/runtime.hpp>
+
+using namespace phonometrica;
+
+TEST_CASE("Test cycle collection", "[GC]")
+{
+	Runtime rt("");
+	rt.set_gc_slice(100);
+
+	for (int i = 0; i < 5000; i++)
+	{
+		auto a = make_handle<List>(&rt);
+		auto b = make_handle<List>(&rt);
+		a->items().append(b);
+		b->items().append(a);
+	}
+	rt.full_collect();
+	REQUIRE(rt.gc_stats().freed >= 10000);
+	REQUIRE(rt.gc_pending() == 0);
+
+	// A long chain must not overflow the C++ stack.
+	auto freed = rt.gc_stats().freed;
+	{
+		auto head = make_handle<List>(&rt);
+		auto node = head;
+
+		for (int i = 0; i < 200000; i++)
+		{
+			auto next = make_handle<List>(&rt);
+			node->items().append(next);
+			node = next;
+		}
+		node->items().append(head);
+	}
+	rt.full_collect();
+	REQUIRE(rt.gc_stats().freed - freed == 200001);
+}